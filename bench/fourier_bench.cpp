@@ -0,0 +1,566 @@
+// Benchmarks of the operations of the C++ library, on synthetic images of a range of sizes and on the JPEGs in test/.
+// Results are printed as a table, or written as JSON in the format of Google Benchmark, so that they can be compared
+//     across releases with its tools. Besides the times, every result has the throughput of the operation in pixels
+//     (items_per_second) and in megapixels (megapixels_per_second) per second.
+//
+// Usage: fourier_bench [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>]
+//                      [--benchmark_format=console|json] [--benchmark_out=<file>]
+//                      [--sizes=<megapixels>,...] [--images=<directory>] [--threads=<n>]
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <regex>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <dirent.h>
+#include <unistd.h>
+#include "Image.hpp"
+#include "Kernel.hpp"
+#include "EdgeDetect.hpp"
+#include "Hysteresis.hpp"
+#include "ThreadPool.hpp"
+#include "Simd.hpp"
+
+// set by CMake.
+#ifndef FOURIER_TEST_IMAGES
+#define FOURIER_TEST_IMAGES "test"
+#endif
+#ifndef FOURIER_BUILD_TYPE
+#define FOURIER_BUILD_TYPE ""
+#endif
+
+#define DEFAULT_SIZES "0.3,2,12,50"
+#define DEFAULT_MIN_TIME 0.5
+#define JPEG_QUALITY 90
+
+// An operation to time: setup() is called before every run of op(), untimed, e.g. to copy the input which op()
+//      overwrites. Throughput is computed from the w x h pixels which a run processes.
+struct Timed {
+    std::function<void()> setup, op;
+    ssize_t w, h;
+};
+
+// A benchmark: prepare() is called once, untimed, to compute its inputs, which are freed along with the Timed
+//      it returns once the benchmark has run.
+struct Benchmark {
+    std::string name;
+    std::function<Timed()> prepare;
+};
+
+struct Result {
+    std::string name;
+    ssize_t iterations;
+    // per iteration, in milliseconds. cpu_time is that of every thread of the process.
+    double real_time, cpu_time;
+    ssize_t w, h;
+
+    double megapixels_per_second() const { return w * h / (real_time * 1e3); }
+};
+
+// An image on which the benchmarks are run, loaded when the first of them is prepared.
+struct Input {
+    std::string label;
+    // the JPEG which the image is read from, or empty for synthetic images.
+    std::string path;
+    std::function<Image()> load;
+    std::shared_ptr<Image> image;
+
+    const Image& get() {
+        if (!image)
+            image = std::make_shared<Image>(load());
+        return *image;
+    }
+};
+
+// A file which is removed when it goes out of scope.
+struct TempFile {
+    std::string path;
+
+    TempFile(const std::string& name) {
+        const char *dir = getenv("TMPDIR");
+        path = std::string(dir ? dir : "/tmp") + "/fourier_bench_" + std::to_string(getpid()) + "_" + name;
+    }
+    ~TempFile() { std::remove(path.c_str()); }
+};
+
+static
+uint32_t
+hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// A w x h RGB image of smooth gradients, overlaid with a grid of squares, whose edges give canny_edge_detect work
+//      to do, and with noise, so that JPEGs of it are about as costly to encode and decode as photographs.
+// Pixels depend only on their coordinates, so images are the same from one run to the next.
+static
+Image
+synthetic(ssize_t w,
+          ssize_t h)
+{
+    Image im(w, h, RGB, BUFFER_UNINITIALIZED);
+    const ChannelType chs[] = { RED, GREEN, BLUE };
+    parallel_for(0, h, rows_per_task(w, 8), [&](ssize_t j0, ssize_t j1) {
+        for (size_t k = 0; k < 3; k++) {
+            for (ssize_t j = j0; j < j1; j++) {
+                float *row = im.buffer().row(chs[k], j);
+                for (ssize_t i = 0; i < w; i++) {
+                    float gradient = 255.0f * (i + (k + 1) * j) / (w + (k + 1) * h);
+                    float square = ((i / 64 + j / 64) % 2) ? 48.0f : -48.0f;
+                    float noise = (hash((uint32_t) (j * w + i) * 3 + k) & 31) - 16.0f;
+                    row[i] = std::max(0.0f, std::min(255.0f, gradient + square + noise));
+                }
+            }
+        }
+    });
+    return im;
+}
+
+// the 4:3 image of about megapixels megapixels.
+static
+Input
+synthetic_input(double megapixels)
+{
+    ssize_t w = (ssize_t) std::round(std::sqrt(megapixels * 1e6 * 4 / 3));
+    ssize_t h = w * 3 / 4;
+    std::stringstream label;
+    label << "synthetic_" << megapixels << "MP";
+    return Input { label.str(), "", [w, h] { return synthetic(w, h); }, nullptr };
+}
+
+// the JPEGs in dir, in the order of their names.
+static
+std::vector<Input>
+jpeg_inputs(const std::string& dir)
+{
+    std::vector<std::string> names;
+    if (DIR *d = opendir(dir.c_str())) {
+        while (struct dirent *entry = readdir(d)) {
+            std::string name = entry->d_name;
+            size_t dot = name.rfind('.');
+            if (dot != std::string::npos && (name.substr(dot) == ".jpeg" || name.substr(dot) == ".jpg"))
+                names.push_back(name);
+        }
+        closedir(d);
+    }
+    std::sort(names.begin(), names.end());
+
+    std::vector<Input> inputs;
+    for (auto it = names.begin(); it != names.end(); ++it) {
+        std::string path = dir + "/" + *it;
+        inputs.push_back(Input { it->substr(0, it->rfind('.')), path, [path] {
+            Image im = Image::readJPEG(path.c_str());
+            im.to_RGB();
+            return im;
+        }, nullptr });
+    }
+    return inputs;
+}
+
+// times op on a copy of the input converted by convert, made afresh before every run.
+static
+Benchmark
+on_copy(const std::string& name,
+        Input& input,
+        std::function<void(Image&)> convert,
+        std::function<void(Image&)> op)
+{
+    return Benchmark { name, [&input, convert, op] {
+        std::shared_ptr<Image> original = std::make_shared<Image>(input.get());
+        if (convert)
+            convert(*original);
+        std::shared_ptr<Image> im = std::make_shared<Image>(*original);
+        return Timed { [original, im] { *im = *original; },
+                       [im, op] { op(*im); },
+                       original->width(), original->height() };
+    } };
+}
+
+// times op on the input, which it leaves as it is.
+static
+Benchmark
+on_input(const std::string& name,
+         Input& input,
+         std::function<void(const Image&)> op)
+{
+    return Benchmark { name, [&input, op] {
+        const Image& im = input.get();
+        return Timed { [] {}, [&im, op] { op(im); }, im.width(), im.height() };
+    } };
+}
+
+// the benchmarks of every operation on input, named <operation>/<parameters>/<input>, or <operation>/<input>.
+static
+std::vector<Benchmark>
+benchmarks(Input& in)
+{
+    std::vector<Benchmark> b;
+    const std::string& l = in.label;
+    auto to_YCbCr = [](Image& im) { im.to_YCbCr(); };
+    auto to_gray = [](Image& im) { im.to_gray(); };
+    auto to_CMYK = [](Image& im) {
+        // there is no conversion to CMYK, so its channels are filled from the inverted RGB channels.
+        Image cmyk(im.width(), im.height(), CMYK, BUFFER_UNINITIALIZED);
+        const ChannelType from[] = { RED, GREEN, BLUE }, to[] = { CYAN, MAGENTA, YELLOW };
+        for (ssize_t j = 0; j < im.height(); j++) {
+            float *k = cmyk.buffer().row(BLACK, j);
+            for (ssize_t i = 0; i < im.width(); i++)
+                k[i] = 255.0f;
+            for (size_t c = 0; c < 3; c++) {
+                const float *src = im.buffer().row(from[c], j);
+                float *dst = cmyk.buffer().row(to[c], j);
+                for (ssize_t i = 0; i < im.width(); i++) {
+                    dst[i] = 255.0f - src[i];
+                    k[i] = std::min(k[i], dst[i]);
+                }
+            }
+        }
+        im = std::move(cmyk);
+    };
+
+    // convolutions with dense, i.e. not separable, kernels of several sizes.
+    const ssize_t kernel_sizes[] = { 3, 5, 9, 15 };
+    for (size_t s = 0; s < sizeof(kernel_sizes) / sizeof(kernel_sizes[0]); s++) {
+        ssize_t n = kernel_sizes[s];
+        Kernel kern(n, KernelRow(n));
+        for (ssize_t j = 0; j < n; j++)
+            for (ssize_t i = 0; i < n; i++)
+                kern[j][i] = (1.0f + (hash(j * n + i) & 7)) / (4.5f * n * n);
+        b.push_back(on_copy("convolve/" + std::to_string(n) + "x" + std::to_string(n) + "/" + l, in, nullptr,
+                            [kern](Image& im) { im.convolve(kern); }));
+    }
+
+    // the gaussian blurs, with the same kernel in every method so that their costs can be compared.
+    b.push_back(on_copy("gaussian_blur_naive/3.0,9/" + l, in, nullptr,
+                        [](Image& im) { im.gaussian_blur_naive(3.0f, 9); }));
+    b.push_back(on_copy("gaussian_blur/3.0,9/" + l, in, nullptr,
+                        [](Image& im) { im.gaussian_blur(3.0f, 9); }));
+    b.push_back(on_copy("gaussian_blur/3.0,9,fir/" + l, in, nullptr,
+                        [](Image& im) { im.gaussian_blur(3.0f, 9, BLUR_FIR); }));
+    b.push_back(on_copy("gaussian_blur/3.0,9,iir/" + l, in, nullptr,
+                        [](Image& im) { im.gaussian_blur(3.0f, 9, BLUR_IIR); }));
+    b.push_back(on_copy("gaussian_blur/10.0,30/" + l, in, nullptr,
+                        [](Image& im) { im.gaussian_blur(10.0f, 30); }));
+    b.push_back(on_copy("box_blur/2/" + l, in, nullptr, [](Image& im) { im.box_blur(2); }));
+    b.push_back(on_copy("box_blur/15/" + l, in, nullptr, [](Image& im) { im.box_blur(15); }));
+    b.push_back(on_copy("fast_gaussian_blur/10.0/" + l, in, nullptr,
+                        [](Image& im) { im.fast_gaussian_blur(10.0f); }));
+
+    // colour conversions.
+    b.push_back(on_copy("to_YCbCr/RGB/" + l, in, nullptr, to_YCbCr));
+    b.push_back(on_copy("to_YCbCr/RGB,fixed16/" + l, in, nullptr,
+                        [](Image& im) { im.to_YCbCr(COLOR_FIXED16); }));
+    b.push_back(on_copy("to_YCbCr/GRAY/" + l, in, to_gray, to_YCbCr));
+    b.push_back(on_copy("to_RGB/YCbCr/" + l, in, to_YCbCr, [](Image& im) { im.to_RGB(); }));
+    b.push_back(on_copy("to_RGB/YCbCr,fixed16/" + l, in, to_YCbCr,
+                        [](Image& im) { im.to_RGB(COLOR_FIXED16); }));
+    b.push_back(on_copy("to_RGB/GRAY/" + l, in, to_gray, [](Image& im) { im.to_RGB(); }));
+    b.push_back(on_copy("to_RGB/CMYK/" + l, in, to_CMYK, [](Image& im) { im.to_RGB(); }));
+    b.push_back(on_copy("to_gray/RGB/" + l, in, nullptr, to_gray));
+    b.push_back(on_copy("to_gray/RGB,fixed16/" + l, in, nullptr, [](Image& im) { im.to_gray(COLOR_FIXED16); }));
+    b.push_back(on_copy("to_gray/YCbCr/" + l, in, to_YCbCr, to_gray));
+
+    // the stages of canny_edge_detect with its default parameters, each on the output of the last, and the whole.
+    auto blurred = [to_gray](Image& im) { to_gray(im); im.gaussian_blur(1.4f, 2); };
+    auto gradient = [blurred](Image& im) {
+        blurred(im);
+        Image edges(im.width(), im.height(), GRAY, BUFFER_UNINITIALIZED);
+        canny_gradient(im.buffer().plane(INTENSITY), im.buffer().stride(),
+                       edges.buffer().plane(INTENSITY), edges.buffer().stride(),
+                       im.width(), im.height(), EDGE_SOBEL, 76.8f, 25.6f, Image::get_max_intensity());
+        im = std::move(edges);
+    };
+    b.push_back(on_copy("canny_edge_detect/to_gray/" + l, in, nullptr, to_gray));
+    b.push_back(on_copy("canny_edge_detect/gaussian_blur/" + l, in, to_gray,
+                        [](Image& im) { im.gaussian_blur(1.4f, 2); }));
+    b.push_back(Benchmark { "canny_edge_detect/gradient/" + l, [&in, blurred] {
+        std::shared_ptr<Image> src = std::make_shared<Image>(in.get());
+        blurred(*src);
+        std::shared_ptr<Image> dst = std::make_shared<Image>(src->width(), src->height(), GRAY,
+                                                             BUFFER_UNINITIALIZED);
+        return Timed { [] {}, [src, dst] {
+            canny_gradient(src->buffer().plane(INTENSITY), src->buffer().stride(),
+                           dst->buffer().plane(INTENSITY), dst->buffer().stride(),
+                           src->width(), src->height(), EDGE_SOBEL, 76.8f, 25.6f, Image::get_max_intensity());
+        }, src->width(), src->height() };
+    } });
+    b.push_back(on_copy("canny_edge_detect/hysteresis/" + l, in, gradient, [](Image& im) {
+        hysteresis(im.buffer().plane(INTENSITY), im.buffer().stride(), im.width(), im.height(),
+                   Image::get_max_intensity());
+    }));
+    b.push_back(on_copy("canny_edge_detect/" + l, in, nullptr, [](Image& im) { im.canny_edge_detect(); }));
+
+    // elementwise operators, assigned to an image of the same size, so that no memory is allocated.
+    auto elementwise = [&in](const std::string& name, std::function<void(const Image&, const Image&, Image&)> op) {
+        return Benchmark { name, [&in, op] {
+            std::shared_ptr<Image> x = std::make_shared<Image>(in.get());
+            std::shared_ptr<Image> y = std::make_shared<Image>(*x * 0.5f + 1.0f);
+            std::shared_ptr<Image> out = std::make_shared<Image>(*x);
+            return Timed { [] {}, [x, y, out, op] { op(*x, *y, *out); }, x->width(), x->height() };
+        } };
+    };
+    b.push_back(elementwise("operator+/" + l, [](const Image& x, const Image& y, Image& out) { out = x + y; }));
+    b.push_back(elementwise("operator*/" + l, [](const Image& x, const Image& y, Image& out) { out = x * y; }));
+    b.push_back(elementwise("operator*,operator+/scalar/" + l, [](const Image& x, const Image&, Image& out) {
+        out = x * 0.5f + 1.0f;
+    }));
+    b.push_back(elementwise("pow/" + l, [](const Image& x, const Image&, Image& out) { out = pow(x, 2.2f); }));
+    b.push_back(elementwise("sqrt/" + l, [](const Image& x, const Image& y, Image& out) {
+        out = sqrt(x * x + y * y);
+    }));
+    b.push_back(elementwise("atan2/" + l, [](const Image& x, const Image& y, Image& out) { out = atan2(x, y); }));
+
+    // JPEG coding; inputs which are not read from a JPEG are encoded to one first.
+    b.push_back(Benchmark { "readJPEG/" + l, [&in, l] {
+        std::shared_ptr<TempFile> tmp;
+        std::string path = in.path;
+        if (path.empty()) {
+            tmp = std::make_shared<TempFile>(l + ".jpeg");
+            in.get().writeJPEG(tmp->path.c_str(), JPEG_QUALITY);
+            path = tmp->path;
+        }
+        return Timed { [] {}, [tmp, path] { Image::readJPEG(path.c_str()); }, in.get().width(), in.get().height() };
+    } });
+    b.push_back(Benchmark { "writeJPEG/" + l, [&in, l] {
+        std::shared_ptr<TempFile> tmp = std::make_shared<TempFile>(l + ".jpeg");
+        const Image& im = in.get();
+        return Timed { [] {}, [tmp, &im] { im.writeJPEG(tmp->path.c_str(), JPEG_QUALITY); }, im.width(), im.height() };
+    } });
+    b.push_back(on_input("encodeJPEG/" + l, in, [](const Image& im) { im.encodeJPEG(JPEG_QUALITY); }));
+
+    return b;
+}
+
+// Runs the benchmark until it has been timed for at least min_time seconds, after one untimed run which warms up
+//      caches, the thread pool and the plane pool.
+static
+Result
+run(const Benchmark& benchmark,
+    double min_time)
+{
+    Timed timed = benchmark.prepare();
+    timed.setup();
+    timed.op();
+
+    Result r { benchmark.name, 0, 0.0, 0.0, timed.w, timed.h };
+    double real = 0.0, cpu = 0.0;
+    while (r.iterations == 0 || real < min_time) {
+        timed.setup();
+        std::clock_t c0 = std::clock();
+        auto t0 = std::chrono::steady_clock::now();
+        timed.op();
+        auto t1 = std::chrono::steady_clock::now();
+        std::clock_t c1 = std::clock();
+        real += std::chrono::duration<double>(t1 - t0).count();
+        cpu += (double) (c1 - c0) / CLOCKS_PER_SEC;
+        r.iterations++;
+    }
+    r.real_time = real * 1e3 / r.iterations;
+    r.cpu_time = cpu * 1e3 / r.iterations;
+    return r;
+}
+
+static
+std::string
+json_string(const std::string& s)
+{
+    std::string out = "\"";
+    for (auto it = s.begin(); it != s.end(); ++it) {
+        if (*it == '"' || *it == '\\')
+            out += '\\';
+        out += *it;
+    }
+    return out + "\"";
+}
+
+static
+const char *
+simd_name(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_NONE: return "none";
+        case SIMD_SSE42: return "sse4.2";
+        case SIMD_AVX2: return "avx2";
+        case SIMD_AVX512: return "avx512";
+    }
+    return "?";
+}
+
+static
+void
+write_json(std::ostream& os,
+           const char *executable,
+           const std::vector<Result>& results)
+{
+    char date[64], host[256] = "";
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+    gethostname(host, sizeof(host) - 1);
+
+    os << "{\n"
+       << "  \"context\": {\n"
+       << "    \"date\": " << json_string(date) << ",\n"
+       << "    \"host_name\": " << json_string(host) << ",\n"
+       << "    \"executable\": " << json_string(executable) << ",\n"
+       << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+       << "    \"num_threads\": " << ThreadPool::instance().num_threads() << ",\n"
+       << "    \"simd_level\": " << json_string(simd_name(simd_level())) << ",\n"
+       << "    \"library_build_type\": " << json_string(FOURIER_BUILD_TYPE) << "\n"
+       << "  },\n"
+       << "  \"benchmarks\": [";
+    for (size_t k = 0; k < results.size(); k++) {
+        const Result& r = results[k];
+        os << (k ? ",\n" : "\n")
+           << "    {\n"
+           << "      \"name\": " << json_string(r.name) << ",\n"
+           << "      \"run_name\": " << json_string(r.name) << ",\n"
+           << "      \"run_type\": \"iteration\",\n"
+           << "      \"iterations\": " << r.iterations << ",\n"
+           << "      \"real_time\": " << r.real_time << ",\n"
+           << "      \"cpu_time\": " << r.cpu_time << ",\n"
+           << "      \"time_unit\": \"ms\",\n"
+           << "      \"width\": " << r.w << ",\n"
+           << "      \"height\": " << r.h << ",\n"
+           << "      \"items_per_second\": " << r.megapixels_per_second() * 1e6 << ",\n"
+           << "      \"megapixels_per_second\": " << r.megapixels_per_second() << "\n"
+           << "    }";
+    }
+    os << "\n  ]\n}\n";
+}
+
+static
+void
+print_header()
+{
+    printf("%-56s %12s %12s %10s %10s\n", "Benchmark", "Time (ms)", "CPU (ms)", "Iterations", "MP/s");
+    printf("%s\n", std::string(104, '-').c_str());
+}
+
+static
+void
+print_result(const Result& r)
+{
+    printf("%-56s %12.3f %12.3f %10zd %10.2f\n",
+           r.name.c_str(), r.real_time, r.cpu_time, r.iterations, r.megapixels_per_second());
+    fflush(stdout);
+}
+
+static
+void
+usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>]\n"
+            "       [--benchmark_format=console|json] [--benchmark_out=<file>]\n"
+            "       [--sizes=<megapixels>,...] [--images=<directory>] [--threads=<n>]\n"
+            "\n"
+            "Benchmarks are named <operation>/<parameters>/<image>, and those matching the filter are run.\n"
+            "Images are synthetic images of the given sizes (default " DEFAULT_SIZES " megapixels), and the\n"
+            "JPEGs in the given directory (default " FOURIER_TEST_IMAGES "); --images= skips the JPEGs.\n"
+            "Results are written to the output file as JSON, and printed as JSON or as a table.\n",
+            argv0);
+}
+
+int
+main(int argc,
+     char *argv[])
+{
+    std::string filter = ".", format = "console", out, sizes = DEFAULT_SIZES, images = FOURIER_TEST_IMAGES;
+    double min_time = DEFAULT_MIN_TIME;
+
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        size_t eq = arg.find('=');
+        std::string key = arg.substr(0, eq), value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (key == "--benchmark_filter")
+            filter = value;
+        else if (key == "--benchmark_min_time")
+            min_time = atof(value.c_str());
+        else if (key == "--benchmark_format" && (value == "console" || value == "json"))
+            format = value;
+        else if (key == "--benchmark_out")
+            out = value;
+        else if (key == "--sizes")
+            sizes = value;
+        else if (key == "--images")
+            images = value;
+        else if (key == "--threads" && atoi(value.c_str()) > 0)
+            ThreadPool::instance().set_num_threads(atoi(value.c_str()));
+        else {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::vector<Input> inputs;
+    std::stringstream size_list(sizes);
+    for (std::string size; std::getline(size_list, size, ',');)
+        if (!size.empty())
+            inputs.push_back(synthetic_input(atof(size.c_str())));
+    if (!images.empty()) {
+        std::vector<Input> jpegs = jpeg_inputs(images);
+        inputs.insert(inputs.end(), jpegs.begin(), jpegs.end());
+    }
+
+    std::regex re;
+    try {
+        re = std::regex(filter);
+    } catch (const std::regex_error& e) {
+        fprintf(stderr, "Invalid filter %s: %s\n", filter.c_str(), e.what());
+        return 1;
+    }
+
+    if (format == "console")
+        print_header();
+
+    // inputs are benchmarked one at a time, and freed before the next is loaded.
+    std::vector<Result> results;
+    for (size_t k = 0; k < inputs.size(); k++) {
+        std::vector<Benchmark> bs = benchmarks(inputs[k]);
+        for (auto it = bs.begin(); it != bs.end(); ++it) {
+            if (!std::regex_search(it->name, re))
+                continue;
+            try {
+                results.push_back(run(*it, min_time));
+            } catch (const std::exception& e) {
+                fprintf(stderr, "%s failed: %s\n", it->name.c_str(), e.what());
+                return 1;
+            }
+            if (format == "console")
+                print_result(results.back());
+        }
+        inputs[k].image.reset();
+    }
+
+    if (format == "json")
+        write_json(std::cout, argv[0], results);
+    if (!out.empty()) {
+        std::ofstream os(out);
+        write_json(os, argv[0], results);
+        if (!os) {
+            fprintf(stderr, "Could not write %s\n", out.c_str());
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#undef DEFAULT_SIZES
+#undef DEFAULT_MIN_TIME
+#undef JPEG_QUALITY
@@ -0,0 +1,168 @@
+#include "Batch.hpp"
+
+#include <cstdio>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "ThreadPool.hpp"
+
+// identifies a file, whatever the path it is reached by.
+struct FileId {
+    dev_t dev;
+    ino_t ino;
+
+    bool operator==(const FileId& other) const { return dev == other.dev && ino == other.ino; }
+};
+
+// the file at path, or false if there is none.
+static
+bool
+file_id(const std::string& path,
+        FileId& id)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st))
+        return false;
+    id = FileId { st.st_dev, st.st_ino };
+    return true;
+}
+
+// the path of the file called as path is in directory dir.
+static
+std::string
+output_path(const std::string& path,
+            const std::string& dir)
+{
+    size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    if (dir.empty())
+        return name;
+    return dir.back() == '/' ? dir + name : dir + "/" + name;
+}
+
+// Creates an empty file next to output, whose name is that of output followed by a suffix which no other file has,
+//     and returns its path.
+static
+std::string
+temporary_path(const std::string& output)
+{
+    static std::atomic<unsigned long> count { 0 };
+    for (;;) {
+        std::string path = output + "." + std::to_string(getpid()) + "." + std::to_string(count++) + ".tmp";
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd >= 0) {
+            close(fd);
+            return path;
+        }
+        if (errno != EEXIST) {
+            throw std::system_error(std::error_code(errno,
+                                                    std::generic_category()),
+                                    "Could not create a temporary file for " + output);
+        }
+    }
+}
+
+static
+void
+process_image(const Pipeline& pipeline,
+              const int quality,
+              const JPEGReadOptions& options,
+              BatchResult& result)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // The JPEG is written to a temporary file in the same directory, which replaces the output once it is complete,
+    //     so that an image which fails leaves the file which was there before, e.g. the output of an earlier batch,
+    //     as it was, rather than truncated and half written.
+    std::string temporary;
+    try {
+        temporary = temporary_path(result.output);
+        // run() only follows the edges of the hysteresis within its lookahead, so pipelines which have to see the
+        //     whole image are applied to it whole, as its methods would be.
+        if (pipeline.has_global_stage()) {
+            if (options.raw)
+                throw std::invalid_argument("Pipelines cannot read JPEGs raw.");
+            pipeline.apply(Image::readJPEG(result.path.c_str(), options)).writeJPEG(temporary.c_str(), quality);
+        } else {
+            pipeline.run(result.path.c_str(), temporary.c_str(), quality, options);
+        }
+        if (std::rename(temporary.c_str(), result.output.c_str())) {
+            throw std::system_error(std::error_code(errno,
+                                                    std::generic_category()),
+                                    "Could not replace " + result.output);
+        }
+        result.ok = true;
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    } catch (...) {
+        result.error = "Unknown error";
+    }
+    if (!result.ok && !temporary.empty())
+        std::remove(temporary.c_str());
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<BatchResult>
+process_batch(const std::vector<std::string>& paths,
+              const Pipeline& pipeline,
+              const std::string& out_dir,
+              size_t threads,
+              const int quality,
+              const JPEGReadOptions& options)
+{
+    std::vector<BatchResult> results(paths.size());
+    for (size_t k = 0; k < paths.size(); k++)
+        results[k] = BatchResult { paths[k], output_path(paths[k], out_dir), 0.0, false, std::string() };
+
+    // Outputs replace the files at their paths as soon as they are written, while other inputs may still be read,
+    //     so images whose output is an input of the batch, or the output of an earlier image, are rejected rather
+    //     than processed.
+    std::vector<FileId> inputs;
+    for (size_t k = 0; k < paths.size(); k++) {
+        FileId id;
+        if (file_id(paths[k], id))
+            inputs.push_back(id);
+    }
+    std::vector<bool> rejected(paths.size(), false);
+    for (size_t k = 0; k < results.size(); k++) {
+        FileId id;
+        if (file_id(results[k].output, id) && std::find(inputs.begin(), inputs.end(), id) != inputs.end()) {
+            results[k].error = "The output " + results[k].output + " is an input of the batch";
+            rejected[k] = true;
+            continue;
+        }
+        for (size_t k2 = 0; k2 < k && !rejected[k]; k2++) {
+            if (!rejected[k2] && results[k2].output == results[k].output) {
+                results[k].error = "The output " + results[k].output + " is also that of " + results[k2].path;
+                rejected[k] = true;
+            }
+        }
+    }
+
+    // the shared pool is never resized, as other threads may be using it: threads only limits the number of
+    //     images processed at once.
+    ThreadPool& pool = ThreadPool::instance();
+    size_t tasks = pool.num_threads();
+    if (threads > 0)
+        tasks = std::min(tasks, threads);
+
+    // One task per thread, each taking images until there are none left, so that images are handed out as threads
+    //     become free rather than in fixed chunks. A thread whose task has finished steals the tasks of the
+    //     parallel regions of the images still being processed.
+    std::atomic<size_t> next { 0 };
+    pool.parallel_for(0, tasks, 1, [&](ssize_t t0, ssize_t t1) {
+        for (ssize_t t = t0; t < t1; t++) {
+            for (size_t k = next++; k < results.size(); k = next++)
+                if (!rejected[k])
+                    process_image(pipeline, quality, options, results[k]);
+        }
+    });
+
+    return results;
+}
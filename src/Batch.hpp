@@ -0,0 +1,44 @@
+#ifndef __BATCH_H_
+#define __BATCH_H_
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "Image.hpp"
+#include "Pipeline.hpp"
+
+// The outcome of processing one image of a batch.
+struct BatchResult {
+    std::string path;
+    // the JPEG written. It is first written to a temporary file in the same directory, which replaces it once
+    //     complete, so that if processing fails, the file which was there before, if any, is left as it was.
+    std::string output;
+    // time taken to read, process and write the image, in seconds.
+    double seconds;
+    // true if the image was written; otherwise error holds the message of the exception thrown.
+    bool ok;
+    std::string error;
+};
+
+// Runs pipeline on the JPEGs at paths, writing each result to the JPEG with the same file name in out_dir, as
+//     pipeline.run(path, output, quality, options) would. Errors are reported in the result of the image which
+//     caused them, and do not stop the rest of the batch. Results are given in the order of paths.
+// Pipelines with a global stage, i.e. canny_edge_detect, whose hysteresis run() only follows within its lookahead,
+//     are instead applied to the whole image, as pipeline.apply(Image::readJPEG(path, options)) would be, so that
+//     their output is that of readJPEG, the methods of Image and writeJPEG. Each image being processed is then held
+//     in memory whole, rather than a band of rows at a time.
+// Images whose output would overwrite an input of the batch, e.g. when out_dir is their own directory, or the output
+//     of an earlier image with the same file name, are not processed, and fail with an error.
+// Images are processed in parallel by the ThreadPool, each thread taking the next image as it finishes one, while
+//     the bands of every image are themselves processed in parallel, so that threads which have run out of images
+//     help with the ones still being processed.
+// If threads is not 0, at most that many images are processed at once, while the bands of each image are still
+//     processed by the whole pool; the number of threads of the pool is left as it is.
+std::vector<BatchResult> process_batch(const std::vector<std::string>& paths,
+                                       const Pipeline& pipeline,
+                                       const std::string& out_dir,
+                                       size_t threads=0,
+                                       const int quality=100,
+                                       const JPEGReadOptions& options=JPEGReadOptions());
+
+#endif // __BATCH_H_
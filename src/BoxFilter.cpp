@@ -0,0 +1,97 @@
+#include "BoxFilter.hpp"
+
+#include <cmath>
+
+void
+box_filter_rows(const float *src,
+                ssize_t src_stride,
+                float *dst,
+                ssize_t dst_stride,
+                ssize_t w,
+                ssize_t j0,
+                ssize_t j1,
+                ssize_t radius)
+{
+    // the window does not fit in a row, so no pixel is computed.
+    if (2 * radius >= w)
+        return;
+
+    double norm = 1.0 / (2 * radius + 1);
+
+    for (ssize_t j = j0; j < j1; j++) {
+        const float *in = src + src_stride * j;
+        float *out = dst + dst_stride * j;
+
+        double sum = 0;
+        for (ssize_t m = 0; m < 2 * radius + 1; m++)
+            sum += in[m];
+        out[radius] = sum * norm;
+
+        for (ssize_t i = radius + 1; i < w - radius; i++) {
+            sum += (double) in[i + radius] - (double) in[i - radius - 1];
+            out[i] = sum * norm;
+        }
+    }
+}
+
+void
+box_filter_columns(const float *src,
+                   ssize_t src_stride,
+                   float *dst,
+                   ssize_t dst_stride,
+                   ssize_t w,
+                   ssize_t j0,
+                   ssize_t j1,
+                   ssize_t radius)
+{
+    if (j0 >= j1)
+        return;
+
+    double norm = 1.0 / (2 * radius + 1);
+
+    // one running sum per column, slid down the band a row at a time.
+    std::vector<double> sums(w, 0);
+    for (ssize_t n = j0 - radius; n <= j0 + radius; n++) {
+        const float *in = src + src_stride * n;
+        for (ssize_t i = 0; i < w; i++)
+            sums[i] += in[i];
+    }
+
+    for (ssize_t j = j0; j < j1; j++) {
+        if (j > j0) {
+            const float *add = src + src_stride * (j + radius);
+            const float *sub = src + src_stride * (j - radius - 1);
+            for (ssize_t i = 0; i < w; i++)
+                sums[i] += (double) add[i] - (double) sub[i];
+        }
+
+        float *out = dst + dst_stride * j;
+        for (ssize_t i = 0; i < w; i++)
+            out[i] = sums[i] * norm;
+    }
+}
+
+std::vector<ssize_t>
+box_radii_for_gaussian(float std_dev,
+                       size_t passes)
+{
+    // n boxes of width w have a variance of n (w * w - 1) / 12. Passes use one of two consecutive odd widths,
+    //     the smaller one for the first m passes, with m chosen to bring the variance closest to std_dev ^ 2.
+    double n = passes;
+    double variance = (double) std_dev * std_dev;
+
+    ssize_t w_l = std::floor(std::sqrt(12 * variance / n + 1));
+    if (w_l % 2 == 0)
+        w_l--;
+    if (w_l < 1)
+        w_l = 1;
+    ssize_t w_u = w_l + 2;
+
+    double m = (12 * variance - n * w_l * w_l - 4 * n * w_l - 3 * n) / (-4 * w_l - 4);
+    size_t m_passes = m < 0 ? 0 : (size_t) std::lround(m);
+
+    std::vector<ssize_t> radii;
+    for (size_t k = 0; k < passes; k++)
+        radii.push_back(((k < m_passes ? w_l : w_u) - 1) / 2);
+    return radii;
+}
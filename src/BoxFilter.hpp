@@ -0,0 +1,37 @@
+#ifndef __BOX_FILTER_H_
+#define __BOX_FILTER_H_
+
+#include <vector>
+#include <cstdlib>
+
+// Box filters computed with running sums, so that their cost per pixel does not depend on the radius.
+// They have the same semantics as the row kernels of Convolve.hpp applied to a 1 x (2 * radius + 1), resp.
+//     (2 * radius + 1) x 1, kernel whose elements are all 1 / (2 * radius + 1).
+// Sums are accumulated in double precision, so that no error builds up as the window slides along.
+
+// Filters the rows [j0, j1) of src horizontally; only the columns [radius, w - radius) of these rows are written.
+void box_filter_rows(const float *src,
+                     ssize_t src_stride,
+                     float *dst,
+                     ssize_t dst_stride,
+                     ssize_t w,
+                     ssize_t j0,
+                     ssize_t j1,
+                     ssize_t radius);
+
+// Filters the rows [j0, j1) of src vertically; the caller must make sure that radius <= j0 and j1 <= h - radius.
+void box_filter_columns(const float *src,
+                        ssize_t src_stride,
+                        float *dst,
+                        ssize_t dst_stride,
+                        ssize_t w,
+                        ssize_t j0,
+                        ssize_t j1,
+                        ssize_t radius);
+
+// The radii of passes box filters approximating a Gaussian blur with standard deviation std_dev.
+// Widths are chosen so that the variance of the passes together matches std_dev * std_dev as closely as possible.
+std::vector<ssize_t> box_radii_for_gaussian(float std_dev,
+                                            size_t passes);
+
+#endif // __BOX_FILTER_H_
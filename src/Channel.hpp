@@ -0,0 +1,43 @@
+#ifndef __CHANNEL_H_
+#define __CHANNEL_H_
+
+#include <string>
+
+typedef enum ChannelType {
+RED,
+GREEN,
+BLUE,
+ALPHA,
+ALPHA_IGNORED,
+CYAN,
+MAGENTA,
+YELLOW,
+BLACK,
+INTENSITY,
+Cb,
+Cr,
+} ChannelType;
+
+inline
+std::string
+str(ChannelType ch) {
+    switch (ch) {
+        case RED: return "RED";
+        case GREEN: return "GREEN";
+        case BLUE: return "BLUE";
+        case ALPHA: return "ALPHA";
+        case ALPHA_IGNORED: return "ALPHA_IGNORED";
+        case CYAN: return "CYAN";
+        case MAGENTA: return "MAGENTA";
+        case YELLOW: return "YELLOW";
+        case BLACK: return "BLACK";
+        case INTENSITY: return "INTENSITY";
+        case Cb: return "Cb";
+        case Cr: return "Cr";
+    }
+}
+
+// number of distinct channel types, usable as the size of a table indexed by ChannelType.
+const int CHANNEL_TYPE_COUNT = Cr + 1;
+
+#endif // __CHANNEL_H_
@@ -0,0 +1,107 @@
+#include "ColorMatrix.hpp"
+
+#include <cmath>
+#include <string>
+#include <stdexcept>
+#include "Simd.hpp"
+
+ColorMatrix
+color_matrix(ssize_t n_in,
+             std::initializer_list<std::initializer_list<float>> rows,
+             bool cmyk)
+{
+    ColorMatrix m;
+    m.n_in = n_in;
+    m.n_out = rows.size();
+    m.cmyk = cmyk;
+
+    if (m.n_in < 1 || m.n_in > COLOR_MATRIX_MAX_PLANES)
+        throw std::invalid_argument("A colour matrix must have between 1 and " +
+                                    std::to_string(COLOR_MATRIX_MAX_PLANES) + " inputs.");
+    if (m.n_out < 1 || m.n_out > COLOR_MATRIX_MAX_PLANES)
+        throw std::invalid_argument("A colour matrix must have between 1 and " +
+                                    std::to_string(COLOR_MATRIX_MAX_PLANES) + " outputs.");
+    if (cmyk && n_in != 3)
+        throw std::invalid_argument("A colour matrix applied to CMYK must have 3 inputs.");
+
+    ssize_t r = 0;
+    for (auto row = rows.begin(); row != rows.end(); ++row, r++) {
+        if ((ssize_t) row->size() != n_in + 1)
+            throw std::invalid_argument("Every row of a colour matrix must hold a coefficient for each input "
+                                        "followed by an offset.");
+
+        ssize_t c = 0;
+        for (auto x = row->begin(); x != row->end(); ++x, c++) {
+            m.coeffs[r][c] = *x;
+            m.fixed_coeffs[r][c] = (int32_t) lrint((double) *x * (1 << COLOR_FIXED_SHIFT));
+        }
+        m.fixed_coeffs[r][n_in] += 1 << (COLOR_FIXED_SHIFT - 1);
+    }
+
+    return m;
+}
+
+namespace {
+
+// the portable kernels treat a single float as a vector.
+struct V {
+    typedef float type;
+    typedef int32_t itype;
+    static const int width = 1;
+
+    static type set1(float x) { return x; }
+    static itype iset1(int32_t x) { return x; }
+    static type load(const float *p) { return *p; }
+    static void store(float *p, type v) { *p = v; }
+    static type add(type a, type b) { return a + b; }
+    static type sub(type a, type b) { return a - b; }
+    static type mul(type a, type b) { return a * b; }
+    static type min(type a, type b) { return a < b ? a : b; }
+    static type max(type a, type b) { return a > b ? a : b; }
+    static itype iadd(itype a, itype b) { return a + b; }
+    static itype isub(itype a, itype b) { return a - b; }
+    static itype imul(itype a, itype b) { return a * b; }
+    static itype imin(itype a, itype b) { return a < b ? a : b; }
+    static itype imax(itype a, itype b) { return a > b ? a : b; }
+    static itype sra(itype a, int n) { return a >> n; }
+    static itype to_int(type a) { return (itype) lrintf(a); }
+    static type to_float(itype a) { return (type) a; }
+};
+
+#include "ColorMatrixSimd.inc"
+
+}
+
+ColorKernels
+color_kernels_scalar()
+{
+    ColorKernels kernels;
+    kernels.floating = color_rows_float;
+    kernels.fixed = color_rows_fixed;
+    return kernels;
+}
+
+static
+ColorKernels
+select_color_kernels()
+{
+    switch (simd_level()) {
+#if defined(FOURIER_SIMD_X86)
+        case SIMD_AVX512:
+            return color_kernels_avx512();
+        case SIMD_AVX2:
+            return color_kernels_avx2();
+        case SIMD_SSE42:
+            return color_kernels_sse42();
+#endif
+        default:
+            return color_kernels_scalar();
+    }
+}
+
+const ColorKernels&
+color_kernels()
+{
+    static const ColorKernels kernels = select_color_kernels();
+    return kernels;
+}
@@ -0,0 +1,64 @@
+#ifndef __COLOR_MATRIX_H_
+#define __COLOR_MATRIX_H_
+
+#include <cstdlib>
+#include <cstdint>
+#include <initializer_list>
+
+// the largest number of planes a colour matrix reads or writes, not counting the black plane of CMYK inputs.
+#define COLOR_MATRIX_MAX_PLANES 4
+// fixed point coefficients are scaled by 2 ^ COLOR_FIXED_SHIFT.
+#define COLOR_FIXED_SHIFT 16
+
+// An affine map from n_in input planes to n_out output planes, applied to every pixel as
+//     out[r] = coeffs[r][0] * in[0] + ... + coeffs[r][n_in - 1] * in[n_in - 1] + coeffs[r][n_in].
+// Terms are accumulated in this order, without fused multiply-adds, so every instruction set produces the
+//     same floats as the scalar kernels. As for the convolution kernels, this relies on -ffp-contract=off, and
+//     test/simd_check.cpp checks it.
+// If cmyk is set, four planes are read, cyan, magenta, yellow and black, and the matrix is applied to the
+//     red, green and blue values (1 - in[c]) * (1 - in[3]) / 256, i.e. the black plane modulates the others.
+struct ColorMatrix {
+    ssize_t n_in, n_out;
+    bool cmyk;
+    float coeffs[COLOR_MATRIX_MAX_PLANES][COLOR_MATRIX_MAX_PLANES + 1];
+    // coeffs in fixed point, with half of the last bit added to the offsets, so that shifting rounds.
+    int32_t fixed_coeffs[COLOR_MATRIX_MAX_PLANES][COLOR_MATRIX_MAX_PLANES + 1];
+};
+
+// builds a matrix from its rows, each of which holds n_in coefficients followed by an offset.
+// Throws std::invalid_argument if the matrix does not have between 1 and COLOR_MATRIX_MAX_PLANES inputs and
+//     outputs, or if it has cmyk set and not exactly 3 inputs.
+ColorMatrix color_matrix(ssize_t n_in,
+                         std::initializer_list<std::initializer_list<float>> rows,
+                         bool cmyk=false);
+
+// Row kernels applying a colour matrix to the rows [j0, j1), w pixels wide, of the planes in, writing the
+//     planes out. Planes are given by their first row, and rows are in_stride and out_stride floats apart.
+typedef void (*ColorRowsFn)(const ColorMatrix& m,
+                            const float *const *in,
+                            ssize_t in_stride,
+                            float *const *out,
+                            ssize_t out_stride,
+                            ssize_t w,
+                            ssize_t j0,
+                            ssize_t j1);
+
+struct ColorKernels {
+    // single precision floating point.
+    ColorRowsFn floating;
+    // 16 bit fixed point, in the manner of libjpeg's colour conversions: inputs are clamped to [0, 255] and
+    //     rounded to integers, the values computed from CMYK inputs are rounded to integers, and outputs are
+    //     rounded and clamped to [0, 255].
+    ColorRowsFn fixed;
+};
+
+// the kernels for the most capable instruction set reported by simd_level().
+const ColorKernels& color_kernels();
+
+// the kernels for each instruction set. Only call these if the CPU supports the instruction set.
+ColorKernels color_kernels_scalar();
+ColorKernels color_kernels_sse42();
+ColorKernels color_kernels_avx2();
+ColorKernels color_kernels_avx512();
+
+#endif // __COLOR_MATRIX_H_
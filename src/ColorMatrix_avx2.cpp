@@ -0,0 +1,44 @@
+// Colour matrix kernels using AVX2. This file is compiled with -mavx2.
+#include "ColorMatrix.hpp"
+
+#include <cmath>
+#include <immintrin.h>
+
+namespace {
+
+struct V {
+    typedef __m256 type;
+    typedef __m256i itype;
+    static const int width = 8;
+
+    static type set1(float x) { return _mm256_set1_ps(x); }
+    static itype iset1(int32_t x) { return _mm256_set1_epi32(x); }
+    static type load(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, type v) { _mm256_storeu_ps(p, v); }
+    static type add(type a, type b) { return _mm256_add_ps(a, b); }
+    static type sub(type a, type b) { return _mm256_sub_ps(a, b); }
+    static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+    static type min(type a, type b) { return _mm256_min_ps(a, b); }
+    static type max(type a, type b) { return _mm256_max_ps(a, b); }
+    static itype iadd(itype a, itype b) { return _mm256_add_epi32(a, b); }
+    static itype isub(itype a, itype b) { return _mm256_sub_epi32(a, b); }
+    static itype imul(itype a, itype b) { return _mm256_mullo_epi32(a, b); }
+    static itype imin(itype a, itype b) { return _mm256_min_epi32(a, b); }
+    static itype imax(itype a, itype b) { return _mm256_max_epi32(a, b); }
+    static itype sra(itype a, int n) { return _mm256_srai_epi32(a, n); }
+    static itype to_int(type a) { return _mm256_cvtps_epi32(a); }
+    static type to_float(itype a) { return _mm256_cvtepi32_ps(a); }
+};
+
+#include "ColorMatrixSimd.inc"
+
+}
+
+ColorKernels
+color_kernels_avx2()
+{
+    ColorKernels kernels;
+    kernels.floating = color_rows_float;
+    kernels.fixed = color_rows_fixed;
+    return kernels;
+}
@@ -0,0 +1,48 @@
+// Colour matrix kernels using AVX-512F. This file is compiled with -mavx512f.
+#include "ColorMatrix.hpp"
+
+#include <cmath>
+#include <immintrin.h>
+
+// GCC warns that the undefined vectors which the masked intrinsics take as their passthrough operand may be
+//     used uninitialized, although every lane is written.
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+namespace {
+
+struct V {
+    typedef __m512 type;
+    typedef __m512i itype;
+    static const int width = 16;
+
+    static type set1(float x) { return _mm512_set1_ps(x); }
+    static itype iset1(int32_t x) { return _mm512_set1_epi32(x); }
+    static type load(const float *p) { return _mm512_loadu_ps(p); }
+    static void store(float *p, type v) { _mm512_storeu_ps(p, v); }
+    static type add(type a, type b) { return _mm512_add_ps(a, b); }
+    static type sub(type a, type b) { return _mm512_sub_ps(a, b); }
+    static type mul(type a, type b) { return _mm512_mul_ps(a, b); }
+    static type min(type a, type b) { return _mm512_min_ps(a, b); }
+    static type max(type a, type b) { return _mm512_max_ps(a, b); }
+    static itype iadd(itype a, itype b) { return _mm512_add_epi32(a, b); }
+    static itype isub(itype a, itype b) { return _mm512_sub_epi32(a, b); }
+    static itype imul(itype a, itype b) { return _mm512_mullo_epi32(a, b); }
+    static itype imin(itype a, itype b) { return _mm512_min_epi32(a, b); }
+    static itype imax(itype a, itype b) { return _mm512_max_epi32(a, b); }
+    static itype sra(itype a, int n) { return _mm512_srai_epi32(a, n); }
+    static itype to_int(type a) { return _mm512_cvtps_epi32(a); }
+    static type to_float(itype a) { return _mm512_cvtepi32_ps(a); }
+};
+
+#include "ColorMatrixSimd.inc"
+
+}
+
+ColorKernels
+color_kernels_avx512()
+{
+    ColorKernels kernels;
+    kernels.floating = color_rows_float;
+    kernels.fixed = color_rows_fixed;
+    return kernels;
+}
@@ -0,0 +1,56 @@
+#include "Convolve.hpp"
+#include "Simd.hpp"
+
+namespace {
+
+// the portable kernels treat a single float as a vector.
+struct V {
+    typedef float type;
+    static const int width = 1;
+
+    static type zero() { return 0.0f; }
+    static type set1(float x) { return x; }
+    static type load(const float *p) { return *p; }
+    static void store(float *p, type v) { *p = v; }
+    static type add(type a, type b) { return a + b; }
+    static type mul(type a, type b) { return a * b; }
+};
+
+#include "ConvolveSimd.inc"
+
+}
+
+ConvolveKernels
+convolve_kernels_scalar()
+{
+    ConvolveKernels kernels;
+    kernels.general = convolve_general;
+    kernels.row = convolve_row;
+    kernels.column = convolve_column;
+    return kernels;
+}
+
+static
+ConvolveKernels
+select_convolve_kernels()
+{
+    switch (simd_level()) {
+#if defined(FOURIER_SIMD_X86)
+        case SIMD_AVX512:
+            return convolve_kernels_avx512();
+        case SIMD_AVX2:
+            return convolve_kernels_avx2();
+        case SIMD_SSE42:
+            return convolve_kernels_sse42();
+#endif
+        default:
+            return convolve_kernels_scalar();
+    }
+}
+
+const ConvolveKernels&
+convolve_kernels()
+{
+    static const ConvolveKernels kernels = select_convolve_kernels();
+    return kernels;
+}
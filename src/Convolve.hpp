@@ -0,0 +1,45 @@
+#ifndef __CONVOLVE_H_
+#define __CONVOLVE_H_
+
+#include <cstdlib>
+
+// Row kernels for the direct convolution used by Image::convolve.
+// A kernel computes the rows [j0, j1) of the convolution of src with a kern_h x kern_w kernel,
+//     and within each of these rows only the columns [kern_w_f, w - kern_w_f), i.e. the pixels at which
+//     the whole kernel fits in the image. No other part of dst is written.
+// The caller must make sure that kern_h_f <= j0 and j1 <= h - kern_h_f.
+// taps holds the kernel column by column; the tap applied to the pixel at offset (m - kern_w_f, n - kern_h_f)
+//     is taps[kern_h * m + n]. Taps are accumulated in exactly this order, without fused multiply-adds,
+//     so every instruction set produces the same floats as the scalar kernels. This relies on the kernels being
+//     compiled with -ffp-contract=off, as GCC otherwise fuses their multiplies and adds under -mavx512f;
+//     test/simd_check.cpp checks it.
+typedef void (*ConvolveRowsFn)(const float *src,
+                               ssize_t src_stride,
+                               float *dst,
+                               ssize_t dst_stride,
+                               ssize_t w,
+                               ssize_t j0,
+                               ssize_t j1,
+                               const float *taps,
+                               ssize_t kern_w,
+                               ssize_t kern_h);
+
+struct ConvolveKernels {
+    // kernels of any shape
+    ConvolveRowsFn general;
+    // 1 x N kernels, i.e. a single row
+    ConvolveRowsFn row;
+    // N x 1 kernels, i.e. a single column
+    ConvolveRowsFn column;
+};
+
+// the kernels for the most capable instruction set reported by simd_level().
+const ConvolveKernels& convolve_kernels();
+
+// the kernels for each instruction set. Only call these if the CPU supports the instruction set.
+ConvolveKernels convolve_kernels_scalar();
+ConvolveKernels convolve_kernels_sse42();
+ConvolveKernels convolve_kernels_avx2();
+ConvolveKernels convolve_kernels_avx512();
+
+#endif // __CONVOLVE_H_
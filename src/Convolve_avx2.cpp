@@ -0,0 +1,32 @@
+// Convolution kernels using AVX2. This file is compiled with -mavx2.
+#include "Convolve.hpp"
+
+#include <immintrin.h>
+
+namespace {
+
+struct V {
+    typedef __m256 type;
+    static const int width = 8;
+
+    static type zero() { return _mm256_setzero_ps(); }
+    static type set1(float x) { return _mm256_set1_ps(x); }
+    static type load(const float *p) { return _mm256_loadu_ps(p); }
+    static void store(float *p, type v) { _mm256_storeu_ps(p, v); }
+    static type add(type a, type b) { return _mm256_add_ps(a, b); }
+    static type mul(type a, type b) { return _mm256_mul_ps(a, b); }
+};
+
+#include "ConvolveSimd.inc"
+
+}
+
+ConvolveKernels
+convolve_kernels_avx2()
+{
+    ConvolveKernels kernels;
+    kernels.general = convolve_general;
+    kernels.row = convolve_row;
+    kernels.column = convolve_column;
+    return kernels;
+}
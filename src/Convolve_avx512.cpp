@@ -0,0 +1,32 @@
+// Convolution kernels using AVX-512F. This file is compiled with -mavx512f.
+#include "Convolve.hpp"
+
+#include <immintrin.h>
+
+namespace {
+
+struct V {
+    typedef __m512 type;
+    static const int width = 16;
+
+    static type zero() { return _mm512_setzero_ps(); }
+    static type set1(float x) { return _mm512_set1_ps(x); }
+    static type load(const float *p) { return _mm512_loadu_ps(p); }
+    static void store(float *p, type v) { _mm512_storeu_ps(p, v); }
+    static type add(type a, type b) { return _mm512_add_ps(a, b); }
+    static type mul(type a, type b) { return _mm512_mul_ps(a, b); }
+};
+
+#include "ConvolveSimd.inc"
+
+}
+
+ConvolveKernels
+convolve_kernels_avx512()
+{
+    ConvolveKernels kernels;
+    kernels.general = convolve_general;
+    kernels.row = convolve_row;
+    kernels.column = convolve_column;
+    return kernels;
+}
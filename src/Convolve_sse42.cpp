@@ -0,0 +1,32 @@
+// Convolution kernels using SSE4.2. This file is compiled with -msse4.2.
+#include "Convolve.hpp"
+
+#include <nmmintrin.h>
+
+namespace {
+
+struct V {
+    typedef __m128 type;
+    static const int width = 4;
+
+    static type zero() { return _mm_setzero_ps(); }
+    static type set1(float x) { return _mm_set1_ps(x); }
+    static type load(const float *p) { return _mm_loadu_ps(p); }
+    static void store(float *p, type v) { _mm_storeu_ps(p, v); }
+    static type add(type a, type b) { return _mm_add_ps(a, b); }
+    static type mul(type a, type b) { return _mm_mul_ps(a, b); }
+};
+
+#include "ConvolveSimd.inc"
+
+}
+
+ConvolveKernels
+convolve_kernels_sse42()
+{
+    ConvolveKernels kernels;
+    kernels.general = convolve_general;
+    kernels.row = convolve_row;
+    kernels.column = convolve_column;
+    return kernels;
+}
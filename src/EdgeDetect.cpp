@@ -0,0 +1,259 @@
+#include "EdgeDetect.hpp"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "ThreadPool.hpp"
+
+#define SOBEL_X {{1.0f, 0.0f, -1.0f}, \
+                 {2.0f, 0.0f, -2.0f}, \
+                 {1.0f, 0.0f, -1.0f}}
+#define SOBEL_Y {{1.0f, 2.0f, 1.0f}, \
+                 {0.0f, 0.0f, 0.0f}, \
+                 {-1.0f, -2.0f, -1.0f}}
+
+#define SOBEL_FELDMAN_X {{3.0f, 0.0f, -3.0f},   \
+                         {10.0f, 0.0f, -10.0f},  \
+                         {3.0f, 0.0f, -3.0f}}
+#define SOBEL_FELDMAN_Y {{3.0f, 10.0f, 3.0f},    \
+                         {0.0f, 0.0f, 0.0f},     \
+                         {-3.0f, -10.0f, -3.0f}}
+
+#define SCHARR_X {{47.0f, 0.0f, -47.0f},        \
+                  {162.0f, 0.0f, -162.0f},      \
+                  {47.0f, 0.0f, -47.0f}}
+#define SCHARR_Y {{47.0f, 162.0f, 47.0f},       \
+                  {0.0f, 0.0f, 0.0f},           \
+                  {-47.0f, -162.0f, -47.0f}}
+
+#define SOBEL_X_LARGE {{-5.0f / 20, -4.0f / 20, 0.0f, 4.0f / 20, 5.0f / 20},   \
+                       {-8.0f / 20, -10.0f / 20, 0.0f, 10.0f / 20, 8.0f / 20}, \
+                       {-10.0f / 20, -20.0f / 20, 0.0f, 20.0f / 20, 10.0f / 20}, \
+                       {-8.0f / 20, -10.0f / 20, 0.0f, 10.0f / 20, 8.0f / 20},   \
+                       {-5.0f / 20, -4.0f / 20, 0.0f, 4.0f / 20, 5.0f / 20}}
+#define SOBEL_Y_LARGE {{-5.0f / 20, -8.0f / 20, -10.0f / 20, -8.0f / 20, -5.0f / 20}, \
+                       {-4.0f / 20, -10.0f / 20, -20.0f / 20, -10.0f / 20, -4.0f / 20}, \
+                       {0.0f, 0.0f, 0.0f, 0.0f, 0.0f},         \
+                       {4.0f / 20, 10.0f / 20, 20.0f / 20, 10.0f / 20, 4.0f / 20},      \
+                       {5.0f / 20, 8.0f / 20, 10.0f / 20, 8.0f / 20, 5.0f / 20}}
+
+// bands are at least this many rows high, as every band recomputes the gradient of the rows on either side of it.
+#define MIN_BAND_HEIGHT 32
+
+// directions across which non-maximum suppression compares a pixel with its neighbours.
+#define ACROSS_ROW 0      // the pixels to the left and to the right.
+#define ACROSS_DIAGONAL 1 // the pixels above and to the right, and below and to the left.
+#define ACROSS_COLUMN 2   // the pixels above and below.
+
+// Gradients are compared across the column when their angle rounds to pi / 2 as a float, which is when
+//     gx ^ 2 / gy ^ 2 is at most this ratio, the distance from pi / 2 to the next smaller rounding boundary.
+#define COLUMN_RATIO 1.5893254e-8f
+
+namespace {
+
+// a non-zero element of a kernel, applied to the pixel at offset (dx, dy).
+struct Tap {
+    ssize_t dx, dy;
+    float weight;
+};
+
+// The non-zero elements of a kernel, in the order in which Image::convolve accumulates them, i.e. column by
+//     column, so that the gradient is exactly that given by convolving with the kernel and scaling the result.
+std::vector<Tap>
+kernel_taps(const Kernel& kern,
+            float scale)
+{
+    ssize_t kern_f = (kern.size() - 1) / 2;
+    std::vector<Tap> taps;
+    for (ssize_t m = 0; m < (ssize_t) kern.size(); m++)
+        for (ssize_t n = 0; n < (ssize_t) kern.size(); n++)
+            if (kern[n][m] != 0)
+                taps.push_back({m - kern_f, n - kern_f, kern[n][m] * scale});
+    return taps;
+}
+
+class Gradient {
+    std::vector<Tap> x_taps, y_taps;
+    ssize_t kern_f;
+
+    public:
+        Gradient(EdgeOperator edge_operator) {
+            Kernel x_edge_k, y_edge_k;
+            switch (edge_operator) {
+                case EDGE_SOBEL:
+                    x_edge_k = SOBEL_X;
+                    y_edge_k = SOBEL_Y;
+                    break;
+                case EDGE_SOBEL_FELDMAN:
+                    x_edge_k = SOBEL_FELDMAN_X;
+                    y_edge_k = SOBEL_FELDMAN_Y;
+                    break;
+                case EDGE_SCHARR:
+                    x_edge_k = SCHARR_X;
+                    y_edge_k = SCHARR_Y;
+                    break;
+                case EDGE_SOBEL_LARGE:
+                    x_edge_k = SOBEL_X_LARGE;
+                    y_edge_k = SOBEL_Y_LARGE;
+                    break;
+                default:
+                    throw std::invalid_argument("Unknown edge operator");
+            }
+            kern_f = (x_edge_k.size() - 1) / 2;
+
+            // The response to a unit slope along x, 8 for the Sobel operator, sets the scale of the gradient.
+            float slope = 0;
+            for (ssize_t m = 0; m < (ssize_t) x_edge_k.size(); m++)
+                for (ssize_t n = 0; n < (ssize_t) x_edge_k.size(); n++)
+                    slope += x_edge_k[n][m] * (m - kern_f);
+            float scale = 8.0f / std::fabs(slope);
+
+            x_taps = kernel_taps(x_edge_k, scale);
+            y_taps = kernel_taps(y_edge_k, scale);
+        }
+
+        // The magnitude of the gradient at row j, and the direction across which it is compared with its
+        //     neighbours. Pixels at which the kernels do not fit in the image have a gradient of 0.
+        void row(const float *src,
+                 ssize_t src_stride,
+                 ssize_t w,
+                 ssize_t h,
+                 ssize_t j,
+                 float *gx,
+                 float *gy,
+                 float *magnitude,
+                 unsigned char *direction) const {
+            std::fill(gx, gx + w, 0.0f);
+            std::fill(gy, gy + w, 0.0f);
+
+            if (j >= kern_f && j < h - kern_f) {
+                for (auto t = x_taps.begin(); t != x_taps.end(); ++t) {
+                    const float *in = src + src_stride * (j + t->dy) + t->dx;
+                    for (ssize_t i = kern_f; i < w - kern_f; i++)
+                        gx[i] += in[i] * t->weight;
+                }
+                for (auto t = y_taps.begin(); t != y_taps.end(); ++t) {
+                    const float *in = src + src_stride * (j + t->dy) + t->dx;
+                    for (ssize_t i = kern_f; i < w - kern_f; i++)
+                        gy[i] += in[i] * t->weight;
+                }
+            }
+
+            const float norm = 1.0f / std::sqrt(2.0f);
+            for (ssize_t i = 0; i < w; i++) {
+                float gx2 = gx[i] * gx[i];
+                float gy2 = gy[i] * gy[i];
+                magnitude[i] = std::sqrt(gx2 + gy2) * norm;
+
+                // The direction is the angle of (gx ^ 2, gy ^ 2), i.e. that of the gradient folded into the first
+                //     quadrant, which is compared with pi / 4 and pi / 2 without being computed.
+                if (gy2 < gx2 || gy2 == 0)
+                    direction[i] = ACROSS_ROW;
+                else if (gx2 <= gy2 * COLUMN_RATIO)
+                    direction[i] = ACROSS_COLUMN;
+                else
+                    direction[i] = ACROSS_DIAGONAL;
+            }
+        }
+};
+
+}
+
+void
+canny_gradient(const float *src,
+               ssize_t src_stride,
+               float *dst,
+               ssize_t dst_stride,
+               ssize_t w,
+               ssize_t h,
+               EdgeOperator edge_operator,
+               float upper_threshold,
+               float lower_threshold,
+               float max_intensity)
+{
+    if (w <= 0 || h <= 0)
+        return;
+
+    Gradient gradient(edge_operator);
+
+    ssize_t band_height = std::max(rows_per_task(w, 16), (ssize_t) MIN_BAND_HEIGHT);
+    parallel_for(0, h, band_height, [&](ssize_t j0, ssize_t j1) {
+        std::vector<float> gx(w), gy(w);
+        // the magnitude and direction of the gradient on the rows above, at and below the row being suppressed.
+        std::vector<float> magnitude(3 * w);
+        std::vector<unsigned char> direction(3 * w);
+        float *above = magnitude.data(), *at = above + w, *below = at + w;
+        unsigned char *d_above = direction.data(), *d_at = d_above + w, *d_below = d_at + w;
+
+        if (j0 > 0)
+            gradient.row(src, src_stride, w, h, j0 - 1, gx.data(), gy.data(), above, d_above);
+        gradient.row(src, src_stride, w, h, j0, gx.data(), gy.data(), at, d_at);
+
+        for (ssize_t j = j0; j < j1; j++) {
+            if (j + 1 < h)
+                gradient.row(src, src_stride, w, h, j + 1, gx.data(), gy.data(), below, d_below);
+
+            // non-maximum suppression: pixels which are darker than either of their neighbours across the
+            //     direction of the gradient are set to 0. The pixels on the border of the image are kept.
+            // double threshold: pixels above upper_threshold are set to maximum intensity.
+            //                   pixels above lower_threshold but below upper_threshold are set to half intensity.
+            //                   Anything else is blacked out.
+            float *out = dst + dst_stride * j;
+            bool inner_row = j > 0 && j < h - 1;
+            for (ssize_t i = 0; i < w; i++) {
+                float v = at[i];
+                if (inner_row && i > 0 && i < w - 1) {
+                    float next_pixel, last_pixel;
+                    switch (d_at[i]) {
+                        case ACROSS_ROW:
+                            next_pixel = at[i + 1];
+                            last_pixel = at[i - 1];
+                            break;
+                        case ACROSS_DIAGONAL:
+                            next_pixel = above[i + 1];
+                            last_pixel = below[i - 1];
+                            break;
+                        default:
+                            next_pixel = above[i];
+                            last_pixel = below[i];
+                            break;
+                    }
+                    if (v < last_pixel || v < next_pixel)
+                        v = 0;
+                }
+
+                if (v >= upper_threshold)
+                    out[i] = max_intensity;
+                else if (v >= lower_threshold)
+                    out[i] = max_intensity / 2;
+                else
+                    out[i] = 0;
+            }
+
+            std::swap(above, at);
+            std::swap(at, below);
+            std::swap(d_above, d_at);
+            std::swap(d_at, d_below);
+        }
+    });
+}
+
+#undef SOBEL_X
+#undef SOBEL_Y
+
+#undef SOBEL_FELDMAN_X
+#undef SOBEL_FELDMAN_Y
+
+#undef SCHARR_X
+#undef SCHARR_Y
+
+#undef SOBEL_X_LARGE
+#undef SOBEL_Y_LARGE
+
+#undef MIN_BAND_HEIGHT
+
+#undef ACROSS_ROW
+#undef ACROSS_DIAGONAL
+#undef ACROSS_COLUMN
+#undef COLUMN_RATIO
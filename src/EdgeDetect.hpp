@@ -0,0 +1,23 @@
+#ifndef __EDGE_DETECT_H_
+#define __EDGE_DETECT_H_
+
+#include <cstdlib>
+#include "Image.hpp"
+
+// The steps of Image::canny_edge_detect between the blur and the hysteresis, fused in a single pass over the
+//     w x h plane src: the gradient given by edge_operator, its magnitude and direction, non-maximum suppression
+//     and the double threshold. Every pixel of dst is written with max_intensity, max_intensity / 2 or 0.
+// Rows are processed in bands, each of which keeps only the last three rows of the gradient.
+// src and dst must not overlap.
+void canny_gradient(const float *src,
+                    ssize_t src_stride,
+                    float *dst,
+                    ssize_t dst_stride,
+                    ssize_t w,
+                    ssize_t h,
+                    EdgeOperator edge_operator,
+                    float upper_threshold,
+                    float lower_threshold,
+                    float max_intensity);
+
+#endif // __EDGE_DETECT_H_
@@ -0,0 +1,56 @@
+#include "Executor.hpp"
+
+#include <algorithm>
+
+Executor::Executor(size_t n) :
+    stopping { false }
+{
+    for (size_t i = 0; i < std::max(n, (size_t) 1); i++)
+        threads.emplace_back(&Executor::work, this);
+}
+
+Executor::~Executor()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+        it->join();
+}
+
+Executor&
+Executor::instance()
+{
+    static Executor *executor = new Executor(std::max(std::thread::hardware_concurrency(), 2u));
+    return *executor;
+}
+
+void
+Executor::work()
+{
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void
+Executor::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
@@ -0,0 +1,43 @@
+#ifndef __EXECUTOR_H_
+#define __EXECUTOR_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdlib>
+
+// Runs whole operations in the background, e.g. reading a JPEG or blurring an image, for callers which carry on
+//     with other work in the meantime.
+// Unlike the tasks of ThreadPool, jobs may take long and may block, e.g. on a file; they are run by threads of
+//     their own, in the order in which they were submitted, and use the pool for their own parallel regions.
+class Executor {
+    std::deque<std::function<void()>> jobs;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    void work();
+
+    public:
+        // starts n threads running jobs.
+        Executor(size_t n);
+        // finishes the jobs already submitted, and then stops the threads.
+        ~Executor();
+
+        // the executor used by the asynchronous operations of the Python module, having
+        //      std::thread::hardware_concurrency() threads, and at least 2 so that a long job does not hold up the others.
+        // It is never destroyed, so that jobs still running at exit are not waited for.
+        static Executor& instance();
+
+        size_t num_threads() const { return threads.size(); }
+
+        // queues job to be run by one of the threads. job must not throw.
+        void submit(std::function<void()> job);
+};
+
+#endif // __EXECUTOR_H_
@@ -0,0 +1,405 @@
+#include "FFT.hpp"
+
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+#include "ThreadPool.hpp"
+
+// number of columns of a spectrum transformed together by FFTConvolver::transform_columns
+#define COLUMN_GROUP 32
+
+// std::complex multiplication checks for infinities and NaNs, which is far too slow for a butterfly.
+static inline
+Complex
+mul(const Complex& a,
+    const Complex& b)
+{
+    return Complex(a.real() * b.real() - a.imag() * b.imag(),
+                   a.real() * b.imag() + a.imag() * b.real());
+}
+
+// multiplies by i (or by -i when NEG is set)
+template <bool NEG>
+static inline
+Complex
+mul_i(const Complex& a)
+{
+    return NEG ? Complex(a.imag(), -a.real()) : Complex(-a.imag(), a.real());
+}
+
+// In-place DFTs of size P. Forward transforms use the root of unity exp(-2 pi i / P),
+//      inverse transforms use its conjugate.
+template <size_t P, bool INV>
+struct Butterfly;
+
+template <bool INV>
+struct Butterfly<2, INV> {
+    static inline void apply(Complex *a) {
+        Complex t = a[0] - a[1];
+        a[0] += a[1];
+        a[1] = t;
+    }
+};
+
+template <bool INV>
+struct Butterfly<3, INV> {
+    static inline void apply(Complex *a) {
+        const float s = 0.86602540378443864676f; // sin(pi / 3)
+        Complex t1 = a[1] + a[2];
+        Complex t2 = a[0] - 0.5f * t1;
+        Complex t3 = mul_i<!INV>((a[1] - a[2]) * s);
+        a[0] += t1;
+        a[1] = t2 + t3;
+        a[2] = t2 - t3;
+    }
+};
+
+template <bool INV>
+struct Butterfly<4, INV> {
+    static inline void apply(Complex *a) {
+        Complex t0 = a[0] + a[2];
+        Complex t1 = a[0] - a[2];
+        Complex t2 = a[1] + a[3];
+        Complex t3 = mul_i<!INV>(a[1] - a[3]);
+        a[0] = t0 + t2;
+        a[1] = t1 + t3;
+        a[2] = t0 - t2;
+        a[3] = t1 - t3;
+    }
+};
+
+template <bool INV>
+struct Butterfly<5, INV> {
+    static inline void apply(Complex *a) {
+        const float c1 = 0.30901699437494742410f;  // cos(2 pi / 5)
+        const float c2 = -0.80901699437494742410f; // cos(4 pi / 5)
+        const float s1 = 0.95105651629515357212f;  // sin(2 pi / 5)
+        const float s2 = 0.58778525229247312917f;  // sin(4 pi / 5)
+        Complex t1 = a[1] + a[4];
+        Complex t2 = a[2] + a[3];
+        Complex t3 = a[1] - a[4];
+        Complex t4 = a[2] - a[3];
+        Complex r1 = a[0] + c1 * t1 + c2 * t2;
+        Complex r2 = a[0] + c2 * t1 + c1 * t2;
+        Complex i1 = mul_i<!INV>(s1 * t3 + s2 * t4);
+        Complex i2 = mul_i<!INV>(s2 * t3 - s1 * t4);
+        a[0] += t1 + t2;
+        a[1] = r1 + i1;
+        a[2] = r2 + i2;
+        a[3] = r2 - i2;
+        a[4] = r1 - i1;
+    }
+};
+
+// One stage of a Stockham autosort FFT.
+// x holds s interleaved sequences of length P * m; the result is written to y without any bit reversal.
+template <size_t P, bool INV>
+static
+void
+stage(const Complex *x,
+      Complex *y,
+      size_t m,
+      size_t s,
+      const Complex *tw)
+{
+    Complex a[P];
+
+    for (size_t q = 0; q < m; q++) {
+        const Complex *w = tw + q * (P - 1);
+        for (size_t t = 0; t < s; t++) {
+            for (size_t r = 0; r < P; r++)
+                a[r] = x[t + s * (q + m * r)];
+
+            Butterfly<P, INV>::apply(a);
+
+            y[t + s * P * q] = a[0];
+            for (size_t k = 1; k < P; k++)
+                y[t + s * (P * q + k)] = mul(a[k], INV ? std::conj(w[k - 1]) : w[k - 1]);
+        }
+    }
+}
+
+template <bool INV>
+static
+void
+stage(size_t p,
+      const Complex *x,
+      Complex *y,
+      size_t m,
+      size_t s,
+      const Complex *tw)
+{
+    switch (p) {
+        case 2: stage<2, INV>(x, y, m, s, tw); break;
+        case 3: stage<3, INV>(x, y, m, s, tw); break;
+        case 4: stage<4, INV>(x, y, m, s, tw); break;
+        case 5: stage<5, INV>(x, y, m, s, tw); break;
+        default:
+            throw std::logic_error("Unsupported FFT radix.");
+    }
+}
+
+FFTPlan::FFTPlan(size_t _n) :
+    n { _n }
+{
+    if (n == 0)
+        throw std::invalid_argument("FFT length must be positive");
+
+    size_t rest = n;
+    const size_t radices[] = { 4, 2, 3, 5 };
+    for (size_t p : radices)
+        while (rest % p == 0) {
+            factors.push_back(p);
+            rest /= p;
+        }
+    if (rest != 1)
+        throw std::invalid_argument("FFT length may only have 2, 3 and 5 as prime factors");
+
+    size_t l = n;
+    for (size_t p : factors) {
+        size_t m = l / p;
+        for (size_t q = 0; q < m; q++)
+            for (size_t k = 1; k < p; k++) {
+                double theta = -2.0 * M_PI * (double) (q * k) / (double) l;
+                twiddles.push_back(Complex(cos(theta), sin(theta)));
+            }
+        l = m;
+    }
+}
+
+std::shared_ptr<const FFTPlan>
+FFTPlan::get(size_t n)
+{
+    static std::mutex cache_mutex;
+    static std::map<size_t, std::shared_ptr<const FFTPlan>> cache;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+
+    auto it = cache.find(n);
+    if (it != cache.end())
+        return it->second;
+
+    std::shared_ptr<const FFTPlan> plan(new FFTPlan(n));
+    cache[n] = plan;
+    return plan;
+}
+
+size_t
+FFTPlan::good_size(size_t n)
+{
+    if (n <= 1)
+        return 1;
+
+    for (;; n++) {
+        size_t rest = n;
+        while (rest % 2 == 0)
+            rest /= 2;
+        while (rest % 3 == 0)
+            rest /= 3;
+        while (rest % 5 == 0)
+            rest /= 5;
+        if (rest == 1)
+            return n;
+    }
+}
+
+void
+FFTPlan::transform(Complex *data,
+                   Complex *work,
+                   size_t batch,
+                   bool inverse) const
+{
+    Complex *x = data;
+    Complex *y = work;
+    const Complex *tw = twiddles.data();
+
+    size_t l = n;
+    size_t s = batch;
+    for (size_t p : factors) {
+        size_t m = l / p;
+        if (inverse)
+            stage<true>(p, x, y, m, s, tw);
+        else
+            stage<false>(p, x, y, m, s, tw);
+        tw += m * (p - 1);
+        l = m;
+        s *= p;
+        std::swap(x, y);
+    }
+
+    if (x != data)
+        std::copy(x, x + n * batch, data);
+}
+
+FFTConvolver::FFTConvolver(const Kernel& kern,
+                           ssize_t _w,
+                           ssize_t _h) :
+    w { _w },
+    h { _h },
+    kern_w_f { ((ssize_t) kern[0].size() - 1) / 2 },
+    kern_h_f { ((ssize_t) kern.size() - 1) / 2 },
+    row_plan { FFTPlan::get(FFTPlan::good_size(_w)) },
+    column_plan { FFTPlan::get(FFTPlan::good_size(_h)) },
+    bins { row_plan->size() / 2 + 1 }
+{
+    // no pixel of the result can be computed, so there is nothing to transform.
+    if (2 * kern_w_f >= w || 2 * kern_h_f >= h)
+        return;
+
+    ssize_t px = row_plan->size();
+    ssize_t py = column_plan->size();
+
+    // Image::convolve correlates the image with the kernel, so the kernel is stored flipped around its center,
+    //     with the center at the origin and negative offsets wrapping around to the end of each dimension.
+    // Since the transform sizes are at least the image size, the wrap-around never reaches a pixel whose
+    //     result is kept.
+    std::vector<float> padded(px * py, 0);
+    for (ssize_t n = 0; n < (ssize_t) kern.size(); n++)
+        for (ssize_t m = 0; m < (ssize_t) kern[n].size(); m++) {
+            ssize_t x = (kern_w_f - m + px) % px;
+            ssize_t y = (kern_h_f - n + py) % py;
+            padded[px * y + x] = kern[n][m];
+        }
+
+    kern_spectrum.resize(py * bins);
+    forward(padded.data(), px, px, py, kern_spectrum.data());
+    transform_columns(kern_spectrum.data(), nullptr);
+
+    float scale = 1.0f / (px * py);
+    for (auto it = kern_spectrum.begin(); it != kern_spectrum.end(); ++it)
+        *it *= scale;
+}
+
+void
+FFTConvolver::forward(const float *src,
+                      ssize_t src_stride,
+                      ssize_t src_w,
+                      ssize_t src_h,
+                      Complex *spectrum) const
+{
+    ssize_t px = row_plan->size();
+    ssize_t py = column_plan->size();
+
+    // two real rows are transformed at once, as the real and imaginary parts of a single complex row.
+    parallel_for(0, (py + 1) / 2, rows_per_task(px, 8), [&](ssize_t p0, ssize_t p1) {
+        std::vector<Complex> row(px);
+        std::vector<Complex> work(px);
+
+        for (ssize_t j = 2 * p0; j < 2 * p1; j += 2) {
+            Complex *a = spectrum + bins * j;
+            Complex *b = j + 1 < py ? spectrum + bins * (j + 1) : nullptr;
+
+            if (j >= src_h) {
+                std::fill(a, a + bins, Complex(0, 0));
+                if (b)
+                    std::fill(b, b + bins, Complex(0, 0));
+                continue;
+            }
+
+            const float *row_a = src + src_stride * j;
+            const float *row_b = j + 1 < src_h ? src + src_stride * (j + 1) : nullptr;
+            for (ssize_t i = 0; i < src_w; i++)
+                row[i] = Complex(row_a[i], row_b ? row_b[i] : 0);
+            std::fill(row.begin() + src_w, row.end(), Complex(0, 0));
+
+            row_plan->transform(row.data(), work.data(), 1, false);
+
+            // separate the two spectra using their Hermitian symmetry.
+            for (size_t k = 0; k < bins; k++) {
+                Complex z = row[k];
+                Complex z_c = std::conj(row[(px - k) % px]);
+                a[k] = (z + z_c) * 0.5f;
+                if (b)
+                    b[k] = mul_i<true>(z - z_c) * 0.5f;
+            }
+        }
+    });
+}
+
+void
+FFTConvolver::transform_columns(Complex *spectrum,
+                                const Complex *filter) const
+{
+    ssize_t py = column_plan->size();
+
+    // Columns are transformed in groups of COLUMN_GROUP, gathered into a small interleaved batch which stays
+    //     in cache during all stages. Each column goes through exactly the same operations whatever the size
+    //     of its group, so results do not depend on how the work is split.
+    parallel_for(0, (bins + COLUMN_GROUP - 1) / COLUMN_GROUP, 1, [&](ssize_t g0, ssize_t g1) {
+        std::vector<Complex> batch(py * COLUMN_GROUP);
+        std::vector<Complex> work(py * COLUMN_GROUP);
+
+        for (ssize_t g = g0; g < g1; g++) {
+            size_t k0 = g * COLUMN_GROUP;
+            size_t n = std::min((size_t) COLUMN_GROUP, bins - k0);
+
+            for (ssize_t j = 0; j < py; j++)
+                std::copy(spectrum + bins * j + k0, spectrum + bins * j + k0 + n, batch.data() + n * j);
+
+            column_plan->transform(batch.data(), work.data(), n, false);
+            if (filter) {
+                for (ssize_t j = 0; j < py; j++)
+                    for (size_t k = 0; k < n; k++)
+                        batch[n * j + k] = mul(batch[n * j + k], filter[bins * j + k0 + k]);
+                column_plan->transform(batch.data(), work.data(), n, true);
+            }
+
+            for (ssize_t j = 0; j < py; j++)
+                std::copy(batch.data() + n * j, batch.data() + n * (j + 1), spectrum + bins * j + k0);
+        }
+    });
+}
+
+void
+FFTConvolver::convolve(const float *src,
+                       ssize_t src_stride,
+                       float *dst,
+                       ssize_t dst_stride) const
+{
+    for (ssize_t j = 0; j < h; j++)
+        std::fill(dst + dst_stride * j, dst + dst_stride * j + w, 0.0f);
+
+    if (kern_spectrum.empty())
+        return;
+
+    ssize_t px = row_plan->size();
+    ssize_t py = column_plan->size();
+
+    std::vector<Complex> spectrum(py * bins);
+    forward(src, src_stride, w, h, spectrum.data());
+    transform_columns(spectrum.data(), kern_spectrum.data());
+
+    // Only the rows for which the kernel fits in the image are needed.
+    // These are again transformed in pairs, and the full spectrum of each row is rebuilt from the stored half.
+    ssize_t j_begin = kern_h_f;
+    ssize_t j_end = h - kern_h_f;
+    parallel_for(0, (j_end - j_begin + 1) / 2, rows_per_task(px, 8), [&](ssize_t p0, ssize_t p1) {
+        std::vector<Complex> row(px);
+        std::vector<Complex> work(px);
+
+        for (ssize_t j = j_begin + 2 * p0; j < j_begin + 2 * p1; j += 2) {
+            const Complex *a = spectrum.data() + bins * j;
+            const Complex *b = j + 1 < j_end ? spectrum.data() + bins * (j + 1) : nullptr;
+
+            for (size_t k = 0; k < bins; k++)
+                row[k] = b ? a[k] + mul_i<false>(b[k]) : a[k];
+            for (ssize_t k = bins; k < px; k++)
+                row[k] = b ? std::conj(a[px - k]) + mul_i<false>(std::conj(b[px - k])) : std::conj(a[px - k]);
+
+            row_plan->transform(row.data(), work.data(), 1, true);
+
+            float *out_a = dst + dst_stride * j;
+            for (ssize_t i = kern_w_f; i < w - kern_w_f; i++)
+                out_a[i] = row[i].real();
+            if (b) {
+                float *out_b = dst + dst_stride * (j + 1);
+                for (ssize_t i = kern_w_f; i < w - kern_w_f; i++)
+                    out_b[i] = row[i].imag();
+            }
+        }
+    });
+}
+
+#undef COLUMN_GROUP
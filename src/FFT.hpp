@@ -0,0 +1,78 @@
+#ifndef __FFT_H_
+#define __FFT_H_
+
+#include <vector>
+#include <complex>
+#include <memory>
+#include <cstdlib>
+#include "Kernel.hpp"
+
+typedef std::complex<float> Complex;
+
+// A plan for complex FFTs of a fixed length.
+// The length may only have 2, 3 and 5 as prime factors; use good_size() to pad a length to such a value.
+// Plans are immutable once built, and are shared between all users of the same length through get().
+class FFTPlan {
+    size_t n;
+    // radices of each stage, in the order they are applied.
+    std::vector<size_t> factors;
+    // twiddle factors for every stage, laid out stage by stage.
+    // For a stage of radix p over sub-transforms of length l, the entry for (q, k) is exp(-2 pi i q k / l),
+    //    stored at q * (p - 1) + k - 1.
+    std::vector<Complex> twiddles;
+
+    FFTPlan(size_t _n);
+
+    public:
+        // returns the (cached) plan for length n.
+        static std::shared_ptr<const FFTPlan> get(size_t n);
+        // the smallest length >= n which has no prime factors other than 2, 3 and 5.
+        static size_t good_size(size_t n);
+
+        size_t size() const { return n; }
+
+        // Transforms batch interleaved sequences in place, so that element k of sequence b lives at data[batch * k + b].
+        // work must have room for batch * size() elements.
+        // The inverse transform is not normalized.
+        void transform(Complex *data,
+                       Complex *work,
+                       size_t batch,
+                       bool inverse) const;
+};
+
+// Applies a fixed kernel to images of a fixed size using real-to-complex 2D FFTs.
+// The result has the same semantics as the direct convolution in Image::convolve:
+//    only pixels at which the whole kernel fits in the image are computed, and all other pixels are set to 0.
+class FFTConvolver {
+    ssize_t w, h;
+    ssize_t kern_w_f, kern_h_f;
+    std::shared_ptr<const FFTPlan> row_plan, column_plan;
+    // number of complex bins kept per row of a spectrum; the remaining bins follow from Hermitian symmetry.
+    size_t bins;
+    // spectrum of the kernel, already scaled to normalize the inverse transform.
+    std::vector<Complex> kern_spectrum;
+
+    // transforms the rows of a src_w x src_h plane, zero padded to the plan sizes, into spectrum.
+    void forward(const float *src,
+                 ssize_t src_stride,
+                 ssize_t src_w,
+                 ssize_t src_h,
+                 Complex *spectrum) const;
+    // Transforms the columns of spectrum. If filter is not null, each column is then multiplied by the
+    //     same column of filter and transformed back, while it is still in cache.
+    void transform_columns(Complex *spectrum,
+                           const Complex *filter) const;
+
+    public:
+        FFTConvolver(const Kernel& kern,
+                     ssize_t _w,
+                     ssize_t _h);
+
+        // convolves the w x h plane src, writing the result to dst. src and dst may not overlap.
+        void convolve(const float *src,
+                      ssize_t src_stride,
+                      float *dst,
+                      ssize_t dst_stride) const;
+};
+
+#endif // __FFT_H_
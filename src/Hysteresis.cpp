@@ -0,0 +1,149 @@
+#include "Hysteresis.hpp"
+
+#include <vector>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include "ThreadPool.hpp"
+
+// Labels are pixel indices j * w + i, and each set is represented by its smallest index. Every pixel is first
+//     linked to a root within its own band of rows, so the bands are labeled independently of each other.
+typedef uint32_t Label;
+
+// finds the root of the set containing p, halving the path to it on the way.
+static inline Label
+find_root(Label *parent,
+          Label p)
+{
+    while (parent[p] != p) {
+        parent[p] = parent[parent[p]];
+        p = parent[p];
+    }
+    return p;
+}
+
+// finds the root of the set containing p without modifying parent, so it may run concurrently.
+static inline Label
+find_root(const Label *parent,
+          Label p)
+{
+    while (parent[p] != p)
+        p = parent[p];
+    return p;
+}
+
+// merges the sets containing p and q; the root of the merged set is the smaller of the two roots,
+//     and is strong if either of them was.
+static inline void
+merge(Label *parent,
+      unsigned char *strong,
+      Label p,
+      Label q)
+{
+    p = find_root(parent, p);
+    q = find_root(parent, q);
+    if (p == q)
+        return;
+    if (q < p)
+        std::swap(p, q);
+    parent[q] = p;
+    strong[p] |= strong[q];
+}
+
+void
+hysteresis(float *plane,
+           ssize_t stride,
+           ssize_t w,
+           ssize_t h,
+           float strong_value)
+{
+    if (w <= 0 || h <= 0)
+        return;
+    if ((size_t) w * h > std::numeric_limits<Label>::max())
+        throw std::length_error("Image is too large for edge tracking");
+
+    std::vector<Label> parent_buffer(w * h);
+    std::vector<unsigned char> strong_buffer(w * h, 0);
+    Label *parent = parent_buffer.data();
+    unsigned char *strong = strong_buffer.data();
+
+    // The bands do not depend on the number of threads, although the labeling would be the same with any bands.
+    ssize_t band_height = rows_per_task(w, 4);
+    ssize_t bands = (h + band_height - 1) / band_height;
+
+    // first pass: every edge pixel is merged with the edge pixels before it among its 8 neighbours in the
+    //     same band. Roots are always smaller than the pixels of their set, so a single sweep in order then
+    //     links every pixel directly to its root.
+    parallel_for(0, bands, 1, [&](ssize_t b0, ssize_t b1) {
+        for (ssize_t b = b0; b < b1; b++) {
+            ssize_t j0 = b * band_height;
+            ssize_t j1 = std::min(h, j0 + band_height);
+
+            for (ssize_t j = j0; j < j1; j++) {
+                const float *row = plane + stride * j;
+                const float *above = row - stride;
+                Label p = j * w;
+
+                for (ssize_t i = 0; i < w; i++, p++) {
+                    if (row[i] == 0)
+                        continue;
+                    parent[p] = p;
+                    strong[p] = row[i] == strong_value;
+
+                    if (i > 0 && row[i - 1] != 0)
+                        merge(parent, strong, p, p - 1);
+                    if (j > j0) {
+                        if (i > 0 && above[i - 1] != 0)
+                            merge(parent, strong, p, p - w - 1);
+                        if (above[i] != 0)
+                            merge(parent, strong, p, p - w);
+                        if (i < w - 1 && above[i + 1] != 0)
+                            merge(parent, strong, p, p - w + 1);
+                    }
+                }
+            }
+
+            for (ssize_t j = j0; j < j1; j++) {
+                const float *row = plane + stride * j;
+                Label p = j * w;
+                for (ssize_t i = 0; i < w; i++, p++)
+                    if (row[i] != 0)
+                        parent[p] = parent[parent[p]];
+            }
+        }
+    });
+
+    // seams: the first row of each band is merged with the last row of the band above. Only the roots of
+    //     the bands are relinked, which takes time proportional to the number of seams times the width.
+    for (ssize_t b = 1; b < bands; b++) {
+        ssize_t j = b * band_height;
+        const float *row = plane + stride * j;
+        const float *above = row - stride;
+        Label p = j * w;
+
+        for (ssize_t i = 0; i < w; i++, p++) {
+            if (row[i] == 0)
+                continue;
+            if (i > 0 && above[i - 1] != 0)
+                merge(parent, strong, p, p - w - 1);
+            if (above[i] != 0)
+                merge(parent, strong, p, p - w);
+            if (i < w - 1 && above[i + 1] != 0)
+                merge(parent, strong, p, p - w + 1);
+        }
+    }
+
+    // second pass: edge pixels in a set with a strong pixel become strong, the others are blacked out.
+    //     parent is no longer modified, so the roots are looked up concurrently.
+    const Label *roots = parent;
+    parallel_for(0, h, rows_per_task(w, 2), [&](ssize_t j0, ssize_t j1) {
+        for (ssize_t j = j0; j < j1; j++) {
+            float *row = plane + stride * j;
+            Label p = j * w;
+            for (ssize_t i = 0; i < w; i++, p++)
+                if (row[i] != 0)
+                    row[i] = strong[find_root(roots, p)] ? strong_value : 0;
+        }
+    });
+}
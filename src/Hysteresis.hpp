@@ -0,0 +1,18 @@
+#ifndef __HYSTERESIS_H_
+#define __HYSTERESIS_H_
+
+#include <cstdlib>
+
+// Edge tracking by hysteresis, the last step of Image::canny_edge_detect.
+// The pixels of the w x h plane must be either strong (equal to strong), weak (any other non zero value) or 0.
+// Weak pixels which are connected to a strong pixel through a chain of edge pixels, each one of the 8 neighbours
+//     of the next, become strong; all other weak pixels are set to 0.
+// Connected edges are found with a union-find labeling, computed over bands of rows in parallel and then merged
+//     across the seams between bands, so the time taken is linear in the size of the image.
+void hysteresis(float *plane,
+                ssize_t stride,
+                ssize_t w,
+                ssize_t h,
+                float strong);
+
+#endif // __HYSTERESIS_H_
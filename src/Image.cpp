@@ -3,82 +3,140 @@
 #include <cstdio>
 #include <cerrno>
 #include <cmath>
-#include <jpeglib.h>
+#include <png.h>
+#include <zlib.h>
 #include <string>
 #include <sstream>
 #include <fstream>
 #include <array>
+#include <algorithm>
 #include <system_error>
-#include <unordered_set>
 #include <functional>
+#include <memory>
 #include "Kernel.hpp"
+#include "FFT.hpp"
+#include "Separable.hpp"
+#include "BoxFilter.hpp"
+#include "RecursiveGaussian.hpp"
+#include "Hysteresis.hpp"
+#include "EdgeDetect.hpp"
+#include "Convolve.hpp"
+#include "ColorMatrix.hpp"
+#include "Interleave.hpp"
+#include "JPEG.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+
+// Each row holds the coefficients of the input channels followed by an offset, and computes the output channel
+//     of the same rank, e.g. the rows of RGB_to_YCbCr compute INTENSITY, Cb and Cr from RED, GREEN and BLUE.
+static const ColorMatrix RGB_to_YCbCr = color_matrix(3, {
+    {65.738 / 256.0, 129.057 / 256.0, 25.064 / 256.0, 16.0},
+    {-37.945 / 256.0, -74.494 / 256.0, 112.439 / 256.0, 128.0},
+    {112.439 / 256.0, -94.154 / 256.0, -18.285 / 256.0, 128.0},
+});
+
+static const ColorMatrix YCbCr_to_RGB = color_matrix(3, {
+    {298.082 / 256.0, 0.0, 408.583 / 256.0, -222.921},
+    {298.082 / 256.0, -100.291 / 256.0, -208.120 / 256.0, 135.576},
+    {298.082 / 256.0, 516.412 / 256.0, 0.0, -276.836},
+});
+
+static const ColorMatrix RGB_to_gray = color_matrix(3, {
+    {65.738 / 256.0, 129.057 / 256.0, 25.064 / 256.0, 16.0},
+});
+
+// the intensity column of YCbCr_to_RGB.
+static const ColorMatrix gray_to_RGB = color_matrix(1, {
+    {298.082 / 256.0, -222.921},
+    {298.082 / 256.0, 135.576},
+    {298.082 / 256.0, -276.836},
+});
+
+// CMYK is converted to RGB by modulating the complement of each of C, M and Y by the complement of K,
+//     and the result is then converted as RGB would be.
+static const ColorMatrix CMYK_to_RGB = color_matrix(3, {
+    {1.0, 0.0, 0.0, 0.0},
+    {0.0, 1.0, 0.0, 0.0},
+    {0.0, 0.0, 1.0, 0.0},
+}, true);
+
+static const ColorMatrix CMYK_to_YCbCr = color_matrix(3, {
+    {65.738 / 256.0, 129.057 / 256.0, 25.064 / 256.0, 16.0},
+    {-37.945 / 256.0, -74.494 / 256.0, 112.439 / 256.0, 128.0},
+    {112.439 / 256.0, -94.154 / 256.0, -18.285 / 256.0, 128.0},
+}, true);
+
+static const ColorMatrix CMYK_to_gray = color_matrix(3, {
+    {65.738 / 256.0, 129.057 / 256.0, 25.064 / 256.0, 16.0},
+}, true);
+
+// Applies m to the channels in_chs of src, writing the channels out_chs of dst, which has the same dimensions.
+static
+void
+convert_color(const ColorMatrix& m,
+              const PlanarBuffer& src,
+              const std::vector<ChannelType>& in_chs,
+              PlanarBuffer& dst,
+              const std::vector<ChannelType>& out_chs,
+              ColorPrecision precision)
+{
+    const float *in[COLOR_MATRIX_MAX_PLANES + 1];
+    float *out[COLOR_MATRIX_MAX_PLANES];
+    for (size_t c = 0; c < in_chs.size(); c++)
+        in[c] = src.plane(in_chs[c]);
+    for (size_t r = 0; r < out_chs.size(); r++)
+        out[r] = dst.plane(out_chs[r]);
+
+    ColorRowsFn rows = precision == COLOR_FIXED16 ? color_kernels().fixed : color_kernels().floating;
+    ssize_t w = src.width();
+    parallel_for(0, src.height(), rows_per_task(w, m.n_in * m.n_out), [&](ssize_t j0, ssize_t j1) {
+        rows(m, in, src.stride(), out, dst.stride(), w, j0, j1);
+    });
+}
 
-const std::map<ChannelType, std::array<float, 4>> RGB_to_YCbCr {
+std::vector<ChannelType>
+Image::channels(ColorSpace c_space)
 {
-    INTENSITY, {
-    65.738 / 256.0,
-    129.057 / 256.0,
-    25.064 / 256.0,
-    16.0,
-    },
-}, {
-    Cb, {
-    -37.945 / 256.0,
-    -74.494 / 256.0,
-    112.439 / 256.0,
-    128.0,
-    },
-}, {
-    Cr, {
-    112.439 / 256.0,
-    -94.154 / 256.0,
-    -18.285 / 256.0,
-    128.0,
-    },
+    switch (c_space) {
+        case RGB:
+            return { RED, GREEN, BLUE };
+        case RGBX:
+            return { RED, GREEN, BLUE, ALPHA_IGNORED };
+        case RGBA:
+            return { RED, GREEN, BLUE, ALPHA };
+        case CMYK:
+            return { CYAN, MAGENTA, YELLOW, BLACK };
+        case YCbCr:
+            return { INTENSITY, Cb, Cr };
+        case GRAY:
+            return { INTENSITY };
+    }
+    throw std::invalid_argument("Unsupported color space.");
 }
-};
 
-const std::map<ChannelType, std::array<float, 4>> YCbCr_to_RGB {
+Image
+Image::wrap(float *data,
+            ssize_t w,
+            ssize_t h,
+            ssize_t row_stride,
+            ssize_t plane_stride,
+            ColorSpace c_space,
+            std::shared_ptr<void> owner)
 {
-    RED, {
-    298.082 / 256.0,
-    0.0,
-    408.583 / 256.0,
-    -222.921,
-    },
-}, {
-    GREEN, {
-    298.082 / 256.0,
-    -100.291 / 256.0,
-    -208.120 / 256.0,
-    135.576,
-    },
-}, {
-    BLUE, {
-    298.082 / 256.0,
-    516.412 / 256.0,
-    0.0,
-    -276.836,
-    },
+    return Image(PlanarBuffer(data, w, h, row_stride, plane_stride, channels(c_space), std::move(owner)), c_space);
 }
-};
 
 void
-Image::to_RGB()
+Image::to_RGB(ColorPrecision precision)
 {
     // if image is already RGB, RGBX, or RGBA, minimal changes have to be made.
     switch (colorSpace()) {
         case RGB:
             return;
         case RGBX:
-        {
-            image_data.erase(ALPHA_IGNORED);
-            c_space = RGB;
-            return;
-        }
         case RGBA:
         {
-            image_data.erase(ALPHA);
+            image_data.keep(channels(RGB));
             c_space = RGB;
             return;
         }
@@ -86,9 +144,7 @@ Image::to_RGB()
             break;
     }
 
-    image_data.insert({ RED, std::vector<float>(width() * height(), 0) });
-    image_data.insert({ GREEN, std::vector<float>(width() * height(), 0) });
-    image_data.insert({ BLUE, std::vector<float>(width() * height(), 0) });
+    PlanarBuffer rgb(width(), height(), channels(RGB), BUFFER_UNINITIALIZED);
 
     switch (colorSpace()) {
         case RGB:
@@ -96,208 +152,270 @@ Image::to_RGB()
         case RGBA:
             throw std::logic_error("This color space should have been handled earlier.");
         case CMYK:
-            for (ssize_t i = 0; i < width(); i++)
-                for (ssize_t j = 0; j < height(); j++) {
-                    (*this)(RED, i, j) = (1 - get(CYAN, i, j)) * (1 - get(BLACK, i, j)) / 256.0;
-                    (*this)(GREEN, i, j) = (1 - get(MAGENTA, i, j)) * (1 - get(BLACK, i, j)) / 256.0;
-                    (*this)(BLUE, i, j) = (1 - get(YELLOW, i, j)) * (1 - get(BLACK, i, j)) / 256.0;
-                };
-            image_data.erase(CYAN);
-            image_data.erase(MAGENTA);
-            image_data.erase(YELLOW);
-            image_data.erase(BLACK);
+            convert_color(CMYK_to_RGB, image_data, channels(CMYK), rgb, channels(RGB), precision);
             break;
         case YCbCr:
-            for (ssize_t i = 0; i < width(); i++)
-                for (ssize_t j = 0; j < height(); j++) {
-                    (*this)(RED, i, j) = YCbCr_to_RGB.at(RED)[0] * get(INTENSITY, i, j) +
-                                         YCbCr_to_RGB.at(RED)[1] * get(Cb, i, j) +
-                                         YCbCr_to_RGB.at(RED)[2] * get(Cr, i, j) +
-                                         YCbCr_to_RGB.at(RED)[3];
-                    (*this)(GREEN, i, j) = YCbCr_to_RGB.at(GREEN)[0] * get(INTENSITY, i, j) +
-                                           YCbCr_to_RGB.at(GREEN)[1] * get(Cb, i, j) +
-                                           YCbCr_to_RGB.at(GREEN)[2] * get(Cr, i, j) +
-                                           YCbCr_to_RGB.at(GREEN)[3];
-                    (*this)(BLUE, i, j) = YCbCr_to_RGB.at(BLUE)[0] * get(INTENSITY, i, j) +
-                                          YCbCr_to_RGB.at(BLUE)[1] * get(Cb, i, j) +
-                                          YCbCr_to_RGB.at(BLUE)[2] * get(Cr, i, j) +
-                                          YCbCr_to_RGB.at(BLUE)[3];
-                    };
-            image_data.erase(INTENSITY);
-            image_data.erase(Cb);
-            image_data.erase(Cr);
+            convert_color(YCbCr_to_RGB, image_data, channels(YCbCr), rgb, channels(RGB), precision);
             break;
         case GRAY:
-            for (ssize_t i = 0; i < width(); i++)
-                for (ssize_t j = 0; j < height(); j++) {
-                    (*this)(RED, i, j) = YCbCr_to_RGB.at(RED)[0] * get(INTENSITY, i, j) +
-                                         YCbCr_to_RGB.at(RED)[3];
-                    (*this)(GREEN, i, j) = YCbCr_to_RGB.at(GREEN)[0] * get(INTENSITY, i, j) +
-                                           YCbCr_to_RGB.at(GREEN)[3];
-                    (*this)(BLUE, i, j) = YCbCr_to_RGB.at(BLUE)[0] * get(INTENSITY, i, j) +
-                                          YCbCr_to_RGB.at(BLUE)[3];
-                };
-            image_data.erase(INTENSITY);
+            convert_color(gray_to_RGB, image_data, channels(GRAY), rgb, channels(RGB), precision);
             break;
     }
+    image_data.swap(rgb);
     c_space = RGB;
 }
 
 void
-Image::to_YCbCr()
+Image::to_YCbCr(ColorPrecision precision)
 {
     if (colorSpace() == YCbCr)
         return;
     else if (colorSpace() == GRAY) {
-        image_data[Cb] = std::vector<float>(width() * height(), 0);
-        image_data[Cr] = std::vector<float>(width() * height(), 0);
+        PlanarBuffer ycc(width(), height(), channels(YCbCr));
+        ycc.copy_plane(image_data, INTENSITY);
+        image_data.swap(ycc);
         c_space = YCbCr;
         return;
     }
 
-    image_data.insert({ INTENSITY, std::vector<float>(width() * height(), 0) });
-    image_data.insert({ Cb, std::vector<float>(width() * height(), 0) });
-    image_data.insert({ Cr, std::vector<float>(width() * height(), 0) });
+    PlanarBuffer ycc(width(), height(), channels(YCbCr), BUFFER_UNINITIALIZED);
 
     switch (colorSpace()) {
         case RGBX:
-            image_data.erase(ALPHA_IGNORED);
-            goto RGB;
-            break;
         case RGBA:
-            image_data.erase(ALPHA);
-            goto RGB;
-            break;
         case RGB:
-        RGB:
-            for (ssize_t i = 0; i < width(); i++)
-                for (ssize_t j = 0; j < height(); j++) {
-                    (*this)(INTENSITY, i, j) = RGB_to_YCbCr.at(INTENSITY)[0] * get(RED, i, j) +
-                                               RGB_to_YCbCr.at(INTENSITY)[1] * get(GREEN, i, j) +
-                                               RGB_to_YCbCr.at(INTENSITY)[2] * get(BLUE, i, j) +
-                                               RGB_to_YCbCr.at(INTENSITY)[3];
-                    (*this)(Cb, i, j) = RGB_to_YCbCr.at(Cb)[0] * get(RED, i, j) +
-                                        RGB_to_YCbCr.at(Cb)[1] * get(GREEN, i, j) +
-                                        RGB_to_YCbCr.at(Cb)[2] * get(BLUE, i, j) +
-                                        RGB_to_YCbCr.at(Cb)[3];
-                    (*this)(Cr, i, j) = RGB_to_YCbCr.at(Cr)[0] * get(RED, i, j) +
-                                        RGB_to_YCbCr.at(Cr)[1] * get(GREEN, i, j) +
-                                        RGB_to_YCbCr.at(Cr)[2] * get(BLUE, i, j) +
-                                        RGB_to_YCbCr.at(Cr)[3];
-                };
-            image_data.erase(RED);
-            image_data.erase(GREEN);
-            image_data.erase(BLUE);
+            // alpha channels are simply thrown away.
+            convert_color(RGB_to_YCbCr, image_data, channels(RGB), ycc, channels(YCbCr), precision);
             break;
         case CMYK:
-            for (ssize_t i = 0; i < width(); i++)
-                for (ssize_t j = 0; j < height(); j++) {
-                    float red = (1 - get(CYAN, i, j)) * (1 - get(BLACK, i, j)) / 256.0;
-                    float green = (1 - get(MAGENTA, i, j)) * (1 - get(BLACK, i, j)) / 256.0;
-                    float blue = (1 - get(YELLOW, i, j)) * (1 - get(BLACK, i, j)) / 256.0;
-                    
-                    (*this)(INTENSITY, i, j) = RGB_to_YCbCr.at(INTENSITY)[0] * red +
-                                               RGB_to_YCbCr.at(INTENSITY)[1] * green +
-                                               RGB_to_YCbCr.at(INTENSITY)[2] * blue +
-                                               RGB_to_YCbCr.at(INTENSITY)[3];
-                    (*this)(Cb, i, j) = RGB_to_YCbCr.at(Cb)[0] * red +
-                                        RGB_to_YCbCr.at(Cb)[1] * green +
-                                        RGB_to_YCbCr.at(Cb)[2] * blue +
-                                        RGB_to_YCbCr.at(Cb)[3];
-                    (*this)(Cr, i, j) = RGB_to_YCbCr.at(Cr)[0] * red +
-                                        RGB_to_YCbCr.at(Cr)[1] * green +
-                                        RGB_to_YCbCr.at(Cr)[2] * blue +
-                                        RGB_to_YCbCr.at(Cr)[3];                   
-                    };
-            image_data.erase(CYAN);
-            image_data.erase(MAGENTA);
-            image_data.erase(YELLOW);
-            image_data.erase(BLACK);
+            convert_color(CMYK_to_YCbCr, image_data, channels(CMYK), ycc, channels(YCbCr), precision);
             break;
         case YCbCr:
         case GRAY:
-            throw std::logic_error("This color space should have been handled earlier.");                   
+            throw std::logic_error("This color space should have been handled earlier.");
     }
+    image_data.swap(ycc);
     c_space = YCbCr;
 }
 
 void
-Image::to_gray()
+Image::to_gray(ColorPrecision precision)
 {
     if (colorSpace() == GRAY)
         return;
     else if (colorSpace() == YCbCr) {
-        image_data.erase(Cb);
-        image_data.erase(Cr);
+        image_data.keep(channels(GRAY));
         c_space = GRAY;
         return;
     }
 
-    image_data.insert({ INTENSITY, std::vector<float>(width() * height(), 0) });
+    PlanarBuffer gray(width(), height(), channels(GRAY), BUFFER_UNINITIALIZED);
 
     switch (colorSpace()) {
         case RGB:
         case RGBX:
         case RGBA:
-            for (ssize_t i = 0; i < width(); i++)
-                for (ssize_t j = 0; j < height(); j++) {
-                   (*this)(INTENSITY, i, j) = RGB_to_YCbCr.at(INTENSITY)[0] * get(RED, i, j) +
-                                              RGB_to_YCbCr.at(INTENSITY)[1] * get(GREEN, i, j) +
-                                              RGB_to_YCbCr.at(INTENSITY)[2] * get(BLUE, i, j) +
-                                              RGB_to_YCbCr.at(INTENSITY)[3];
-                };
-            image_data.erase(RED);
-            image_data.erase(GREEN);
-            image_data.erase(BLUE);
+            convert_color(RGB_to_gray, image_data, channels(RGB), gray, channels(GRAY), precision);
             break;
         case CMYK:
-            for (ssize_t i = 0; i < width(); i++)
-                for (ssize_t j = 0; j < height(); j++) {
-                    float red = (1 - get(CYAN, i, j)) * (1 - get(BLACK, i, j)) / 256.0;
-                    float green = (1 - get(MAGENTA, i, j)) * (1 - get(BLACK, i, j)) / 256.0;
-                    float blue = (1 - get(YELLOW, i, j)) * (1 - get(BLACK, i, j)) / 256.0;
-
-                    (*this)(INTENSITY, i, j) = RGB_to_YCbCr.at(INTENSITY)[0] * red +
-                                               RGB_to_YCbCr.at(INTENSITY)[1] * green +
-                                               RGB_to_YCbCr.at(INTENSITY)[2] * blue +
-                                               RGB_to_YCbCr.at(INTENSITY)[3];
-                };
-            image_data.erase(CYAN);
-            image_data.erase(MAGENTA);
-            image_data.erase(YELLOW);
-            image_data.erase(BLACK);
+            convert_color(CMYK_to_gray, image_data, channels(CMYK), gray, channels(GRAY), precision);
             break;
         case YCbCr:
         case GRAY:
-            throw std::logic_error("This color space should have been handled earlier.");                   
+            throw std::logic_error("This color space should have been handled earlier.");
     }
+    image_data.swap(gray);
     c_space = GRAY;
 }
 
+// Applies a separable kernel to the w x h plane src, with the same semantics as the direct convolution.
+// Each term is applied as a row pass over every row, into a scratch plane which is zero outside the columns
+//      that the row pass computes, followed by a column pass which is summed into dst.
+static
+void
+convolve_separable(const float *src,
+                   ssize_t src_stride,
+                   float *dst,
+                   ssize_t dst_stride,
+                   ssize_t w,
+                   ssize_t h,
+                   const SeparableKernel& sep)
+{
+    if (sep.rank() == 0)
+        return;
+
+    ssize_t kern_w = sep.row(0).size();
+    ssize_t kern_h = sep.column(0).size();
+    ssize_t kern_h_f = (kern_h - 1) / 2;
+
+    const ConvolveKernels& kernels = convolve_kernels();
+    PlanarBuffer rows(w, h, { INTENSITY });
+    float *tmp = rows.plane(INTENSITY);
+
+    for (size_t t = 0; t < sep.rank(); t++) {
+        const float *row_taps = sep.row(t).data();
+        const float *column_taps = sep.column(t).data();
+
+        parallel_for(0, h, rows_per_task(w, kern_w), [&](ssize_t j0, ssize_t j1) {
+            kernels.row(src, src_stride,
+                        tmp, rows.stride(),
+                        w, j0, j1,
+                        row_taps, kern_w, 1);
+        });
+
+        parallel_for(kern_h_f, h - kern_h_f, rows_per_task(w, kern_h), [&](ssize_t j0, ssize_t j1) {
+            if (t == 0) {
+                kernels.column(tmp, rows.stride(),
+                               dst, dst_stride,
+                               w, j0, j1,
+                               column_taps, 1, kern_h);
+                return;
+            }
+
+            // later terms are computed one row at a time into a buffer, and added to the result;
+            //      with a stride of 0, the column kernel writes every row it computes to the same place.
+            std::vector<float> term(w);
+            for (ssize_t j = j0; j < j1; j++) {
+                kernels.column(tmp, rows.stride(),
+                               term.data(), 0,
+                               w, j, j + 1,
+                               column_taps, 1, kern_h);
+                float *out = dst + dst_stride * j;
+                for (ssize_t i = 0; i < w; i++)
+                    out[i] += term[i];
+            }
+        });
+    }
+}
+
 inline
 void
 Image::convolve_component(ChannelType ch,
-                          const Kernel& kern)
+                          const Kernel& kern,
+                          const SeparableKernel *sep,
+                          const FFTConvolver *fft_conv,
+                          PlanarBuffer& dst) const
 {
-    std::vector<float> convolved_comp(width() * height(), 0);
-
-    ssize_t kern_h_f = (kern.size() - 1) / 2;
-    ssize_t kern_w_f = (kern[0].size() - 1) / 2;
-
-    for (ssize_t i = kern_w_f; i < width() - kern_w_f; i++) {
-        // elements (i, j) which are in the safe zone; i.e. convolution at these pixels does not cause issues
-        for (ssize_t j = kern_h_f; j < height() - kern_h_f; j++) {
-            for (size_t m = 0; m < kern[0].size(); m++)
-                for (size_t n = 0; n < kern.size(); n++)
-                    convolved_comp[width() * j + i] += get(ch,
-                                                           i + m - kern_w_f,
-                                                           j + n - kern_h_f) * kern[n][m];
-        }
+    const float *src = image_data.plane(ch);
+    float *convolved_comp = dst.plane(ch);
+    ssize_t stride = image_data.stride();
+
+    if (sep) {
+        convolve_separable(src, stride,
+                           convolved_comp, dst.stride(),
+                           width(), height(), *sep);
+        return;
+    }
+
+    if (fft_conv) {
+        fft_conv->convolve(src, stride,
+                           convolved_comp, dst.stride());
+        return;
     }
 
-    image_data[ch] = convolved_comp;
+    ssize_t kern_w = kern[0].size();
+    ssize_t kern_h = kern.size();
+    ssize_t kern_h_f = (kern_h - 1) / 2;
+
+    // the row kernels take the taps column by column
+    std::vector<float> taps(kern_w * kern_h);
+    for (ssize_t m = 0; m < kern_w; m++)
+        for (ssize_t n = 0; n < kern_h; n++)
+            taps[kern_h * m + n] = kern[n][m];
+
+    const ConvolveKernels& kernels = convolve_kernels();
+    ConvolveRowsFn convolve_rows = kern_h == 1 ? kernels.row :
+                                   kern_w == 1 ? kernels.column :
+                                   kernels.general;
+
+    // only elements (i, j) which are in the safe zone are computed; i.e. convolution at these pixels does not cause issues
+    // Rows are computed in independent bands, each reading a halo of kern_h_f rows around it from src.
+    ssize_t dst_stride = dst.stride();
+    parallel_for(kern_h_f, height() - kern_h_f, rows_per_task(width(), kern_w * kern_h),
+                 [&](ssize_t j0, ssize_t j1) {
+        convolve_rows(src, stride,
+                      convolved_comp, dst_stride,
+                      width(), j0, j1,
+                      taps.data(), kern_w, kern_h);
+    });
 }
 
+void
+Image::filter_components(const std::function<void(ChannelType, PlanarBuffer&)>& filter)
+{
+    // components are filtered into a new buffer, and components which are not filtered are copied over.
+    PlanarBuffer filtered(width(), height(), image_data.channels());
+
+    switch (colorSpace()) {
+        case RGBA:
+            filtered.copy_plane(image_data, ALPHA);
+            goto RGB;
+        case RGBX:
+            filtered.copy_plane(image_data, ALPHA_IGNORED);
+            // fall through
+        case RGB:
+        RGB:
+            filter(RED, filtered);
+            filter(GREEN, filtered);
+            filter(BLUE, filtered);
+            break;
+        case CMYK:
+            filter(CYAN, filtered);
+            filter(MAGENTA, filtered);
+            filter(YELLOW, filtered);
+            filter(BLACK, filtered);
+            break;
+        case YCbCr:
+            filter(INTENSITY, filtered);
+            // filter(Cb, filtered);
+            // filter(Cr, filtered);
+            filtered.copy_plane(image_data, Cb);
+            filtered.copy_plane(image_data, Cr);
+            break;
+        case GRAY:
+            filter(INTENSITY, filtered);
+            break;
+    }
+
+    image_data.swap(filtered);
+}
+
+// Kernels having more than this many elements are applied in the frequency domain.
+// The direct convolution gets cheaper as vectors get wider, so the crossover depends on the instruction set.
+static
+size_t
+fft_crossover()
+{
+    switch (simd_level()) {
+        case SIMD_AVX512:
+            return 1225;
+        case SIMD_AVX2:
+            return 961;
+        case SIMD_SSE42:
+            return 529;
+        default:
+            return 225;
+    }
+}
+
+// The cost of the extra passes over the image made by each separable term, counted in kernel elements of
+//     the direct convolution. The direct convolution gets cheaper per element as vectors get wider,
+//     while the passes are bound by memory bandwidth, so the overhead depends on the instruction set.
+static
+size_t
+separable_overhead()
+{
+    switch (simd_level()) {
+        case SIMD_AVX512:
+            return 80;
+        case SIMD_AVX2:
+            return 48;
+        case SIMD_SSE42:
+            return 24;
+        default:
+            return 10;
+    }
+}
 
 Image&
 Image::convolve(const Kernel& kern)
@@ -317,30 +435,29 @@ Image::convolve(const Kernel& kern)
             throw std::invalid_argument("Kernel rows must be the same size");
     }
 
-    switch (colorSpace()) {
-        case RGB:
-        case RGBA:
-        case RGBX:
-            convolve_component(RED, kern);
-            convolve_component(GREEN, kern);
-            convolve_component(BLUE, kern);
-            break;
-        case CMYK:
-            convolve_component(CYAN, kern);
-            convolve_component(MAGENTA, kern);
-            convolve_component(YELLOW, kern);
-            convolve_component(BLACK, kern);
-            break;
-        case YCbCr:
-            convolve_component(INTENSITY, kern);
-            // convolve_component(Cb, kern);
-            // convolve_component(Cr, kern);
-            break;
-        case GRAY:
-            convolve_component(INTENSITY, kern);
-            break;
+    // Pick the cheapest way of applying the kernel, counting the operations per pixel:
+    //  * directly, one per element of the kernel,
+    //  * as row and column passes of its separable terms, one per element of each pass, plus the overhead
+    //    of the extra passes over the image,
+    //  * in the frequency domain, where the cost does not depend on the kernel and is set by fft_crossover().
+    // Kernels with a single row or column are already as cheap as they can be.
+    size_t area = kern.size() * kern_w;
+    std::shared_ptr<const SeparableKernel> sep;
+    if (kern.size() > 1 && kern_w > 1) {
+        sep = SeparableKernel::get(kern);
+        if (sep->rank() * (kern.size() + kern_w + separable_overhead()) >= std::min(area, fft_crossover()))
+            sep.reset();
     }
 
+    // the kernel's spectrum is computed once and shared by all components.
+    std::unique_ptr<FFTConvolver> fft_conv;
+    if (!sep && area > fft_crossover())
+        fft_conv.reset(new FFTConvolver(kern, width(), height()));
+
+    filter_components([&](ChannelType ch, PlanarBuffer& dst) {
+        convolve_component(ch, kern, sep.get(), fft_conv.get(), dst);
+    });
+
     return *this;
 }
 
@@ -359,10 +476,23 @@ Image::gaussian_blur_naive(float std_dev,
     return this->convolve(k);
 }
 
+// BLUR_AUTO uses the recursive filter from this standard deviation on. Below it, the recursive filter is not much
+//     cheaper than the vectorized kernels, and its approximation of the gaussian is noticeably less accurate.
+#define IIR_MIN_STD_DEV 8.0f
+
 Image&
 Image::gaussian_blur(float std_dev,
-                     ssize_t kern_size_f)
+                     ssize_t kern_size_f,
+                     BlurMethod method)
 {
+    // The recursive filter computes an untruncated gaussian, so it can only stand in for kernels which are
+    //     wide enough not to be truncated.
+    if (method == BLUR_AUTO)
+        method = std_dev >= IIR_MIN_STD_DEV && kern_size_f >= BLUR_ACC * std_dev ? BLUR_IIR : BLUR_FIR;
+
+    if (method == BLUR_IIR)
+        return gaussian_blur_recursive(std_dev, kern_size_f);
+
     GaussianRow r(std_dev, kern_size_f);
     GaussianColumn c(std_dev, kern_size_f);
 
@@ -375,232 +505,115 @@ Image::gaussian_blur(float std_dev,
 }
 
 #undef BLUR_ACC
+#undef IIR_MIN_STD_DEV
+
+Image&
+Image::gaussian_blur_recursive(float std_dev,
+                               ssize_t kern_size_f)
+{
+    RecursiveGaussian blur(std_dev);
+
+    filter_components([&](ChannelType ch, PlanarBuffer& dst) {
+        const float *src = image_data.plane(ch);
+        float *blurred = dst.plane(ch);
+        ssize_t stride = dst.stride();
+
+        parallel_for(0, height(), rows_per_task(width(), 16), [&](ssize_t j0, ssize_t j1) {
+            blur.blur_rows(src, image_data.stride(),
+                           blurred, stride,
+                           width(), j0, j1);
+        });
+        // the vertical pass is split into bands of columns, which are kept wide enough to read whole cache lines.
+        parallel_for(0, width(), std::max((ssize_t) 256, rows_per_task(height(), 16)), [&](ssize_t i0, ssize_t i1) {
+            blur.blur_columns(blurred, stride,
+                              blurred, stride,
+                              height(), i0, i1);
+        });
+
+        // black out the same border as the kernels of width 2 * kern_size_f + 1 do.
+        for (ssize_t j = 0; j < height(); j++) {
+            float *row = blurred + stride * j;
+            if (j < kern_size_f || j >= height() - kern_size_f || 2 * kern_size_f >= width()) {
+                std::fill(row, row + width(), 0.0f);
+                continue;
+            }
+            std::fill(row, row + kern_size_f, 0.0f);
+            std::fill(row + width() - kern_size_f, row + width(), 0.0f);
+        }
+    });
+
+    return *this;
+}
 
 Image&
 Image::box_blur(ssize_t kern_size_f)
 {
-    Kernel row_k(1,
-                 KernelRow(2 * kern_size_f + 1,
-                           1.0f / (2 * kern_size_f + 1)));
-    Kernel column_k(2 * kern_size_f + 1,
-                    KernelRow(1,
-                              1.0f / (2 * kern_size_f + 1)));
-    return this->convolve(row_k).convolve(column_k);
+    if (kern_size_f < 0)
+        throw std::invalid_argument("Kernel size must not be negative");
+
+    // Rows are blurred into a scratch plane, which is then blurred vertically.
+    // The row filter never writes the columns within kern_size_f of the border, so these stay zero in the
+    //     scratch plane, and the result has the same borders as a convolution with a row and a column kernel.
+    PlanarBuffer rows(width(), height(), { INTENSITY });
+    float *tmp = rows.plane(INTENSITY);
+
+    filter_components([&](ChannelType ch, PlanarBuffer& dst) {
+        const float *src = image_data.plane(ch);
+        float *blurred = dst.plane(ch);
+
+        parallel_for(0, height(), rows_per_task(width()), [&](ssize_t j0, ssize_t j1) {
+            box_filter_rows(src, image_data.stride(),
+                            tmp, rows.stride(),
+                            width(), j0, j1, kern_size_f);
+        });
+        // each band starts by summing 2 * kern_size_f + 1 rows, so bands are kept several times larger than that.
+        parallel_for(kern_size_f, height() - kern_size_f,
+                     std::max(rows_per_task(width()), 4 * (2 * kern_size_f + 1)),
+                     [&](ssize_t j0, ssize_t j1) {
+            box_filter_columns(tmp, rows.stride(),
+                               blurred, dst.stride(),
+                               width(), j0, j1, kern_size_f);
+        });
+    });
+
+    return *this;
+}
+
+Image&
+Image::fast_gaussian_blur(float std_dev,
+                          size_t passes)
+{
+    if (passes == 0)
+        throw std::invalid_argument("At least one pass is needed");
+
+    std::vector<ssize_t> radii = box_radii_for_gaussian(std_dev, passes);
+    for (auto it = radii.begin(); it != radii.end(); ++it)
+        box_blur(*it);
+
+    return *this;
 }
 
 Image&
 Image::canny_edge_detect(float blur_std_dev,
                          ssize_t blur_size_f,
                          float upper_threshold,
-                         float lower_threshold)
+                         float lower_threshold,
+                         EdgeOperator edge_operator)
 {
     to_gray();
 
     gaussian_blur(blur_std_dev, blur_size_f);
 
-#define SOBEL_X {{1.0f, 0.0f, -1.0f}, \
-                 {2.0f, 0.0f, -2.0f}, \
-                 {1.0f, 0.0f, -1.0f}}
-#define SOBEL_Y {{1.0f, 2.0f, 1.0f}, \
-                 {0.0f, 0.0f, 0.0f}, \
-                 {-1.0f, -2.0f, -1.0f}}
-
-#define SOBEL_FELDMAN_X {{3.0f, 0.0f, -3.0f},   \
-                         {10.0f, 0.0f, -10.0f},  \
-                         {3.0f, 0.0f, -3.0f}}
-#define SOBEL_FELDMAN_Y {{3.0f, 10.0f, 3.0f},    \
-                         {0.0f, 0.0f, 0.0f},     \
-                         {-3.0f, -10.0f, -3.0f}}
-
-#define SCHARR_X {{47.0f, 0.0f, -47.0f},        \
-                  {162.0f, 0.0f, -162.0f},      \
-                  {47.0f, 0.0f, -47.0f}}
-#define SCHARR_Y {{47.0f, 162.0f, 47.0f},       \
-                  {0.0f, 0.0f, 0.0f},           \
-                  {-47.0f, -162.0f, -47.0f}}
-
-#define SOBEL_X_LARGE {{-5.0f / 20, -4.0f / 20, 0.0f, 4.0f / 20, 5.0f / 20},   \
-                       {-8.0f / 20, -10.0f / 20, 0.0f, 10.0f / 20, 8.0f / 20}, \
-                       {-10.0f / 20, -20.0f / 20, 0.0f, 20.0f / 20, 10.0f / 20}, \
-                       {-8.0f / 20, -10.0f / 20, 0.0f, 10.0f / 20, 8.0f / 20},   \
-                       {-5.0f / 20, -4.0f / 20, 0.0f, 4.0f / 20, 5.0f / 20}}
-#define SOBEL_Y_LARGE {{-5.0f / 20, -8.0f / 20, -10.0f / 20, -8.0f / 20, -5.0f / 20}, \
-                       {-4.0f / 20, -10.0f / 20, -20.0f / 20, -10.0f / 20, -4.0f / 20}, \
-                       {0.0f, 0.0f, 0.0f, 0.0f, 0.0f},         \
-                       {4.0f / 20, 10.0f / 20, 20.0f / 20, 10.0f / 20, 4.0f / 20},      \
-                       {5.0f / 20, 8.0f / 20, 10.0f / 20, 8.0f / 20, 5.0f / 20}}
-
-    Kernel x_edge_k SOBEL_X;
-    Kernel y_edge_k SOBEL_Y;
-
-#undef SOBEL_X
-#undef SOBEL_Y
-
-#undef SOBEL_FELDMAN_X
-#undef SOBEL_FELDMAN_Y
-
-#undef SCHARR_X
-#undef SCHARR_Y
-
-#undef SOBEL_X_LARGE
-#undef SOBEL_Y_LARGE
-
-    Image tmp_copy(*this);
-
-    // find an approximation of gradient direction
-    Image Theta(atan2(pow(tmp_copy.convolve(y_edge_k), 2),
-                      pow(this->convolve(x_edge_k), 2)));
-    // find an approximation of image gradient.
-    *this = sqrt((*this = *this + tmp_copy)) * (1.0f / sqrt(2.0f));
-
-    // non-maximum suppression:
-    //    Pixels which are on an edge are analyzed as follows.
-    //      The approximate value of a pixel on either side of the edge in the gradient direction is calculated,
-    //         if both are brighter than the center pixel, this is set to 0.
-    std::vector<float> tmp(image_data[INTENSITY]); // temp store while image is suppressed
-    for (ssize_t i = 1; i < width() - 1; i++)
-        for (ssize_t j = 1; j < height() - 1; j++) {
-            float t = Theta.get(INTENSITY, i, j);
-            float next_pixel = 0; // variable to store value of next pixel on the edge
-            float last_pixel = 0; // variable to store value of last pixel on the edge
-
-            // find two pixels i_0 and i_1 such that the direction t of the image's gradient is between them
-            // The two pixels have directions t_0 and t_1 respectively which are multiples of pi / 4 radians.
-            // Using linear interpolation, the value of an imaginary pixel in the direction of the gradient is then
-            //  i = ((t_1 - t)i_1 + (t - t_0)i_0) / (t_1 - t_0)
-            //  Similarly, we can find the value of an imaginary pixel in the direction opposite the that of the gradient.
-            //  This is how values for next_pixel and last_pixel are found.
-#define INTERVAL (M_PI / 4)
-           // if (t >= 0 && t < INTERVAL) {
-           //     next_pixel = ((INTERVAL - t) * get(INTENSITY, i + 1, j - 1) -
-           //                   t * get(INTENSITY, i + 1, j)) / INTERVAL;
-           //     last_pixel = ((INTERVAL - t) * get(INTENSITY, i - 1, j + 1) -
-           //                   t * get(INTENSITY, i - 1, j)) / INTERVAL;
-           // } else if (t >= INTERVAL && t < 2 * INTERVAL) {
-           //     next_pixel = ((2 * INTERVAL - t) * get(INTENSITY, i, j - 1) -
-           //                   (INTERVAL - t) * get(INTENSITY, i + 1, j - 1)) / INTERVAL;
-           //     last_pixel = ((2 * INTERVAL - t) * get(INTENSITY, i, j + 1) -
-           //                   (INTERVAL - t) * get(INTENSITY, i - 1, j + 1)) / INTERVAL;
-           // } else if (t >= 2 * INTERVAL && t < 3 * INTERVAL) {
-           //     next_pixel = ((3 * INTERVAL - t) * get(INTENSITY, i - 1, j - 1) -
-           //                   (2 * INTERVAL - t) * get(INTENSITY, i, j - 1)) / INTERVAL;
-           //     last_pixel = ((3 * INTERVAL - t) * get(INTENSITY, i + 1, j + 1) -
-           //                   (2 * INTERVAL - t) * get(INTENSITY, i, j + 1)) / INTERVAL;
-           // } else if (t >= 3 * INTERVAL && t < 4 * INTERVAL) {
-           //     next_pixel = ((4 * INTERVAL - t) * get(INTENSITY, i - 1, j) -
-           //                   (3 * INTERVAL - t) * get(INTENSITY, i - 1, j - 1)) / INTERVAL;
-           //     last_pixel = ((4 * INTERVAL - t) * get(INTENSITY, i + 1, j) -
-           //                   (3 * INTERVAL - t) * get(INTENSITY, i + 1, j + 1)) / INTERVAL;
-           // } else if (t >= 4 * INTERVAL && t < 5 * INTERVAL) {
-           //     next_pixel = ((5 * INTERVAL - t) * get(INTENSITY, i - 1, j + 1) -
-           //                   (4 * INTERVAL - t) * get(INTENSITY, i - 1, j)) / INTERVAL;
-           //     last_pixel = ((5 * INTERVAL - t) * get(INTENSITY, i + 1, j - 1) -
-           //                   (4 * INTERVAL - t) * get(INTENSITY, i + 1, j)) / INTERVAL;
-           // } else if (t >= 5 * INTERVAL && t < 6 * INTERVAL) {
-           //     next_pixel = ((6 * INTERVAL - t) * get(INTENSITY, i, j + 1) -
-           //                   (5 * INTERVAL - t) * get(INTENSITY, i - 1, j + 1)) / INTERVAL;
-           //     last_pixel = ((6 * INTERVAL - t) * get(INTENSITY, i, j - 1) -
-           //                   (5 * INTERVAL - t) * get(INTENSITY, i + 1, j - 1)) / INTERVAL;
-           // } else if (t >= 6 * INTERVAL && t < 7 * INTERVAL) {
-           //     next_pixel = ((7 * INTERVAL - t) * get(INTENSITY, i + 1, j + 1) -
-           //                   (6 * INTERVAL - t) * get(INTENSITY, i, j + 1)) / INTERVAL;
-           //     last_pixel = ((7 * INTERVAL - t) * get(INTENSITY, i - 1, j - 1) -
-           //                   (6 * INTERVAL - t) * get(INTENSITY, i, j - 1)) / INTERVAL;
-           // } else if (t >= 7 * INTERVAL && t < 8 * INTERVAL) {
-           //     next_pixel = ((8 * INTERVAL - t) * get(INTENSITY, i + 1, j) -
-           //                   (7 * INTERVAL - t) * get(INTENSITY, i + 1, j + 1)) / INTERVAL;
-           //     last_pixel = ((8 * INTERVAL - t) * get(INTENSITY, i - 1, j) -
-           //                   (7 * INTERVAL - t) * get(INTENSITY, i - 1, j - 1)) / INTERVAL;
-           // }
-
-           if (t >= 0 && t < INTERVAL) {
-               next_pixel = get(INTENSITY, i + 1, j);
-               last_pixel = get(INTENSITY, i - 1, j);
-           } else if (t >= INTERVAL && t < 2 * INTERVAL) {
-               next_pixel = get(INTENSITY, i + 1, j - 1);
-               last_pixel = get(INTENSITY, i - 1, j + 1);
-           } else if (t >= 2 * INTERVAL && t < 3 * INTERVAL) {
-               next_pixel = get(INTENSITY, i, j - 1);
-               last_pixel = get(INTENSITY, i, j + 1);
-           } else if (t >= 3 * INTERVAL && t < 4 * INTERVAL) {
-               next_pixel = get(INTENSITY, i - 1, j - 1);
-               last_pixel = get(INTENSITY, i + 1, j + 1);
-           } else if (t >= 4 * INTERVAL && t < 5 * INTERVAL) {
-               next_pixel = get(INTENSITY, i - 1, j);
-               last_pixel = get(INTENSITY, i + 1, j);
-           } else if (t >= 5 * INTERVAL && t < 6 * INTERVAL) {
-               next_pixel = get(INTENSITY, i - 1, j + 1);
-               last_pixel = get(INTENSITY, i + 1, j - 1);
-           } else if (t >= 6 * INTERVAL && t < 7 * INTERVAL) {
-               next_pixel = get(INTENSITY, i, j + 1);
-               last_pixel = get(INTENSITY, i, j - 1);
-           } else if (t >= 7 * INTERVAL && t < 8 * INTERVAL) {
-               next_pixel = get(INTENSITY, i + 1, j + 1);
-               last_pixel = get(INTENSITY, i - 1, j - 1);
-           }
-
-#undef INTERVAL
-
-            if (get(INTENSITY, i, j) < last_pixel ||
-                get(INTENSITY, i, j) < next_pixel)
-                tmp[width() * j + i] = 0;
-        }
-    image_data[INTENSITY] = tmp;
-
-    // double threshold: pixels above upper_threshold are set to maximum intensity.
-    //                   pixels above lower_threshold but below upper_threshold are set to half intensity.
-    //                   Anything else is blacked out.
-    for (ssize_t i = 0; i < width(); i++)
-        for (ssize_t j = 0; j < height(); j++) {
-            if (get(INTENSITY, i, j) >= upper_threshold)
-                (*this)(INTENSITY, i, j) = get_max_intensity();
-            else if (get(INTENSITY, i, j) >= lower_threshold)
-                (*this)(INTENSITY, i, j) = get_max_intensity() / 2;
-            else
-                (*this)(INTENSITY, i, j) = 0;
-        }
+    // gradient, non-maximum suppression and double threshold.
+    PlanarBuffer edges(width(), height(), {INTENSITY});
+    canny_gradient(image_data.plane(INTENSITY), image_data.stride(),
+                   edges.plane(INTENSITY), edges.stride(),
+                   width(), height(), edge_operator,
+                   upper_threshold, lower_threshold, get_max_intensity());
+    image_data.swap(edges);
 
-    // connectivity analysis; improve eventually
-    std::unordered_set<ssize_t> visited_pts;
-
-    std::function<void(ssize_t, ssize_t)> traverse_edge = [&](ssize_t i, ssize_t j) {
-        visited_pts.insert(make_pair(i, j));
-
-#define EDGE_TRAVERSAL_CLAUSE(X, Y)                                    \
-        if (get(INTENSITY, (X), (Y)) == get_max_intensity() / 2) {     \
-            (*this)(INTENSITY, (X), (Y)) = get_max_intensity();        \
-            traverse_edge((X), (Y));                                   \
-        }
-
-        EDGE_TRAVERSAL_CLAUSE(i - 1, j - 1)
-        EDGE_TRAVERSAL_CLAUSE(i - 1, j)
-        EDGE_TRAVERSAL_CLAUSE(i - 1, j + 1)
-        EDGE_TRAVERSAL_CLAUSE(i, j - 1)
-        EDGE_TRAVERSAL_CLAUSE(i, j + 1)
-        EDGE_TRAVERSAL_CLAUSE(i + 1, j - 1)
-        EDGE_TRAVERSAL_CLAUSE(i + 1, j)
-        EDGE_TRAVERSAL_CLAUSE(i + 1, j + 1)
-#undef EDGE_TRAVERSAL_CLAUSE
-    };
-
-    for (ssize_t i = 0; i < width(); i++)
-        for (ssize_t j = 0; j < height(); j++) {
-            if (visited_pts.count(make_pair(i, j)))
-                continue;
-            else if (get(INTENSITY, i, j) != get_max_intensity()) {
-                visited_pts.insert(make_pair(i, j));
-            } else {
-                traverse_edge(i, j);
-            }
-        }
-
-    for (auto pair: visited_pts) {
-        ssize_t i = get_x_from_pair(pair);
-        ssize_t j = get_y_from_pair(pair);
-
-        if (get(INTENSITY, i, j) == get_max_intensity() / 2)
-            (*this)(INTENSITY, i, j) = 0;
-    }
+    // connectivity analysis: half intensity pixels connected to an edge at maximum intensity join it.
+    hysteresis(image_data.plane(INTENSITY), image_data.stride(), width(), height(), get_max_intensity());
 
     return *this;
 }
@@ -644,316 +657,536 @@ Image::canny_edge_detect(float blur_std_dev,
 //                      {1.0f / 3.0f, 1.0f / 3.0f, 1.0f / 3.0f},     \
 //                      {1/0f / 3.0f, 1.0f / 3.0f, 1.0f / 3.0f}}
 
+// the size of the blocks which libjpeg decodes component c into, which depends on its version.
+#if JPEG_LIB_VERSION >= 70
+#define DCT_H_SCALED_SIZE(c) ((c)->DCT_h_scaled_size)
+#define DCT_V_SCALED_SIZE(c) ((c)->DCT_v_scaled_size)
+#define MIN_DCT_H_SCALED_SIZE(cinfo) ((cinfo)->min_DCT_h_scaled_size)
+#define MIN_DCT_V_SCALED_SIZE(cinfo) ((cinfo)->min_DCT_v_scaled_size)
+#else
+#define DCT_H_SCALED_SIZE(c) ((c)->DCT_scaled_size)
+#define DCT_V_SCALED_SIZE(c) ((c)->DCT_scaled_size)
+#define MIN_DCT_H_SCALED_SIZE(cinfo) ((cinfo)->min_DCT_scaled_size)
+#define MIN_DCT_V_SCALED_SIZE(cinfo) ((cinfo)->min_DCT_scaled_size)
+#endif
+
 Image
-Image::readJPEG(const char *fname)
+Image::readJPEG(const char *fname,
+                const JPEGReadOptions& options)
 {
-    Image n_image;
+    JPEGFileDecompressor decompressor(fname);
+    jpeg_read_header(&decompressor.cinfo, TRUE);
+    return decompressJPEG(&decompressor.cinfo, options);
+}
 
-    FILE *ifp;
+std::vector<Image>
+Image::readJPEGPlanes(const char *fname)
+{
+    JPEGFileDecompressor decompressor(fname);
+    jpeg_read_header(&decompressor.cinfo, TRUE);
+    return decompressJPEGPlanes(&decompressor.cinfo);
+}
 
-    try { // catch any std::exception to throw custom one
-        ifp = fopen(fname, "rb");
-    } catch (...) {
-        ifp = nullptr;
-    }
+Image
+Image::decodeJPEG(const unsigned char *data,
+                  size_t size,
+                  const JPEGReadOptions& options)
+{
+    JPEGDecompressor decompressor;
+    // older versions of libjpeg take a pointer to non-const data, though they never write to it.
+    jpeg_mem_src(&decompressor.cinfo, const_cast<unsigned char *>(data), size);
+    jpeg_read_header(&decompressor.cinfo, TRUE);
+    return decompressJPEG(&decompressor.cinfo, options);
+}
 
-    if (!ifp) {
-        throw std::system_error(std::error_code(errno,
-                                                std::generic_category()),
-                                std::string("Could not open file ") + fname + " for reading");
+std::vector<Image>
+Image::decompressJPEGPlanes(jpeg_decompress_struct *cinfo)
+{
+    if (cinfo->jpeg_color_space != JCS_YCbCr && cinfo->jpeg_color_space != JCS_GRAYSCALE)
+        throw std::invalid_argument("Only YCbCr and grayscale JPEGs can be read raw.");
+
+    cinfo->raw_data_out = TRUE;
+    cinfo->out_color_space = cinfo->jpeg_color_space;
+    jpeg_start_decompress(cinfo);
+
+    // Every call to jpeg_read_raw_data decodes a row of MCUs, i.e. v_samp_factor blocks high in each
+    //     component, into buffers whose rows hold whole blocks.
+    int n = cinfo->num_components;
+    std::vector<Image> planes;
+    std::vector<std::vector<JSAMPLE>> buffers(n);
+    std::vector<std::vector<JSAMPROW>> rows(n);
+    std::vector<JSAMPARRAY> data(n);
+    for (int c = 0; c < n; c++) {
+        jpeg_component_info *comp = cinfo->comp_info + c;
+        planes.push_back(Image(comp->downsampled_width, comp->downsampled_height, GRAY));
+
+        size_t row_size = comp->width_in_blocks * DCT_H_SCALED_SIZE(comp);
+        rows[c].resize(comp->v_samp_factor * DCT_V_SCALED_SIZE(comp));
+        buffers[c].resize(row_size * rows[c].size());
+        for (size_t r = 0; r < rows[c].size(); r++)
+            rows[c][r] = buffers[c].data() + row_size * r;
+        data[c] = rows[c].data();
     }
 
-    struct jpeg_decompress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    cinfo.err = jpeg_std_error(&jerr);
-
-    jpeg_create_decompress(&cinfo);
-    jpeg_stdio_src(&cinfo, ifp);
-
-    jpeg_read_header(&cinfo, TRUE);
-
-    jpeg_start_decompress(&cinfo);
-
-    n_image.w = cinfo.output_width;
-    n_image.h = cinfo.output_height;
-    switch (cinfo.out_color_space) {
-        case JCS_CMYK:
-            n_image.c_space = CMYK;
-            n_image.image_data[CYAN] = std::vector<float>(n_image.width() *
-                                                          n_image.height(), 0);
-            n_image.image_data[MAGENTA] = std::vector<float>(n_image.width() *
-                                                             n_image.height(), 0);
-            n_image.image_data[YELLOW] = std::vector<float>(n_image.width() *
-                                                            n_image.height(), 0);
-            n_image.image_data[BLACK] = std::vector<float>(n_image.width() *
-                                                           n_image.height(), 0);
-            break;
-        case JCS_EXT_RGBX:
-        case JCS_EXT_BGRX:
-        case JCS_EXT_XRGB:
-        case JCS_EXT_XBGR:
-            n_image.c_space = RGBX;
-            n_image.image_data[RED] = std::vector<float>(n_image.width() *
-                                                         n_image.height(), 0);
-            n_image.image_data[BLUE] = std::vector<float>(n_image.width() *
-                                                          n_image.height(), 0);
-            n_image.image_data[GREEN] = std::vector<float>(n_image.width() *
-                                                           n_image.height(), 0);
-            n_image.image_data[ALPHA_IGNORED] = std::vector<float>(n_image.width() *
-                                                                   n_image.height(), 0);
-            break;
-        case JCS_EXT_RGBA:
-        case JCS_EXT_BGRA:
-        case JCS_EXT_ARGB:
-        case JCS_EXT_ABGR:
-            n_image.c_space = RGBA;
-            n_image.image_data[RED] = std::vector<float>(n_image.width() *
-                                                         n_image.height(), 0);
-            n_image.image_data[BLUE] = std::vector<float>(n_image.width() *
-                                                          n_image.height(), 0);
-            n_image.image_data[GREEN] = std::vector<float>(n_image.width() *
-                                                           n_image.height(), 0);
-            n_image.image_data[ALPHA] = std::vector<float>(n_image.width() *
-                                                           n_image.height(), 0);
-            break;
-        case JCS_EXT_RGB:
-        case JCS_EXT_BGR:
-        case JCS_RGB:
-        case JCS_RGB565:
-            n_image.c_space = RGB;
-            n_image.image_data[RED] = std::vector<float>(n_image.width() *
-                                                         n_image.height(), 0);
-            n_image.image_data[BLUE] = std::vector<float>(n_image.width() *
-                                                          n_image.height(), 0);
-            n_image.image_data[GREEN] = std::vector<float>(n_image.width() *
-                                                           n_image.height(), 0);
-            break;
-        case JCS_YCbCr:
-            n_image.c_space = YCbCr;
-            n_image.image_data[INTENSITY] = std::vector<float>(n_image.width() *
-                                                               n_image.height(), 0);
-            n_image.image_data[Cb] = std::vector<float>(n_image.width() *
-                                                        n_image.height(), 0);
-            n_image.image_data[Cr] = std::vector<float>(n_image.width() *
-                                                        n_image.height(), 0);
-            break;
-        case JCS_GRAYSCALE:
-            n_image.c_space = GRAY;
-            n_image.image_data[INTENSITY] = std::vector<float>(n_image.width() *
-                                                               n_image.height(), 0);
-            break;
-        case JCS_YCCK:
-        case JCS_UNKNOWN:
-            throw std::logic_error("Unsupported JPEG color space");
+    JDIMENSION mcu_height = cinfo->max_v_samp_factor * MIN_DCT_V_SCALED_SIZE(cinfo);
+    for (ssize_t mcu_row = 0; cinfo->output_scanline < cinfo->output_height; mcu_row++) {
+        jpeg_read_raw_data(cinfo, data.data(), mcu_height);
+
+        for (int c = 0; c < n; c++) {
+            ssize_t j0 = mcu_row * rows[c].size();
+            for (ssize_t r = 0; r < (ssize_t) rows[c].size() && j0 + r < planes[c].height(); r++) {
+                float *out = planes[c].image_data.row(INTENSITY, j0 + r);
+                for (ssize_t i = 0; i < planes[c].width(); i++)
+                    out[i] = rows[c][r][i];
+            }
+        }
     }
 
-    // mapper between component number and ChannelType
-    std::map<int, ChannelType> channelMapper;
+    jpeg_finish_decompress(cinfo);
 
-    switch (cinfo.out_color_space) {
-        case JCS_EXT_RGBX:
-            channelMapper[0] = RED;
-            channelMapper[1] = GREEN;
-            channelMapper[2] = BLUE;
-            channelMapper[3] = ALPHA_IGNORED;
-            break;
-        case JCS_EXT_RGBA:
-            channelMapper[3] = ALPHA;
-            // fall through
-        case JCS_EXT_RGB:
-        case JCS_RGB:
-        case JCS_RGB565:
-            channelMapper[0] = RED;
-            channelMapper[1] = GREEN;
-            channelMapper[2] = BLUE;
-            break;
-        case JCS_EXT_BGRX:
-            channelMapper[2] = RED;
-            channelMapper[1] = GREEN;
-            channelMapper[0] = BLUE;
-            channelMapper[3] = ALPHA_IGNORED;
-            break;
-        case JCS_EXT_BGRA:
-            channelMapper[3] = ALPHA;
-            // fall through
-        case JCS_EXT_BGR:
-            channelMapper[2] = RED;
-            channelMapper[1] = GREEN;
-            channelMapper[0] = BLUE;
-           break;
-        case JCS_EXT_XRGB:
-            channelMapper[1] = RED;
-            channelMapper[2] = GREEN;
-            channelMapper[3] = BLUE;
-            channelMapper[0] = ALPHA_IGNORED;
-            break;
-        case JCS_EXT_ARGB:
-            channelMapper[1] = RED;
-            channelMapper[2] = GREEN;
-            channelMapper[3] = BLUE;
-            channelMapper[0] = ALPHA;
-            break;
-        case JCS_EXT_XBGR:
-            channelMapper[3] = RED;
-            channelMapper[2] = GREEN;
-            channelMapper[1] = BLUE;
-            channelMapper[0] = ALPHA_IGNORED;
-            break;
-        case JCS_EXT_ABGR:
-            channelMapper[3] = RED;
-            channelMapper[2] = GREEN;
-            channelMapper[1] = BLUE;
-            channelMapper[0] = ALPHA;
-            break;
-        case JCS_CMYK:
-            channelMapper[0] = CYAN;
-            channelMapper[1] = MAGENTA;
-            channelMapper[2] = YELLOW;
-            channelMapper[3] = BLACK;
-            break;
-        case JCS_YCbCr:
-            channelMapper[0] = INTENSITY;
-            channelMapper[1] = Cb;
-            channelMapper[2] = Cr;
-            break;
-        case JCS_GRAYSCALE:
-            channelMapper[0] = INTENSITY;
-            break;
-        case JCS_YCCK:
-        case JCS_UNKNOWN:
-            throw std::logic_error("Unsupported JPEG color space");
-    }
+    return planes;
+}
 
-    // ith pixel belonging to channel comp will be stored @ cinfo.num_components * i + comp
-    JSAMPLE *row_buffer = new JSAMPLE[cinfo.output_width * cinfo.num_components];
-   
-    while (cinfo.output_scanline < cinfo.output_height) {
-        jpeg_read_scanlines(&cinfo, &row_buffer, 1);
-
-        for (auto it = channelMapper.begin();
-             it != channelMapper.end();
-             ++it)
-            for (ssize_t i = 0; i < n_image.width(); i++)
-                n_image(it->second, i, cinfo.output_scanline - 1)
-                    = row_buffer[cinfo.num_components * i + it->first];
+Image
+Image::decompressJPEG(jpeg_decompress_struct *cinfo,
+                      const JPEGReadOptions& options)
+{
+    Image n_image;
+
+    // Images which libjpeg cannot convert are decoded into the colour space it chooses and converted after.
+    set_jpeg_read_options(cinfo, options);
+
+    if (options.raw) {
+        // The size of each component relative to the image, which is h_factor / max_h_factor wide and
+        //      v_factor / max_v_factor high. When scaling, libjpeg may decode subsampled components with larger
+        //      blocks than the others, so these depend on the size of the blocks as well as on the sampling factors.
+        // They are computed before decoding, as comp_info is freed once decoding is finished.
+        cinfo->raw_data_out = TRUE;
+        jpeg_calc_output_dimensions(cinfo);
+        std::vector<int> h_factors, v_factors;
+        for (int c = 0; c < cinfo->num_components; c++) {
+            jpeg_component_info *comp = cinfo->comp_info + c;
+            h_factors.push_back(comp->h_samp_factor * DCT_H_SCALED_SIZE(comp));
+            v_factors.push_back(comp->v_samp_factor * DCT_V_SCALED_SIZE(comp));
+        }
+        int max_h_factor = cinfo->max_h_samp_factor * MIN_DCT_H_SCALED_SIZE(cinfo);
+        int max_v_factor = cinfo->max_v_samp_factor * MIN_DCT_V_SCALED_SIZE(cinfo);
+
+        std::vector<Image> planes = decompressJPEGPlanes(cinfo);
+        ssize_t w = cinfo->output_width, h = cinfo->output_height;
+        bool gray = planes.size() == 1 || (options.convert && options.color_space == GRAY);
+
+        n_image = Image(w, h, gray ? GRAY : YCbCr);
+        std::vector<ChannelType> components = channels(n_image.c_space);
+        for (size_t c = 0; c < components.size(); c++) {
+            if (gray && planes[c].width() == w && planes[c].height() == h) {
+                n_image = std::move(planes[c]);
+                break;
+            }
+
+            // pixel (i, j) of the image is pixel (i * h_factor / max_h_factor, j * v_factor / max_v_factor)
+            //      of the component.
+            std::vector<ssize_t> columns(w);
+            for (ssize_t i = 0; i < w; i++)
+                columns[i] = i * h_factors[c] / max_h_factor;
+            const Image& plane = planes[c];
+            ChannelType ch = components[c];
+            int v_factor = v_factors[c];
+            parallel_for(0, h, rows_per_task(w), [&](ssize_t j0, ssize_t j1) {
+                for (ssize_t j = j0; j < j1; j++) {
+                    const float *in = plane.image_data.row(INTENSITY, j * v_factor / max_v_factor);
+                    float *out = n_image.image_data.row(ch, j);
+                    for (ssize_t i = 0; i < w; i++)
+                        out[i] = in[columns[i]];
+                }
+            });
+        }
+
+        convert_decoded(n_image, options);
+        return n_image;
     }
 
-    jpeg_finish_decompress(&cinfo);
+    jpeg_start_decompress(cinfo);
+
+    JPEGScanlineReader reader(cinfo);
+    n_image = Image(cinfo->output_width, cinfo->output_height, reader.color_space(), BUFFER_UNINITIALIZED);
+    reader.read(n_image.image_data, 0, n_image.height());
 
-    delete[] row_buffer;
-    jpeg_destroy_decompress(&cinfo);
-    fclose(ifp);
+    jpeg_finish_decompress(cinfo);
 
+    convert_decoded(n_image, options);
     return n_image;
 }
 
-// Image
-// Image::readPNG(const char *fname)
-// {
+// error_fn of the PNG readers and writers below, throwing the message of the error rather than jumping.
+// As with libjpeg, libpng's frames have unwind information, so the exception reaches the caller.
+static
+void
+throw_png_error(png_structp,
+                png_const_charp message)
+{
+    throw std::runtime_error(std::string("Could not process PNG: ") + message);
+}
+
+// A reader which throws its errors, and which is destroyed however reading ends.
+class PNGReader {
+    public:
+        png_structp png;
+        png_infop info;
+
+        PNGReader() {
+            png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, throw_png_error, nullptr);
+            if (!png)
+                throw std::bad_alloc();
+            info = png_create_info_struct(png);
+            if (!info) {
+                png_destroy_read_struct(&png, nullptr, nullptr);
+                throw std::bad_alloc();
+            }
+        }
 
-// }
+        ~PNGReader() {
+            png_destroy_read_struct(&png, &info, nullptr);
+        }
+};
+
+// A reader reading from a file, which is closed however reading ends.
+class PNGFileReader : public PNGReader {
+    FILE *ifp;
 
+    public:
+        PNGFileReader(const char *fname) {
+            ifp = fopen(fname, "rb");
+            if (!ifp) {
+                throw std::system_error(std::error_code(errno,
+                                                        std::generic_category()),
+                                        std::string("Could not open file ") + fname + " for reading");
+            }
+
+            png_init_io(png, ifp);
+        }
+
+        ~PNGFileReader() {
+            fclose(ifp);
+        }
+};
+
+// A reader reading from memory, in place.
+class PNGMemoryReader : public PNGReader {
+    const unsigned char *data;
+    size_t size, offset;
+
+    static void read(png_structp png,
+                     png_bytep out,
+                     png_size_t n) {
+        PNGMemoryReader *reader = (PNGMemoryReader *) png_get_io_ptr(png);
+        if (n > reader->size - reader->offset)
+            png_error(png, "Unexpected end of data");
+        std::copy(reader->data + reader->offset, reader->data + reader->offset + n, out);
+        reader->offset += n;
+    }
+
+    public:
+        PNGMemoryReader(const unsigned char *_data,
+                        size_t _size) :
+            data { _data },
+            size { _size },
+            offset { 0 } {
+            png_set_read_fn(png, this, read);
+        }
+};
+
+// A writer which throws its errors, and which is destroyed however writing ends.
+class PNGWriter {
+    public:
+        png_structp png;
+        png_infop info;
+
+        PNGWriter() {
+            png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, throw_png_error, nullptr);
+            if (!png)
+                throw std::bad_alloc();
+            info = png_create_info_struct(png);
+            if (!info) {
+                png_destroy_write_struct(&png, nullptr);
+                throw std::bad_alloc();
+            }
+        }
+
+        ~PNGWriter() {
+            png_destroy_write_struct(&png, &info);
+        }
+};
+
+// A writer writing to a file, which is closed however writing ends.
+class PNGFileWriter : public PNGWriter {
+    FILE *ofp;
+
+    public:
+        PNGFileWriter(const char *fname) {
+            ofp = fopen(fname, "wb");
+            if (!ofp) {
+                throw std::system_error(std::error_code(errno,
+                                                        std::generic_category()),
+                                        std::string("Could not open file ") + fname + " for writing");
+            }
+
+            png_init_io(png, ofp);
+        }
+
+        ~PNGFileWriter() {
+            fclose(ofp);
+        }
+};
+
+// A writer appending the PNG to a vector.
+class PNGVectorWriter : public PNGWriter {
+    static void write(png_structp png,
+                      png_bytep in,
+                      png_size_t n) {
+        PNGVectorWriter *writer = (PNGVectorWriter *) png_get_io_ptr(png);
+        writer->data.insert(writer->data.end(), in, in + n);
+    }
+
+    static void flush(png_structp) {}
+
+    public:
+        std::vector<unsigned char> data;
+
+        PNGVectorWriter() {
+            png_set_write_fn(png, this, write, flush);
+        }
+};
+
+// converts w pixels of n 16 bit, big endian components from in into the rows out[0], ..., out[n - 1],
+//      scaling them to [0, 255].
+static
 void
-Image::writeJPEG(const char *fname,
-                 const int quality) const
+deinterleave_png16(const png_byte *in,
+                   float *const *out,
+                   ssize_t n,
+                   ssize_t w)
 {
-    FILE *ofp;
+    for (ssize_t i = 0; i < w; i++)
+        for (ssize_t c = 0; c < n; c++) {
+            const png_byte *sample = in + 2 * (n * i + c);
+            out[c][i] = ((sample[0] << 8) | sample[1]) / 257.0f;
+        }
+}
 
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
+// the opposite of deinterleave_png16, clamping pixels to [0, 255] and rounding them.
+static
+void
+interleave_png16(const float *const *in,
+                 png_byte *out,
+                 ssize_t n,
+                 ssize_t w)
+{
+    for (ssize_t i = 0; i < w; i++)
+        for (ssize_t c = 0; c < n; c++) {
+            float x = std::min(std::max(in[c][i], 0.0f), 255.0f);
+            long sample = lrintf(x * 257.0f);
+            png_byte *p = out + 2 * (n * i + c);
+            p[0] = sample >> 8;
+            p[1] = sample & 0xff;
+        }
+}
 
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
+Image
+Image::readPNG(const char *fname)
+{
+    PNGFileReader reader(fname);
+    return decompressPNG(reader.png, reader.info);
+}
 
-    try { // catch any std::exception to throw custom one.
-        ofp = fopen(fname, "wb");
-    } catch (...) {
-        ofp = nullptr;
+Image
+Image::decodePNG(const unsigned char *data,
+                 size_t size)
+{
+    PNGMemoryReader reader(data, size);
+    return decompressPNG(reader.png, reader.info);
+}
+
+Image
+Image::decompressPNG(png_structp png,
+                     png_infop info)
+{
+    png_read_info(png, info);
+
+    // every PNG is read as 8 or 16 bit gray, RGB or RGBA.
+    png_byte color_type = png_get_color_type(png, info);
+    bool transparency = png_get_valid(png, info, PNG_INFO_tRNS);
+    if (color_type == PNG_COLOR_TYPE_PALETTE)
+        png_set_palette_to_rgb(png);
+    if (color_type == PNG_COLOR_TYPE_GRAY && png_get_bit_depth(png, info) < 8)
+        png_set_expand_gray_1_2_4_to_8(png);
+    if (transparency)
+        png_set_tRNS_to_alpha(png);
+    if (color_type == PNG_COLOR_TYPE_GRAY_ALPHA || (color_type == PNG_COLOR_TYPE_GRAY && transparency))
+        png_set_gray_to_rgb(png);
+    int passes = png_set_interlace_handling(png);
+    png_read_update_info(png, info);
+
+    ColorSpace c_space;
+    switch (png_get_color_type(png, info)) {
+        case PNG_COLOR_TYPE_GRAY:
+            c_space = GRAY;
+            break;
+        case PNG_COLOR_TYPE_RGB:
+            c_space = RGB;
+            break;
+        case PNG_COLOR_TYPE_RGB_ALPHA:
+            c_space = RGBA;
+            break;
+        default:
+            throw std::logic_error("Unsupported PNG color type");
     }
+    Image n_image(png_get_image_width(png, info), png_get_image_height(png, info), c_space, BUFFER_UNINITIALIZED);
+
+    // components are stored in the order given by channels(), e.g. RED, GREEN, BLUE, ALPHA for RGBA images.
+    std::vector<ChannelType> components = channels(c_space);
+    bool wide = png_get_bit_depth(png, info) == 16;
+    DeinterleaveFn deinterleave = wide ? deinterleave_png16 : interleave_kernels().deinterleave;
+    auto convert_row = [&](const png_byte *row,
+                           ssize_t j) {
+        float *planes[4];
+        for (size_t c = 0; c < components.size(); c++)
+            planes[c] = n_image.image_data.row(components[c], j);
+        deinterleave(row, planes, components.size(), n_image.width());
+    };
 
-    if (!ofp) {
-        throw std::system_error(std::error_code(errno,
-                                                std::generic_category()),
-                                std::string("Could not open file ") + fname + " for reading");
+    // Rows are converted into the planes as they are read, unless the PNG is interlaced, in which case each pass
+    //      fills in some of the pixels of every row, and the whole image is read before being converted.
+    size_t row_size = png_get_rowbytes(png, info);
+    if (passes == 1) {
+        std::vector<png_byte> buffer(row_size);
+        for (ssize_t j = 0; j < n_image.height(); j++) {
+            png_read_row(png, buffer.data(), nullptr);
+            convert_row(buffer.data(), j);
+        }
+    } else {
+        std::vector<png_byte> buffer(row_size * n_image.height());
+        std::vector<png_bytep> rows(n_image.height());
+        for (ssize_t j = 0; j < n_image.height(); j++)
+            rows[j] = buffer.data() + row_size * j;
+        png_read_image(png, rows.data());
+        parallel_for(0, n_image.height(), rows_per_task(n_image.width()), [&](ssize_t j0, ssize_t j1) {
+            for (ssize_t j = j0; j < j1; j++)
+                convert_row(rows[j], j);
+        });
     }
-    jpeg_stdio_dest(&cinfo, ofp);
 
-    cinfo.image_width = width();
-    cinfo.image_height = height();
-    cinfo.input_components = image_data.size();
+    png_read_end(png, nullptr);
+
+    return n_image;
+}
+
+void
+Image::writePNG(const char *fname,
+                const PNGWriteOptions& options) const
+{
+    PNGFileWriter writer(fname);
+    compressPNG(writer.png, writer.info, options);
+}
+
+std::vector<unsigned char>
+Image::encodePNG(const PNGWriteOptions& options) const
+{
+    PNGVectorWriter writer;
+    compressPNG(writer.png, writer.info, options);
+    return std::move(writer.data);
+}
+
+void
+Image::compressPNG(png_structp png,
+                   png_infop info,
+                   const PNGWriteOptions& options) const
+{
+    if (options.bit_depth != 8 && options.bit_depth != 16)
+        throw std::invalid_argument("PNGs can only be written with 8 or 16 bits per sample.");
+    if (options.compression_level < -1 || options.compression_level > 9)
+        throw std::invalid_argument("The compression level of PNGs must be between -1 and 9.");
 
+    int color_type;
+    std::vector<ChannelType> components;
     switch (colorSpace()) {
-        case RGB:
-            cinfo.in_color_space = JCS_RGB;
+        case GRAY:
+            color_type = PNG_COLOR_TYPE_GRAY;
+            components = { INTENSITY };
             break;
+        case RGB:
         case RGBX:
-            cinfo.in_color_space = JCS_EXT_RGBX;
+            color_type = PNG_COLOR_TYPE_RGB;
+            components = { RED, GREEN, BLUE };
             break;
         case RGBA:
-            cinfo.in_color_space = JCS_EXT_RGBA;
+            color_type = PNG_COLOR_TYPE_RGB_ALPHA;
+            components = { RED, GREEN, BLUE, ALPHA };
             break;
-        case CMYK:
-            cinfo.in_color_space = JCS_CMYK;
+        default: {
+            Image rgb(*this);
+            rgb.to_RGB();
+            rgb.compressPNG(png, info, options);
+            return;
+        }
+    }
+
+    png_set_IHDR(png, info, width(), height(), options.bit_depth, color_type,
+                 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_compression_level(png, options.compression_level == -1 ? Z_DEFAULT_COMPRESSION
+                                                                    : options.compression_level);
+    switch (options.filters) {
+        case PNG_FILTERS_NONE:
+            png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
             break;
-        case YCbCr:
-            cinfo.in_color_space = JCS_YCbCr;
+        case PNG_FILTERS_FAST:
+            png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FAST_FILTERS);
             break;
-        case GRAY:
-            cinfo.in_color_space = JCS_GRAYSCALE;
+        case PNG_FILTERS_ALL:
+            png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_ALL_FILTERS);
             break;
     }
-
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
-    jpeg_start_compress(&cinfo, TRUE);
-
-    // create a row buffer and merge all components
-    JSAMPLE *row_buffer = new JSAMPLE[cinfo.image_width * cinfo.num_components];
-
-    while (cinfo.next_scanline < cinfo.image_height) {
-        for (ssize_t i = 0; i < width(); i++)
-            switch (colorSpace()) {
-                case RGB:
-                    row_buffer[cinfo.num_components * i] = get(RED, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 1] = get(GREEN, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 2] = get(BLUE, i, cinfo.next_scanline);
-                    break;
-                case RGBX:
-                    row_buffer[cinfo.num_components * i] = get(RED, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 1] = get(GREEN, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 2] = get(BLUE, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 3] = get(ALPHA_IGNORED, i, cinfo.next_scanline);
-                   break;
-                case RGBA:
-                    row_buffer[cinfo.num_components * i] = get(RED, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 1] = get(GREEN, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 2] = get(BLUE, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 3] = get(ALPHA, i, cinfo.next_scanline);
-                    break;
-                case CMYK:
-                    row_buffer[cinfo.num_components * i] = get(CYAN, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 1] = get(MAGENTA, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 2] = get(YELLOW, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 3] = get(BLACK, i, cinfo.next_scanline);
-                   break;
-                case YCbCr:
-                    row_buffer[cinfo.num_components * i] = get(INTENSITY, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 1] = get(Cb, i, cinfo.next_scanline);
-                    row_buffer[cinfo.num_components * i + 2] = get(Cr, i, cinfo.next_scanline);
-                    break;
-                case GRAY:
-                    row_buffer[cinfo.num_components * i] = get(INTENSITY, i, cinfo.next_scanline);
-                    break;
-            } // extract data for different kinds of color spaces
-        jpeg_write_scanlines(&cinfo, &row_buffer, 1);
+    png_write_info(png, info);
+
+    // rows are converted from the planes as they are written.
+    InterleaveFn interleave = options.bit_depth == 16 ? interleave_png16 : interleave_kernels().interleave;
+    std::vector<png_byte> buffer(width() * components.size() * options.bit_depth / 8);
+    for (ssize_t j = 0; j < height(); j++) {
+        const float *planes[4];
+        for (size_t c = 0; c < components.size(); c++)
+            planes[c] = image_data.row(components[c], j);
+        interleave(planes, buffer.data(), components.size(), width());
+        png_write_row(png, buffer.data());
     }
 
-    jpeg_finish_compress(&cinfo);
+    png_write_end(png, nullptr);
+}
 
-    delete[] row_buffer;
-    fclose(ofp);
-    jpeg_destroy_compress(&cinfo);
+void
+Image::writeJPEG(const char *fname,
+                 const int quality) const
+{
+    JPEGFileCompressor compressor(fname);
+    compressJPEG(&compressor.cinfo, quality);
+}
 
+std::vector<unsigned char>
+Image::encodeJPEG(const int quality) const
+{
+    JPEGCompressor compressor;
+    JPEGVectorDestination dest(&compressor.cinfo);
+    compressJPEG(&compressor.cinfo, quality);
+    return std::move(dest.data);
+}
+
+void
+Image::compressJPEG(jpeg_compress_struct *cinfo,
+                    const int quality) const
+{
+    JPEGScanlineWriter writer(cinfo, width(), height(), colorSpace(), quality);
+    writer.write(image_data, 0, height());
+
+    jpeg_finish_compress(cinfo);
 }
 
 std::string
@@ -981,14 +1214,14 @@ operator<<(std::ostream& os,
 {
     os << "Color space: " << str(im.c_space) << std::endl;
 
-    for (auto it = im.image_data.begin();
-         it != im.image_data.end();
+    for (auto it = im.image_data.channels().begin();
+         it != im.image_data.channels().end();
          ++it) {
-        os << "Channel: " << str(it->first) << std::endl;
+        os << "Channel: " << str(*it) << std::endl;
         for (ssize_t j = 0; j < im.height(); j++) {
             os << "[";
             for (ssize_t i = 0; i < im.width(); i++)
-                os << im.get(it->first, i, j) << ", ";
+                os << im.get(*it, i, j) << ", ";
             os << "]" << std::endl;
         }
         os << "---" << std::endl;
@@ -996,117 +1229,7 @@ operator<<(std::ostream& os,
     return os;
 }
 
-Image
-operator+(const Image& im1,
-          const Image& im2)
-{
-    if (im1.colorSpace() != im2.colorSpace())
-        throw std::invalid_argument("Images must have the same colour space");
-    if (im1.width() != im2.width())
-        throw std::invalid_argument("Images must have the same width");
-    if (im1.height() != im2.height())
-        throw std::invalid_argument("Images must have the same height");
-
-    Image n_im(im1);
-
-    for (auto it = im1.image_data.begin(); it != im1.image_data.end(); ++it)
-        for (ssize_t i = 0; i < im1.width(); i++)
-            for (ssize_t j = 0; j < im1.height(); j++)
-                n_im(it->first, i, j) += im2.get(it->first, i, j);
-
-    return n_im;
-}
-
-Image
-operator*(const Image& im1,
-          const Image& im2)
-{
-    if (im1.colorSpace() != im2.colorSpace())
-        throw std::invalid_argument("Images must have the same colour space");
-    if (im1.width() != im2.width())
-        throw std::invalid_argument("Images must have the same width");
-    if (im1.height() != im2.height())
-        throw std::invalid_argument("Images must have the same height");
-
-    Image n_im(im1);
-
-    for (auto it = im1.image_data.begin(); it != im1.image_data.end(); ++it)
-        for (ssize_t i = 0; i < im1.width(); i++)
-            for (ssize_t j = 0; j < im1.height(); j++)
-                n_im(it->first, i, j) *= im2.get(it->first, i, j);
-
-    return n_im;
-}
-
-Image
-operator+(const Image& im,
-          float x)
-{
-    Image n_im(im);
-
-    for (auto it = im.image_data.begin(); it != im.image_data.end(); ++it)
-        for (ssize_t i = 0; i < im.width(); i++)
-            for (ssize_t j = 0; j < im.height(); j++)
-                n_im(it->first, i, j) += x;
-
-    return n_im;
-}
-
-Image
-operator*(const Image& im,
-          float x)
-{
-    Image n_im(im);
-
-    for (auto it = im.image_data.begin(); it != im.image_data.end(); ++it)
-        for (ssize_t i = 0; i < im.width(); i++)
-            for (ssize_t j = 0; j < im.height(); j++)
-                n_im(it->first, i, j) *= x;
-
-    return n_im;
-}
-
-Image&
-pow(Image& im,
-    float p) {
-    for (auto it = im.image_data.begin(); it != im.image_data.end(); ++it)
-        for (ssize_t i = 0; i < im.width(); i++)
-            for (ssize_t j = 0; j < im.height(); j++)
-                im(it->first, i, j) = pow(im(it->first, i, j), p);
-
-     return im;
-
-}
-
-Image&
-sqrt(Image& im)
-{
-     for (auto it = im.image_data.begin(); it != im.image_data.end(); ++it)
-        for (ssize_t i = 0; i < im.width(); i++)
-            for (ssize_t j = 0; j < im.height(); j++)
-                im(it->first, i, j) = sqrt(im(it->first, i, j));
-
-     return im;
-}
-
-Image
-atan2(const Image& im1,
-      const Image& im2)
-{
-    if (im1.colorSpace() != im2.colorSpace())
-        throw std::invalid_argument("Images must have the same colour space");
-    if (im1.width() != im2.width())
-        throw std::invalid_argument("Images must have the same width");
-    if (im1.height() != im2.height())
-        throw std::invalid_argument("Images must have the same height");
-
-    Image n_im(im1.width(), im1.height(), im1.colorSpace());
-
-    for (auto it = im1.image_data.begin(); it != im1.image_data.end(); ++it)
-        for (ssize_t i = 0; i < im1.width(); i++)
-            for (ssize_t j = 0; j < im1.height(); j++)
-                n_im(it->first, i, j) = atan2(im1.get(it->first, i, j),
-                                             im2.get(it->first, i, j));
-
-    return n_im;
-}
+#undef DCT_H_SCALED_SIZE
+#undef DCT_V_SCALED_SIZE
+#undef MIN_DCT_H_SCALED_SIZE
+#undef MIN_DCT_V_SCALED_SIZE
@@ -7,40 +7,21 @@
 #include <iostream>
 #include <atomic>
 #include <cstdlib>
-
-typedef enum ChannelType {
-RED,
-GREEN,
-BLUE,
-ALPHA,
-ALPHA_IGNORED,
-CYAN,
-MAGENTA,
-YELLOW,
-BLACK,
-INTENSITY,
-Cb,
-Cr,
-} ChannelType;
-
-inline
-std::string
-str(ChannelType ch) {
-    switch (ch) {
-        case RED: return "RED";
-        case GREEN: return "GREEN";
-        case BLUE: return "BLUE";
-        case ALPHA: return "ALPHA";
-        case ALPHA_IGNORED: return "ALPHA_IGNORED";
-        case CYAN: return "CYAN";
-        case MAGENTA: return "MAGENTA";
-        case YELLOW: return "YELLOW";
-        case BLACK: return "BLACK";
-        case INTENSITY: return "INTENSITY";
-        case Cb: return "Cb";
-        case Cr: return "Cr";
-    }
-}
+#include <functional>
+#include <memory>
+#include "Channel.hpp"
+#include "PlanarBuffer.hpp"
+
+class FFTConvolver;
+class SeparableKernel;
+class ImageTerm;
+class LazyImage;
+class Pipeline;
+template <class E> class ImageExpr;
+struct jpeg_decompress_struct;
+struct jpeg_compress_struct;
+struct png_struct_def;
+struct png_info_def;
 
 typedef enum ColorSpace {
 RGB,
@@ -64,151 +45,269 @@ str(ColorSpace c_space) {
     }
 }
 
+// how gaussian_blur applies the blur.
+typedef enum BlurMethod {
+BLUR_AUTO, // chooses one of the methods below, depending on the standard deviation.
+BLUR_FIR,  // convolution with a row and a column kernel; its cost grows with the size of the kernel.
+BLUR_IIR,  // recursive filter, whose cost does not depend on the standard deviation.
+} BlurMethod;
+
+// the arithmetic with which colour conversions compute pixels.
+typedef enum ColorPrecision {
+COLOR_FLOAT,   // single precision floating point.
+COLOR_FIXED16, // 16 bit fixed point, as libjpeg does. Pixels are computed as 8 bit integers, so it suits images
+               //      holding 8 bit values, such as those just read from a file.
+} ColorPrecision;
+
+// how readJPEG decodes images.
+struct JPEGReadOptions {
+    // Whether to decode into color_space, which must be RGB, YCbCr or GRAY, rather than into the colour space
+    //      chosen by libjpeg, i.e. RGB for colour images, GRAY for grayscale ones and CMYK for CMYK ones.
+    // libjpeg converts into the colour space while decoding when it can; it does not even decode the chroma of
+    //      YCbCr images decoded into GRAY. Other images are converted after decoding as to_RGB() etc. would.
+    // Note that libjpeg's YCbCr is full range, i.e. intensities are not rescaled to [16, 235] as by to_YCbCr(),
+    //      and the intensity it decodes is not that computed by to_gray().
+    bool convert = false;
+    ColorSpace color_space = RGB;
+    // Whether to read the components as they are stored in the file, without colour conversion or upsampling
+    //      by libjpeg, giving YCbCr or GRAY images. Subsampled components are upsampled by replicating pixels.
+    //      Only YCbCr and grayscale JPEGs can be read raw.
+    bool raw = false;
+    // Scales the image by scale_num / scale_denom while decoding, which libjpeg does as part of the inverse DCT,
+    //      so a reduced image costs a fraction of the time and memory of decoding it whole and resizing it.
+    //      Scales of 1/8, 1/4, 1/2 and 1 are supported by every libjpeg; others are rounded up by libjpeg to the
+    //      next scale it supports, e.g. to a multiple of 1/8 by libjpeg-turbo.
+    unsigned scale_num = 1, scale_denom = 1;
+    // If either is positive, the image is decoded at the smallest scale of the form n/8 at which it is at least
+    //      min_width wide and min_height high, or whole if it is smaller than that; scale_num and scale_denom
+    //      are then ignored.
+    ssize_t min_width = 0, min_height = 0;
+};
+
+// the row filters from which libpng chooses when writing PNGs. Filtering rows makes them compress better.
+typedef enum PNGFilters {
+PNG_FILTERS_NONE, // rows are not filtered; fastest, but compresses worst.
+PNG_FILTERS_FAST, // libpng chooses for each row between no filter and the sub and up filters, which are cheap.
+PNG_FILTERS_ALL,  // libpng chooses for each row from every filter; slowest, but compresses best.
+} PNGFilters;
+
+// how writePNG encodes images.
+struct PNGWriteOptions {
+    // 8 or 16 bits per sample. 16 bit samples keep the fractions of pixels, which are stored multiplied by 257.
+    int bit_depth = 8;
+    // zlib's compression level, from 0 (no compression, fastest) to 9 (smallest), or -1 for zlib's default.
+    int compression_level = -1;
+    PNGFilters filters = PNG_FILTERS_ALL;
+};
+
+// the operator with which canny_edge_detect approximates the gradient of the image.
+typedef enum EdgeOperator {
+EDGE_SOBEL,         // 3 x 3 Sobel operator.
+EDGE_SOBEL_FELDMAN, // 3 x 3 operator with Feldman's weights, more isotropic than Sobel's.
+EDGE_SCHARR,        // 3 x 3 operator with Scharr's weights, optimized for rotational symmetry.
+EDGE_SOBEL_LARGE,   // 5 x 5 extension of the Sobel operator, less sensitive to noise.
+} EdgeOperator;
+
 typedef std::vector<std::vector<float>> Kernel;
 typedef std::vector<float> KernelRow;
 
 class Image {
-    // The data for one channel is held in a vector of floats,
-    //       organized in such a way that the pixel (i, j) is in the position w * j + i
+    // The channels of the image are held in a single PlanarBuffer,
+    //       organized in such a way that the pixel (i, j) of channel ch is at image_data.row(ch, j)[i].
     // Each individual pixel takes on a value of 0-255.
     // For many operations which export pixels, the exported pixel value is converted to some unsigned integer type.
-    std::map<ChannelType,
-             std::vector<float>> image_data;
+    PlanarBuffer image_data;
     ColorSpace c_space;
-    ssize_t w, h;
 
     public:
         // simple getters
-        ssize_t width() const { return w; }
-        ssize_t height() const { return h; }
+        ssize_t width() const { return image_data.width(); }
+        ssize_t height() const { return image_data.height(); }
         ColorSpace colorSpace() const { return c_space; }
-    private:
-        // interface functions to convert a pair of numbers to a unqique value and vice versa.
-        // can also be used to index into the image data array easily.
-        ssize_t make_pair(ssize_t i, ssize_t j) const { return width() * j + i; }
-        ssize_t get_x_from_pair(ssize_t pair) const { return pair % width(); }
-        ssize_t get_y_from_pair(ssize_t pair) const { return pair / width(); }
 
+        // the channels making up an image in the color space c_space.
+        static std::vector<ChannelType> channels(ColorSpace c_space);
+
+        // The planes holding the pixels of the image, which can be read and written in place.
+        // They are replaced by operations which compute new pixels, such as colour conversions and filters, so
+        //      pointers into them are only valid until the next such operation.
+        PlanarBuffer& buffer() { return image_data; }
+        const PlanarBuffer& buffer() const { return image_data; }
+
+        // An image in c_space whose pixels are held in memory which it neither copies nor frees, as by the wrapping
+        //      constructor of PlanarBuffer, with the planes of channels(c_space) in order. owner is kept until the image
+        //      no longer refers to the memory.
+        // Elementwise arithmetic into the image writes to the memory in place, while operations which compute new
+        //      pixels give the image memory of its own, as do copies.
+        static Image wrap(float *data,
+                          ssize_t w,
+                          ssize_t h,
+                          ssize_t row_stride,
+                          ssize_t plane_stride,
+                          ColorSpace c_space,
+                          std::shared_ptr<void> owner=std::shared_ptr<void>());
+    private:
         Image(){}
 
         // It is the responsibility of factory methods to call this method with the proper parameters,
         //     for example, no checks are made to see if image having ColorSpace RGB has only a RED, GREEN and BLUE channel.
-        Image(const std::map<ChannelType,
-              std::vector<float>>& _image_data,
-              const ColorSpace _c_space,
-              ssize_t _w,
-              ssize_t _h) :
-            image_data { _image_data },
-            c_space { _c_space },
-            w { _w },
-            h { _h } {}
+        Image(PlanarBuffer&& _image_data,
+              const ColorSpace _c_space) :
+            image_data { std::move(_image_data) },
+            c_space { _c_space } {}
 
     // access a single pixel, such as the RED pixel at (100, 200) in an RGB image.
         float& operator()(ChannelType ch,
                           ssize_t i,
-                          ssize_t j) { return image_data[ch][make_pair(i, j)]; }
+                          ssize_t j) { return image_data.row(ch, j)[i]; }
 
         float get(ChannelType ch,
                   ssize_t i,
-                  ssize_t j) const { return image_data.at(ch)[make_pair(i, j)]; }
+                  ssize_t j) const { return image_data.row(ch, j)[i]; }
 
         // return a copy of the indicated row. Avoid calling inside the API functions as it is somewhat expensive.
         // avoids returning a reference due to possibility of changing a single row's width.
         inline std::vector<float> operator()(ChannelType ch,
                                              ssize_t row) const;
 
-        // convolves a single component, purely used to reduce size of operator* definition.
+        // convolves a single component of the image into the corresponding plane of dst.
+        // If sep is given, kern is applied as the row and column passes of its terms;
+        //      otherwise if fft_conv is given, it is used in place of the direct convolution with kern.
         inline void convolve_component(ChannelType ch,
-                                       const Kernel& kern);
+                                       const Kernel& kern,
+                                       const SeparableKernel *sep,
+                                       const FFTConvolver *fft_conv,
+                                       PlanarBuffer& dst) const;
+
+        // Calls filter(ch, dst) for each component ch that filters such as convolve() apply to,
+        //      which must write the filtered component to the plane ch of dst.
+        // Other components, i.e. alpha channels and the chroma of YCbCr images, are left unchanged.
+        void filter_components(const std::function<void(ChannelType, PlanarBuffer&)>& filter);
+
+        // evaluates expr into this image, which must have its dimensions and colour space.
+        template <class E>
+        void assign(const E& expr);
+
+        // decodes the JPEG whose header has been read by cinfo.
+        static Image decompressJPEG(jpeg_decompress_struct *cinfo,
+                                    const JPEGReadOptions& options);
+        // decodes each component of the JPEG whose header has been read by cinfo with jpeg_read_raw_data.
+        static std::vector<Image> decompressJPEGPlanes(jpeg_decompress_struct *cinfo);
+        // encodes the image with cinfo, whose destination has been set.
+        void compressJPEG(jpeg_compress_struct *cinfo,
+                          const int quality) const;
+        // decodes the PNG read by png, whose input has been set.
+        static Image decompressPNG(png_struct_def *png,
+                                   png_info_def *info);
+        // encodes the image with png, whose output has been set.
+        void compressPNG(png_struct_def *png,
+                         png_info_def *info,
+                         const PNGWriteOptions& options) const;
+
+        // the BLUR_IIR method of gaussian_blur.
+        Image& gaussian_blur_recursive(float std_dev,
+                                       ssize_t kern_size_f);
 
     public:
         // copy constructor
         Image(const Image& im) :
             image_data { im.image_data },
-            c_space { im.c_space },
-            w { im.w },
-            h { im.h } {};
+            c_space { im.c_space } {};
 
         Image& operator=(const Image& im) {
             image_data = im.image_data;
             c_space = im.c_space;
-            w = im.w;
-            h = im.h;
             return *this;
         }
 
-        // empty image constructor
+        // move constructor; im is left empty.
+        Image(Image&& im) :
+            image_data { std::move(im.image_data) },
+            c_space { im.c_space } {};
+
+        Image& operator=(Image&& im) {
+            image_data.swap(im.image_data);
+            c_space = im.c_space;
+            return *this;
+        }
+
+        // Empty image constructor. The image is black, unless init is BUFFER_UNINITIALIZED, for callers which
+        //      write every pixel.
         Image(ssize_t _w,
               ssize_t _h,
-              ColorSpace _c_space) :
-            w { _w },
-            h { _h },
-            c_space { _c_space } {
-                switch (_c_space) {
-                    case RGBX:
-                         image_data[RED] = std::vector<float>(_w * _h, 0);
-                         image_data[GREEN] = std::vector<float>(_w * _h, 0);
-                         image_data[BLUE] = std::vector<float>(_w * _h, 0);
-                         image_data[ALPHA] = std::vector<float>(_w * _h, 0);
-                         break;
-                    case RGBA:
-                        image_data[ALPHA] = std::vector<float>(_w * _h, 0);
-                        // fall through
-                    case RGB:
-                         image_data[RED] = std::vector<float>(_w * _h, 0);
-                         image_data[GREEN] = std::vector<float>(_w * _h, 0);
-                         image_data[BLUE] = std::vector<float>(_w * _h, 0);
-                         break;
-                    case CMYK:
-                        image_data[CYAN] = std::vector<float>(_w * _h, 0);
-                        image_data[MAGENTA] = std::vector<float>(_w * _h, 0);
-                        image_data[YELLOW] = std::vector<float>(_w * _h, 0);
-                        image_data[BLACK] = std::vector<float>(_w * _h, 0);
-                        break;
-                    case YCbCr:
-                        image_data[INTENSITY] = std::vector<float>(_w * _h, 0);
-                        image_data[Cb] = std::vector<float>(_w * _h, 0);
-                        image_data[Cr] = std::vector<float>(_w * _h, 0);
-                        break;
-                    case GRAY:
-                        image_data[INTENSITY] = std::vector<float>(_w * _h, 0);
-                        break;
-                }
-            }
+              ColorSpace _c_space,
+              BufferInit init=BUFFER_ZERO) :
+            image_data { _w, _h, channels(_c_space), init },
+            c_space { _c_space } {}
 
+        // Colour conversions compute new pixels with the given precision; channels which are only kept or copied
+        //      are left as they are.
         // Converts images to RGB.
         //  * RGB images untouched
         //  * RGBX and RGBA images have their alpha channels thrown away; fast
-        void to_RGB();
+        void to_RGB(ColorPrecision precision=COLOR_FLOAT);
         // Converts images to YCbCr.
         //  * YCbCr images untouched
         //  * gray images have two channels added; fast
         //  * RGBX and RGBA have their alpha channels thrown away and are then converted.
-        void to_YCbCr();
+        void to_YCbCr(ColorPrecision precision=COLOR_FLOAT);
         // Converts images to gray. Similar semantics to to_YCbCr().
-        void to_gray();
+        void to_gray(ColorPrecision precision=COLOR_FLOAT);
 
         // convolve image
         Image& convolve(const Kernel& kern);
 
         Image& gaussian_blur_naive(float std_dev,
                                    ssize_t kern_size_f);
+        // Applies a gaussian blur with a kernel of width 2 * kern_size_f + 1, leaving a border of kern_size_f black.
+        // With BLUR_IIR, std_dev must be at least 0.5, and the blur is not truncated to the kernel's width.
         Image& gaussian_blur(float std_dev,
-                             ssize_t kern_size_f);
+                             ssize_t kern_size_f,
+                             BlurMethod method=BLUR_AUTO);
+        // box blur computed with running sums; its cost does not depend on kern_size_f.
         Image& box_blur(ssize_t kern_size_f);
+        // Approximates a gaussian blur by passes box blurs, at a cost which does not depend on std_dev.
+        // Like every pass of box_blur, each pass leaves a border of its radius black,
+        //      so the border gets wider as passes are added.
+        Image& fast_gaussian_blur(float std_dev,
+                                  size_t passes=3);
+        // The response of every edge_operator is scaled to that of the Sobel operator,
+        //      so the same thresholds can be used with any of them.
         Image& canny_edge_detect(float blur_std_dev=1.4f,
                                  ssize_t blur_size_f=2,
                                  float upper_threshold=76.8f,
-                                 float lower_threshold=25.6f);
+                                 float lower_threshold=25.6f,
+                                 EdgeOperator edge_operator=EDGE_SOBEL);
 
-        // writes the given JPEG to file with name fname.
+        // writes the given JPEG to file with name fname. Pixels are clamped to [0, 255] and truncated to integers.
         void writeJPEG(const char *fname, const int quality) const;
-        // IMPLEMENT
-        void writePNG(const char *fname) const;
-
-        static Image readJPEG(const char *fname);
-        // IMPLEMENT
+        // encodes the image as writeJPEG would, returning the JPEG rather than writing it to a file.
+        std::vector<unsigned char> encodeJPEG(const int quality) const;
+        // Writes the image to the PNG with name fname. Gray, RGB and RGBA images are written as they are,
+        //      RGBX images as RGB, and other images are converted to RGB. Pixels are clamped to [0, 255].
+        void writePNG(const char *fname,
+                      const PNGWriteOptions& options=PNGWriteOptions()) const;
+        // encodes the image as writePNG would, returning the PNG rather than writing it to a file.
+        std::vector<unsigned char> encodePNG(const PNGWriteOptions& options=PNGWriteOptions()) const;
+
+        // Errors reported by libjpeg while reading or writing JPEGs, e.g. for corrupt data, are thrown as
+        //      std::runtime_error.
+        static Image readJPEG(const char *fname,
+                              const JPEGReadOptions& options=JPEGReadOptions());
+        // Reads the components of a YCbCr or grayscale JPEG as they are stored in the file, each as a GRAY image.
+        // Subsampled components are left subsampled, so their images may be smaller than the JPEG.
+        static std::vector<Image> readJPEGPlanes(const char *fname);
+        // decodes the JPEG held in the size bytes at data as readJPEG would, reading them in place.
+        static Image decodeJPEG(const unsigned char *data,
+                                size_t size,
+                                const JPEGReadOptions& options=JPEGReadOptions());
+        // Reads the PNG with name fname, giving a gray, RGB or RGBA image. Gray PNGs with an alpha channel are read as
+        //      RGBA, and palettes are expanded. The samples of 16 bit PNGs are divided by 257, keeping their fractions.
+        // Errors reported by libpng are thrown as std::runtime_error.
         static Image readPNG(const char *fname);
+        // decodes the PNG held in the size bytes at data as readPNG would, reading them in place.
+        static Image decodePNG(const unsigned char *data,
+                               size_t size);
 
         std::string str() const;
         std::string dump() const;
@@ -216,22 +315,26 @@ class Image {
         friend std::ostream& operator<<(std::ostream& os,
                                         const Image& im);
 
-        // elementwise arithmetic operations.
-        // These may produce images with pixel values above 255.
-        //       Such images cause undefined behaviour if written to a file.
-        friend Image operator+(const Image& im1,
-                               const Image& im2);
-        friend Image operator*(const Image& im1,
-                               const Image& im2);
-        friend Image operator+(const Image& im,
-                               float x);
-        friend Image operator*(const Image& im,
-                               float x);
-        friend Image& pow(Image& im,
-                          float p);
-        friend Image& sqrt(Image& im);
-        friend Image atan2(const Image& im1,
-                           const Image& im2);
+        // Elementwise arithmetic is built as expressions, see ImageExpr.hpp, which are evaluated
+        //     in a single pass when constructing or assigning to an image.
+        template <class E>
+        Image(const ImageExpr<E>& expr);
+        template <class E>
+        Image& operator=(const ImageExpr<E>& expr);
+        // Compound assignment evaluates in place, without allocating, as does assigning an expression of this
+        //     image to it, e.g. y = atan2(y, x).
+        Image& operator+=(const Image& im);
+        Image& operator*=(const Image& im);
+        Image& operator+=(float x);
+        Image& operator*=(float x);
+        template <class E>
+        Image& operator+=(const ImageExpr<E>& expr);
+        template <class E>
+        Image& operator*=(const ImageExpr<E>& expr);
+
+        friend class ImageTerm;
+        friend class LazyImage;
+        friend class Pipeline;
 
         static float get_max_intensity() { return (float) ((1 << (sizeof(unsigned char) * 8)) - 1); }
 };
@@ -242,10 +345,8 @@ Image::operator()(ChannelType ch,
                   ssize_t row_i) const
 {
     if (image_data.count(ch) > 0) {
-        std::vector<float> row;
-        for (ssize_t i = 0; i < width(); i++)
-            row.push_back(image_data.at(ch)[make_pair(i, row_i)]);
-        return row;
+        const float *row = image_data.row(ch, row_i);
+        return std::vector<float>(row, row + width());
     } else
         throw std::invalid_argument("Unsupported channel type.");
 }
@@ -254,31 +355,7 @@ std::ostream&
 operator<<(std::ostream& os,
            const Image& im);
 
-Image
-operator+(const Image& im1,
-          const Image& im2);
-
-Image
-operator*(const Image& im1,
-          const Image& im2);
-
-Image
-operator+(const Image& im,
-          float x);
-
-Image
-operator*(const Image& im,
-          float x);
-
-Image&
-pow(Image& im,
-    float p);
-
-Image&
-sqrt(Image& im);
-
-Image
-atan2(const Image& im1,
-      const Image& im2);
+// the arithmetic operators and functions, and the definitions of the members which evaluate them.
+#include "ImageExpr.hpp"
 
 #endif // __IMAGE_H_
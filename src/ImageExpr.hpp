@@ -0,0 +1,329 @@
+#ifndef __IMAGE_EXPR_H_
+#define __IMAGE_EXPR_H_
+
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+#include "Image.hpp"
+#include "ThreadPool.hpp"
+
+// Expression templates for the elementwise arithmetic on images.
+// Arithmetic operators and functions do not compute anything, they return an expression which records the
+//     operation and holds its operands. Images are held by reference, so they must outlive the expression,
+//     and other expressions by value.
+// The expression is evaluated when it is used to construct or is assigned to an Image, in a single pass
+//     which computes each pixel of the result from the corresponding pixels of the images it refers to,
+//     without creating any intermediate images.
+//
+// Every expression E derives from ImageExpr<E>, and has
+//  * width(), height() and colorSpace(), those of the image it evaluates to,
+//  * bind(ch, j), which prepares the expression to compute row j of channel ch,
+//  * operator[](i), which computes pixel i of the row last bound,
+//  * cost, the approximate cost of computing a pixel, in additions.
+// Binding a row modifies the expression, so every thread evaluates its own copy.
+
+// the elementwise operations, shared with LazyImage.
+struct AddOp {
+    static const ssize_t cost = 1;
+    float operator()(float a, float b) const { return a + b; }
+};
+
+struct MulOp {
+    static const ssize_t cost = 1;
+    float operator()(float a, float b) const { return a * b; }
+};
+
+struct PowOp {
+    static const ssize_t cost = 8;
+    float operator()(float a, float p) const { return std::pow(a, p); }
+};
+
+struct SqrtOp {
+    static const ssize_t cost = 1;
+    float operator()(float a) const { return std::sqrt(a); }
+};
+
+struct Atan2Op {
+    static const ssize_t cost = 8;
+    float operator()(float a, float b) const { return std::atan2(a, b); }
+};
+
+// checks that two images or expressions can be combined pixel by pixel.
+template <class A, class B>
+void
+check_operands(const A& a,
+               const B& b)
+{
+    if (a.colorSpace() != b.colorSpace())
+        throw std::invalid_argument("Images must have the same colour space");
+    if (a.width() != b.width())
+        throw std::invalid_argument("Images must have the same width");
+    if (a.height() != b.height())
+        throw std::invalid_argument("Images must have the same height");
+}
+
+template <class E>
+class ImageExpr {
+    public:
+        const E& self() const { return static_cast<const E&>(*this); }
+};
+
+// an image, as an operand of an expression.
+class ImageTerm : public ImageExpr<ImageTerm> {
+    const Image *im;
+    const float *row;
+
+    public:
+        static const ssize_t cost = 0;
+
+        ImageTerm(const Image& _im) :
+            im { &_im },
+            row { nullptr } {}
+
+        ssize_t width() const { return im->width(); }
+        ssize_t height() const { return im->height(); }
+        ColorSpace colorSpace() const { return im->colorSpace(); }
+
+        void bind(ChannelType ch, ssize_t j) { row = im->image_data.row(ch, j); }
+        float operator[](ssize_t i) const { return row[i]; }
+};
+
+// op applied to each pixel of a.
+template <class Op, class A>
+class UnaryExpr : public ImageExpr<UnaryExpr<Op, A>> {
+    A a;
+
+    public:
+        static const ssize_t cost = A::cost + Op::cost;
+
+        UnaryExpr(const A& _a) :
+            a { _a } {}
+
+        ssize_t width() const { return a.width(); }
+        ssize_t height() const { return a.height(); }
+        ColorSpace colorSpace() const { return a.colorSpace(); }
+
+        void bind(ChannelType ch, ssize_t j) { a.bind(ch, j); }
+        float operator[](ssize_t i) const { return Op()(a[i]); }
+};
+
+// op applied to each pixel of a and the float x.
+template <class Op, class A>
+class ScalarExpr : public ImageExpr<ScalarExpr<Op, A>> {
+    A a;
+    float x;
+
+    public:
+        static const ssize_t cost = A::cost + Op::cost;
+
+        ScalarExpr(const A& _a,
+                   float _x) :
+            a { _a },
+            x { _x } {}
+
+        ssize_t width() const { return a.width(); }
+        ssize_t height() const { return a.height(); }
+        ColorSpace colorSpace() const { return a.colorSpace(); }
+
+        void bind(ChannelType ch, ssize_t j) { a.bind(ch, j); }
+        float operator[](ssize_t i) const { return Op()(a[i], x); }
+};
+
+// op applied to each pair of corresponding pixels of a and b, which must have the same dimensions and colour space.
+template <class Op, class A, class B>
+class BinaryExpr : public ImageExpr<BinaryExpr<Op, A, B>> {
+    A a;
+    B b;
+
+    public:
+        static const ssize_t cost = A::cost + B::cost + Op::cost;
+
+        BinaryExpr(const A& _a,
+                   const B& _b) :
+            a { _a },
+            b { _b } {
+            check_operands(a, b);
+        }
+
+        ssize_t width() const { return a.width(); }
+        ssize_t height() const { return a.height(); }
+        ColorSpace colorSpace() const { return a.colorSpace(); }
+
+        void bind(ChannelType ch, ssize_t j) { a.bind(ch, j); b.bind(ch, j); }
+        float operator[](ssize_t i) const { return Op()(a[i], b[i]); }
+};
+
+// Images and expressions are the operands of the arithmetic operators; operand<T>::type is how an expression
+//     holds an operand of type T.
+template <class T>
+struct is_operand : std::integral_constant<bool, std::is_same<T, Image>::value ||
+                                                 std::is_base_of<ImageExpr<T>, T>::value> {};
+
+template <class T>
+struct operand { typedef T type; };
+
+template <>
+struct operand<Image> { typedef ImageTerm type; };
+
+// elementwise arithmetic operations.
+// These may produce images with pixel values above 255, which are computed and kept as floats. They are clamped to
+//       [0, 255] when written to a file, and saturated when packed into a PackedImage of SAMPLE_U8 or SAMPLE_U16,
+//       while SAMPLE_F16 keeps them; see SampleType.
+// Since they only return an expression, calling them without using the result does nothing, e.g. pow(im, 2.0f) does
+//       not square im as it used to; the compiler warns about such calls.
+template <class A, class B>
+__attribute__((warn_unused_result))
+typename std::enable_if<is_operand<A>::value && is_operand<B>::value,
+                        BinaryExpr<AddOp, typename operand<A>::type, typename operand<B>::type>>::type
+operator+(const A& a,
+          const B& b)
+{
+    return { a, b };
+}
+
+template <class A, class B>
+__attribute__((warn_unused_result))
+typename std::enable_if<is_operand<A>::value && is_operand<B>::value,
+                        BinaryExpr<MulOp, typename operand<A>::type, typename operand<B>::type>>::type
+operator*(const A& a,
+          const B& b)
+{
+    return { a, b };
+}
+
+template <class A>
+__attribute__((warn_unused_result))
+typename std::enable_if<is_operand<A>::value,
+                        ScalarExpr<AddOp, typename operand<A>::type>>::type
+operator+(const A& a,
+          float x)
+{
+    return { a, x };
+}
+
+template <class A>
+__attribute__((warn_unused_result))
+typename std::enable_if<is_operand<A>::value,
+                        ScalarExpr<MulOp, typename operand<A>::type>>::type
+operator*(const A& a,
+          float x)
+{
+    return { a, x };
+}
+
+template <class A>
+__attribute__((warn_unused_result))
+typename std::enable_if<is_operand<A>::value,
+                        ScalarExpr<PowOp, typename operand<A>::type>>::type
+pow(const A& a,
+    float p)
+{
+    return { a, p };
+}
+
+template <class A>
+__attribute__((warn_unused_result))
+typename std::enable_if<is_operand<A>::value,
+                        UnaryExpr<SqrtOp, typename operand<A>::type>>::type
+sqrt(const A& a)
+{
+    return { a };
+}
+
+template <class A, class B>
+__attribute__((warn_unused_result))
+typename std::enable_if<is_operand<A>::value && is_operand<B>::value,
+                        BinaryExpr<Atan2Op, typename operand<A>::type, typename operand<B>::type>>::type
+atan2(const A& a,
+      const B& b)
+{
+    return { a, b };
+}
+
+template <class E>
+Image::Image(const ImageExpr<E>& expr) :
+    image_data { expr.self().width(), expr.self().height(), channels(expr.self().colorSpace()), BUFFER_UNINITIALIZED },
+    c_space { expr.self().colorSpace() }
+{
+    assign(expr.self());
+}
+
+template <class E>
+Image&
+Image::operator=(const ImageExpr<E>& expr)
+{
+    const E& e = expr.self();
+
+    // Each pixel only depends on the corresponding pixels of the operands, so the expression can be evaluated
+    //     in place even if this image is one of them. Otherwise the buffer does not fit the result.
+    if (e.colorSpace() != c_space || e.width() != width() || e.height() != height()) {
+        Image result(expr);
+        image_data.swap(result.image_data);
+        c_space = result.c_space;
+    } else
+        assign(e);
+
+    return *this;
+}
+
+inline
+Image&
+Image::operator+=(const Image& im)
+{
+    return *this = *this + im;
+}
+
+inline
+Image&
+Image::operator*=(const Image& im)
+{
+    return *this = *this * im;
+}
+
+inline
+Image&
+Image::operator+=(float x)
+{
+    return *this = *this + x;
+}
+
+inline
+Image&
+Image::operator*=(float x)
+{
+    return *this = *this * x;
+}
+
+template <class E>
+Image&
+Image::operator+=(const ImageExpr<E>& expr)
+{
+    return *this = *this + expr.self();
+}
+
+template <class E>
+Image&
+Image::operator*=(const ImageExpr<E>& expr)
+{
+    return *this = *this * expr.self();
+}
+
+template <class E>
+void
+Image::assign(const E& expr)
+{
+    ssize_t w = width();
+
+    for (auto it = image_data.channels().begin(); it != image_data.channels().end(); ++it)
+        parallel_for(0, height(), rows_per_task(w, E::cost), [&](ssize_t j0, ssize_t j1) {
+            E e(expr);
+            for (ssize_t j = j0; j < j1; j++) {
+                e.bind(*it, j);
+                float *row = image_data.row(*it, j);
+                for (ssize_t i = 0; i < w; i++)
+                    row[i] = e[i];
+            }
+        });
+}
+
+#endif // __IMAGE_EXPR_H_
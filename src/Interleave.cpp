@@ -0,0 +1,42 @@
+#include "Interleave.hpp"
+#include "Simd.hpp"
+
+namespace {
+
+#include "InterleaveSimd.inc"
+
+}
+
+InterleaveKernels
+interleave_kernels_scalar()
+{
+    InterleaveKernels kernels;
+    kernels.deinterleave = deinterleave;
+    kernels.interleave = interleave;
+    return kernels;
+}
+
+static
+InterleaveKernels
+select_interleave_kernels()
+{
+    switch (simd_level()) {
+#if defined(FOURIER_SIMD_X86)
+        case SIMD_AVX512:
+            return interleave_kernels_avx512();
+        case SIMD_AVX2:
+            return interleave_kernels_avx2();
+        case SIMD_SSE42:
+            return interleave_kernels_sse42();
+#endif
+        default:
+            return interleave_kernels_scalar();
+    }
+}
+
+const InterleaveKernels&
+interleave_kernels()
+{
+    static const InterleaveKernels kernels = select_interleave_kernels();
+    return kernels;
+}
@@ -0,0 +1,36 @@
+#ifndef __INTERLEAVE_H_
+#define __INTERLEAVE_H_
+
+#include <cstdlib>
+
+// Row kernels converting between the interleaved 8 bit samples read and written by libjpeg, in which the n
+//     components of a pixel are stored next to each other, and planes of floats.
+
+// converts w pixels of n components from in into the rows out[0], ..., out[n - 1].
+typedef void (*DeinterleaveFn)(const unsigned char *in,
+                               float *const *out,
+                               ssize_t n,
+                               ssize_t w);
+
+// converts w pixels from the rows in[0], ..., in[n - 1] into n components each at out.
+// Pixels are clamped to [0, 255] and truncated to integers.
+typedef void (*InterleaveFn)(const float *const *in,
+                             unsigned char *out,
+                             ssize_t n,
+                             ssize_t w);
+
+struct InterleaveKernels {
+    DeinterleaveFn deinterleave;
+    InterleaveFn interleave;
+};
+
+// the kernels for the most capable instruction set reported by simd_level().
+const InterleaveKernels& interleave_kernels();
+
+// the kernels for each instruction set. Only call these if the CPU supports the instruction set.
+InterleaveKernels interleave_kernels_scalar();
+InterleaveKernels interleave_kernels_sse42();
+InterleaveKernels interleave_kernels_avx2();
+InterleaveKernels interleave_kernels_avx512();
+
+#endif // __INTERLEAVE_H_
@@ -0,0 +1,17 @@
+// (De)interleaving kernels using AVX2. This file is compiled with -mavx2.
+#include "Interleave.hpp"
+
+namespace {
+
+#include "InterleaveSimd.inc"
+
+}
+
+InterleaveKernels
+interleave_kernels_avx2()
+{
+    InterleaveKernels kernels;
+    kernels.deinterleave = deinterleave;
+    kernels.interleave = interleave;
+    return kernels;
+}
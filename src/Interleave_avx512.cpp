@@ -0,0 +1,17 @@
+// (De)interleaving kernels using AVX-512F. This file is compiled with -mavx512f.
+#include "Interleave.hpp"
+
+namespace {
+
+#include "InterleaveSimd.inc"
+
+}
+
+InterleaveKernels
+interleave_kernels_avx512()
+{
+    InterleaveKernels kernels;
+    kernels.deinterleave = deinterleave;
+    kernels.interleave = interleave;
+    return kernels;
+}
@@ -0,0 +1,17 @@
+// (De)interleaving kernels using SSE4.2. This file is compiled with -msse4.2.
+#include "Interleave.hpp"
+
+namespace {
+
+#include "InterleaveSimd.inc"
+
+}
+
+InterleaveKernels
+interleave_kernels_sse42()
+{
+    InterleaveKernels kernels;
+    kernels.deinterleave = deinterleave;
+    kernels.interleave = interleave;
+    return kernels;
+}
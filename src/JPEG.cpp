@@ -0,0 +1,380 @@
+#include "JPEG.hpp"
+
+#include <cerrno>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include "Interleave.hpp"
+
+// the number of scanlines passed to libjpeg by every call reading or writing them.
+#define JPEG_SCANLINE_BATCH 16
+
+// the number of bytes by which the buffer of a JPEGVectorDestination starts, and then grows.
+#define JPEG_DESTINATION_SIZE 65536
+
+// error_exit of the (de)compressors, throwing the message of the error rather than exiting.
+// libjpeg's frames have unwind information, so the exception reaches the caller, whose (de)compressor is
+//      then destroyed as any other object.
+static
+void
+throw_jpeg_error(j_common_ptr cinfo)
+{
+    char message[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, message);
+    throw std::runtime_error(std::string("Could not process JPEG: ") + message);
+}
+
+JPEGDecompressor::JPEGDecompressor()
+{
+    cinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = throw_jpeg_error;
+    jpeg_create_decompress(&cinfo);
+}
+
+JPEGDecompressor::~JPEGDecompressor()
+{
+    jpeg_destroy_decompress(&cinfo);
+}
+
+JPEGFileDecompressor::JPEGFileDecompressor(const char *fname)
+{
+    try { // catch any std::exception to throw custom one
+        ifp = fopen(fname, "rb");
+    } catch (...) {
+        ifp = nullptr;
+    }
+
+    if (!ifp) {
+        throw std::system_error(std::error_code(errno,
+                                                std::generic_category()),
+                                std::string("Could not open file ") + fname + " for reading");
+    }
+
+    jpeg_stdio_src(&cinfo, ifp);
+}
+
+JPEGFileDecompressor::~JPEGFileDecompressor()
+{
+    fclose(ifp);
+}
+
+JPEGCompressor::JPEGCompressor()
+{
+    cinfo.err = jpeg_std_error(&jerr);
+    jerr.error_exit = throw_jpeg_error;
+    jpeg_create_compress(&cinfo);
+}
+
+JPEGCompressor::~JPEGCompressor()
+{
+    jpeg_destroy_compress(&cinfo);
+}
+
+JPEGFileCompressor::JPEGFileCompressor(const char *fname)
+{
+    try { // catch any std::exception to throw custom one.
+        ofp = fopen(fname, "wb");
+    } catch (...) {
+        ofp = nullptr;
+    }
+
+    if (!ofp) {
+        throw std::system_error(std::error_code(errno,
+                                                std::generic_category()),
+                                std::string("Could not open file ") + fname + " for writing");
+    }
+
+    jpeg_stdio_dest(&cinfo, ofp);
+}
+
+JPEGFileCompressor::~JPEGFileCompressor()
+{
+    fclose(ofp);
+}
+
+static
+void
+init_vector_destination(j_compress_ptr cinfo)
+{
+    JPEGVectorDestination *dest = (JPEGVectorDestination *) cinfo->dest;
+    dest->data.resize(JPEG_DESTINATION_SIZE);
+    dest->pub.next_output_byte = dest->data.data();
+    dest->pub.free_in_buffer = dest->data.size();
+}
+
+// called by libjpeg once the whole buffer is full.
+static
+boolean
+empty_vector_destination(j_compress_ptr cinfo)
+{
+    JPEGVectorDestination *dest = (JPEGVectorDestination *) cinfo->dest;
+    size_t size = dest->data.size();
+    dest->data.resize(size + JPEG_DESTINATION_SIZE);
+    dest->pub.next_output_byte = dest->data.data() + size;
+    dest->pub.free_in_buffer = JPEG_DESTINATION_SIZE;
+    return TRUE;
+}
+
+static
+void
+term_vector_destination(j_compress_ptr cinfo)
+{
+    JPEGVectorDestination *dest = (JPEGVectorDestination *) cinfo->dest;
+    dest->data.resize(dest->data.size() - dest->pub.free_in_buffer);
+}
+
+JPEGVectorDestination::JPEGVectorDestination(j_compress_ptr cinfo)
+{
+    pub.init_destination = init_vector_destination;
+    pub.empty_output_buffer = empty_vector_destination;
+    pub.term_destination = term_vector_destination;
+    cinfo->dest = &pub;
+}
+
+// the colour space into which libjpeg decodes a JPEG stored in in_space to give an image in c_space,
+//      or JCS_UNKNOWN if libjpeg cannot convert between them.
+static
+J_COLOR_SPACE
+jpeg_out_color_space(J_COLOR_SPACE in_space,
+                     ColorSpace c_space)
+{
+    switch (c_space) {
+        case RGB:
+            if (in_space == JCS_YCbCr || in_space == JCS_RGB)
+                return JCS_RGB;
+            break;
+        case YCbCr:
+            if (in_space == JCS_YCbCr)
+                return JCS_YCbCr;
+            break;
+        case GRAY:
+            if (in_space == JCS_YCbCr || in_space == JCS_GRAYSCALE)
+                return JCS_GRAYSCALE;
+            break;
+        default:
+            throw std::invalid_argument("JPEGs can only be decoded to RGB, YCbCr or gray images.");
+    }
+    return JCS_UNKNOWN;
+}
+
+// sets the scale at which cinfo decodes the JPEG, as asked for by options.
+static
+void
+set_jpeg_scale(jpeg_decompress_struct *cinfo,
+               const JPEGReadOptions& options)
+{
+    if (options.min_width <= 0 && options.min_height <= 0) {
+        if (options.scale_num == 0 || options.scale_denom == 0)
+            throw std::invalid_argument("JPEGs cannot be scaled by " + std::to_string(options.scale_num) +
+                                        "/" + std::to_string(options.scale_denom) + ".");
+        cinfo->scale_num = options.scale_num;
+        cinfo->scale_denom = options.scale_denom;
+        return;
+    }
+
+    // libjpeg computes the dimensions of the scaled image, rounding the scale to one it supports.
+    cinfo->scale_denom = 8;
+    for (cinfo->scale_num = 1; cinfo->scale_num < 8; cinfo->scale_num++) {
+        jpeg_calc_output_dimensions(cinfo);
+        if ((ssize_t) cinfo->output_width >= options.min_width &&
+            (ssize_t) cinfo->output_height >= options.min_height)
+            break;
+    }
+}
+
+void
+set_jpeg_read_options(jpeg_decompress_struct *cinfo,
+                      const JPEGReadOptions& options)
+{
+    if (options.convert) {
+        J_COLOR_SPACE out_color_space = jpeg_out_color_space(cinfo->jpeg_color_space, options.color_space);
+        if (out_color_space != JCS_UNKNOWN)
+            cinfo->out_color_space = out_color_space;
+    }
+
+    set_jpeg_scale(cinfo, options);
+}
+
+void
+convert_decoded(Image& im,
+                const JPEGReadOptions& options)
+{
+    if (!options.convert)
+        return;
+
+    switch (options.color_space) {
+        case RGB:
+            im.to_RGB();
+            break;
+        case YCbCr:
+            im.to_YCbCr();
+            break;
+        case GRAY:
+            im.to_gray();
+            break;
+        default:
+            throw std::invalid_argument("JPEGs can only be decoded to RGB, YCbCr or gray images.");
+    }
+}
+
+JPEGScanlineReader::JPEGScanlineReader(jpeg_decompress_struct *_cinfo) :
+    cinfo { _cinfo }
+{
+    switch (cinfo->out_color_space) {
+        case JCS_EXT_RGBX:
+            c_space = RGBX;
+            components = { RED, GREEN, BLUE, ALPHA_IGNORED };
+            break;
+        case JCS_EXT_RGBA:
+            c_space = RGBA;
+            components = { RED, GREEN, BLUE, ALPHA };
+            break;
+        case JCS_EXT_RGB:
+        case JCS_RGB:
+        case JCS_RGB565:
+            c_space = RGB;
+            components = { RED, GREEN, BLUE };
+            break;
+        case JCS_EXT_BGRX:
+            c_space = RGBX;
+            components = { BLUE, GREEN, RED, ALPHA_IGNORED };
+            break;
+        case JCS_EXT_BGRA:
+            c_space = RGBA;
+            components = { BLUE, GREEN, RED, ALPHA };
+            break;
+        case JCS_EXT_BGR:
+            c_space = RGB;
+            components = { BLUE, GREEN, RED };
+            break;
+        case JCS_EXT_XRGB:
+            c_space = RGBX;
+            components = { ALPHA_IGNORED, RED, GREEN, BLUE };
+            break;
+        case JCS_EXT_ARGB:
+            c_space = RGBA;
+            components = { ALPHA, RED, GREEN, BLUE };
+            break;
+        case JCS_EXT_XBGR:
+            c_space = RGBX;
+            components = { ALPHA_IGNORED, BLUE, GREEN, RED };
+            break;
+        case JCS_EXT_ABGR:
+            c_space = RGBA;
+            components = { ALPHA, BLUE, GREEN, RED };
+            break;
+        case JCS_CMYK:
+            c_space = CMYK;
+            components = { CYAN, MAGENTA, YELLOW, BLACK };
+            break;
+        case JCS_YCbCr:
+            c_space = YCbCr;
+            components = { INTENSITY, Cb, Cr };
+            break;
+        case JCS_GRAYSCALE:
+            c_space = GRAY;
+            components = { INTENSITY };
+            break;
+        case JCS_YCCK:
+        case JCS_UNKNOWN:
+            throw std::logic_error("Unsupported JPEG color space");
+    }
+
+    // Scanlines are read a batch at a time into a buffer holding a multiple of rec_outbuf_height rows,
+    //      the number of rows libjpeg decodes at once most efficiently, and then split into the planes.
+    // The ith pixel of component c of a row is stored @ cinfo->output_components * i + c.
+    ssize_t row_size = cinfo->output_width * cinfo->output_components;
+    ssize_t batch = (JPEG_SCANLINE_BATCH + cinfo->rec_outbuf_height - 1) / cinfo->rec_outbuf_height
+                    * cinfo->rec_outbuf_height;
+    buffer.resize(row_size * batch);
+    rows.resize(batch);
+    for (ssize_t r = 0; r < batch; r++)
+        rows[r] = buffer.data() + row_size * r;
+}
+
+void
+JPEGScanlineReader::read(PlanarBuffer& dst,
+                         ssize_t r0,
+                         ssize_t n)
+{
+    const InterleaveKernels& kernels = interleave_kernels();
+    std::vector<float *> planes(components.size());
+    for (ssize_t done = 0; done < n; ) {
+        JDIMENSION lines = jpeg_read_scanlines(cinfo, rows.data(), std::min<ssize_t>(rows.size(), n - done));
+
+        for (JDIMENSION r = 0; r < lines; r++, done++) {
+            for (size_t c = 0; c < components.size(); c++)
+                planes[c] = dst.row(components[c], r0 + done);
+            kernels.deinterleave(rows[r], planes.data(), components.size(), cinfo->output_width);
+        }
+    }
+}
+
+JPEGScanlineWriter::JPEGScanlineWriter(jpeg_compress_struct *_cinfo,
+                                       ssize_t w,
+                                       ssize_t h,
+                                       ColorSpace c_space,
+                                       int quality) :
+    cinfo { _cinfo },
+    components { Image::channels(c_space) }
+{
+    cinfo->image_width = w;
+    cinfo->image_height = h;
+    cinfo->input_components = components.size();
+
+    switch (c_space) {
+        case RGB:
+            cinfo->in_color_space = JCS_RGB;
+            break;
+        case RGBX:
+            cinfo->in_color_space = JCS_EXT_RGBX;
+            break;
+        case RGBA:
+            cinfo->in_color_space = JCS_EXT_RGBA;
+            break;
+        case CMYK:
+            cinfo->in_color_space = JCS_CMYK;
+            break;
+        case YCbCr:
+            cinfo->in_color_space = JCS_YCbCr;
+            break;
+        case GRAY:
+            cinfo->in_color_space = JCS_GRAYSCALE;
+            break;
+    }
+
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+    jpeg_start_compress(cinfo, TRUE);
+
+    // Scanlines are interleaved a batch at a time into a buffer, and passed to libjpeg in a single call.
+    // The ith pixel of component c of a row is stored @ cinfo->input_components * i + c.
+    ssize_t row_size = w * cinfo->input_components;
+    buffer.resize(row_size * JPEG_SCANLINE_BATCH);
+    rows.resize(JPEG_SCANLINE_BATCH);
+    for (ssize_t r = 0; r < JPEG_SCANLINE_BATCH; r++)
+        rows[r] = buffer.data() + row_size * r;
+}
+
+void
+JPEGScanlineWriter::write(const PlanarBuffer& src,
+                          ssize_t r0,
+                          ssize_t n)
+{
+    const InterleaveKernels& kernels = interleave_kernels();
+    std::vector<const float *> planes(components.size());
+    for (ssize_t done = 0; done < n; ) {
+        ssize_t lines = std::min<ssize_t>(JPEG_SCANLINE_BATCH, n - done);
+
+        for (ssize_t r = 0; r < lines; r++) {
+            for (size_t c = 0; c < components.size(); c++)
+                planes[c] = src.row(components[c], r0 + done + r);
+            kernels.interleave(planes.data(), rows[r], components.size(), cinfo->image_width);
+        }
+        done += jpeg_write_scanlines(cinfo, rows.data(), lines);
+    }
+}
+
+#undef JPEG_SCANLINE_BATCH
+#undef JPEG_DESTINATION_SIZE
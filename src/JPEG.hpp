@@ -0,0 +1,117 @@
+#ifndef __JPEG_H_
+#define __JPEG_H_
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <jpeglib.h>
+#include "Image.hpp"
+
+// The parts of the JPEG codec shared by Image and Pipeline: (de)compressors which throw their errors and are
+//      destroyed however coding ends, and the conversion of scanlines to and from planes.
+
+// A decompressor which throws its errors as std::runtime_error, and which is destroyed however decoding ends.
+class JPEGDecompressor {
+    struct jpeg_error_mgr jerr;
+
+    public:
+        struct jpeg_decompress_struct cinfo;
+
+        JPEGDecompressor();
+        ~JPEGDecompressor();
+};
+
+// A decompressor reading from a file, which is closed however reading ends.
+class JPEGFileDecompressor : public JPEGDecompressor {
+    FILE *ifp;
+
+    public:
+        JPEGFileDecompressor(const char *fname);
+        ~JPEGFileDecompressor();
+};
+
+// A compressor which throws its errors as std::runtime_error, and which is destroyed however encoding ends.
+class JPEGCompressor {
+    struct jpeg_error_mgr jerr;
+
+    public:
+        struct jpeg_compress_struct cinfo;
+
+        JPEGCompressor();
+        ~JPEGCompressor();
+};
+
+// A compressor writing to a file, which is closed however writing ends.
+class JPEGFileCompressor : public JPEGCompressor {
+    FILE *ofp;
+
+    public:
+        JPEGFileCompressor(const char *fname);
+        ~JPEGFileCompressor();
+};
+
+// A destination manager writing the compressed JPEG into a vector, which is grown as libjpeg fills it.
+// Unlike the buffer of jpeg_mem_dest, the vector is freed however encoding ends.
+struct JPEGVectorDestination {
+    struct jpeg_destination_mgr pub;
+    std::vector<unsigned char> data;
+
+    JPEGVectorDestination(j_compress_ptr cinfo);
+};
+
+// Sets up cinfo, whose header has been read, to decode the JPEG into the colour space and at the scale asked for
+//      by options, as far as libjpeg can; images which libjpeg cannot convert are left in the colour space it
+//      chooses, and must be converted after decoding.
+void set_jpeg_read_options(jpeg_decompress_struct *cinfo,
+                           const JPEGReadOptions& options);
+
+// converts im, decoded with the options set by set_jpeg_read_options, into the colour space asked for by options,
+//      if libjpeg has not already done so.
+void convert_decoded(Image& im,
+                     const JPEGReadOptions& options);
+
+// Reads the scanlines of a JPEG, whose decompression has been started, into planes.
+class JPEGScanlineReader {
+    jpeg_decompress_struct *cinfo;
+    ColorSpace c_space;
+    // the channel of each component, in the order in which libjpeg interleaves them.
+    std::vector<ChannelType> components;
+    std::vector<JSAMPLE> buffer;
+    std::vector<JSAMPROW> rows;
+
+    public:
+        JPEGScanlineReader(jpeg_decompress_struct *cinfo);
+
+        // the colour space of the image, whose channels the planes read into must have.
+        ColorSpace color_space() const { return c_space; }
+
+        // reads the next n scanlines into the rows [r0, r0 + n) of dst.
+        void read(PlanarBuffer& dst,
+                  ssize_t r0,
+                  ssize_t n);
+};
+
+// Writes the scanlines of an image from its planes into a JPEG.
+class JPEGScanlineWriter {
+    jpeg_compress_struct *cinfo;
+    // components are written in the order given by channels(), e.g. RED, GREEN, BLUE for RGB images.
+    std::vector<ChannelType> components;
+    std::vector<JSAMPLE> buffer;
+    std::vector<JSAMPROW> rows;
+
+    public:
+        // sets up cinfo, whose destination has been set, for a w x h image in c_space, and starts compressing.
+        JPEGScanlineWriter(jpeg_compress_struct *cinfo,
+                           ssize_t w,
+                           ssize_t h,
+                           ColorSpace c_space,
+                           int quality);
+
+        // Writes the rows [r0, r0 + n) of src as the next n scanlines. Pixels are clamped to [0, 255] and
+        //      truncated to integers.
+        void write(const PlanarBuffer& src,
+                   ssize_t r0,
+                   ssize_t n);
+};
+
+#endif // __JPEG_H_
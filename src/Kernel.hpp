@@ -44,7 +44,7 @@ class GaussianRow : public std::vector<std::vector<float>> {
             float q = sqrt(2 * M_PI) * std_dev;
 
             for (ssize_t i = 0; i < 2 * kern_size_f + 1; i++)
-                (*this)[0][i] = exp(-(i - kern_size_f) / p) / q;
+                (*this)[0][i] = exp(-(i - kern_size_f) * (i - kern_size_f) / p) / q;
         }
 
         void normalize() {
@@ -67,7 +67,7 @@ class GaussianColumn : public Kernel {
             float q = sqrt(2 * M_PI) * std_dev;
 
             for (ssize_t i = 0; i < 2 * kern_size_f + 1; i++)
-                (*this)[i][0] = exp(-(i - kern_size_f) / p) / q;
+                (*this)[i][0] = exp(-(i - kern_size_f) * (i - kern_size_f) / p) / q;
         }
 
         void normalize() {
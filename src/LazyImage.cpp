@@ -0,0 +1,280 @@
+#include "LazyImage.hpp"
+
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include "ImageExpr.hpp"
+#include "ThreadPool.hpp"
+
+// A node of an expression. The dimensions of an expression are those of the images it refers to at the time
+//     they are queried, since images may be modified after the expression is built.
+class LazyImage::Node {
+    public:
+        // rows of scratch space used by row().
+        const size_t depth;
+        // approximate cost of computing a pixel, in additions.
+        const ssize_t cost;
+
+        Node(size_t _depth,
+             ssize_t _cost) :
+            depth { _depth },
+            cost { _cost } {}
+        virtual ~Node() {}
+
+        virtual ssize_t width() const = 0;
+        virtual ssize_t height() const = 0;
+        virtual ColorSpace colorSpace() const = 0;
+        // throws std::invalid_argument if the operands of some operation can no longer be combined.
+        virtual void check() const = 0;
+
+        // computes row j of channel ch, w pixels wide, into out, using the depth rows of w floats at scratch.
+        virtual void row(ChannelType ch,
+                         ssize_t j,
+                         ssize_t w,
+                         float *out,
+                         float *scratch) const = 0;
+};
+
+namespace {
+
+typedef std::shared_ptr<const LazyImage::Node> NodePtr;
+
+class ImageNode : public LazyImage::Node {
+    const Image *im;
+    const PlanarBuffer *data;
+
+    public:
+        ImageNode(const Image *_im,
+                  const PlanarBuffer *_data) :
+            Node(0, 1),
+            im { _im },
+            data { _data } {}
+
+        ssize_t width() const { return im->width(); }
+        ssize_t height() const { return im->height(); }
+        ColorSpace colorSpace() const { return im->colorSpace(); }
+        void check() const {}
+
+        void row(ChannelType ch,
+                 ssize_t j,
+                 ssize_t w,
+                 float *out,
+                 float *) const {
+            const float *in = data->row(ch, j);
+            std::copy(in, in + w, out);
+        }
+};
+
+template <class Op>
+class UnaryNode : public LazyImage::Node {
+    NodePtr a;
+
+    public:
+        UnaryNode(NodePtr _a) :
+            Node(_a->depth, _a->cost + Op::cost),
+            a { std::move(_a) } {}
+
+        ssize_t width() const { return a->width(); }
+        ssize_t height() const { return a->height(); }
+        ColorSpace colorSpace() const { return a->colorSpace(); }
+        void check() const { a->check(); }
+
+        void row(ChannelType ch,
+                 ssize_t j,
+                 ssize_t w,
+                 float *out,
+                 float *scratch) const {
+            a->row(ch, j, w, out, scratch);
+            Op op;
+            for (ssize_t i = 0; i < w; i++)
+                out[i] = op(out[i]);
+        }
+};
+
+template <class Op>
+class ScalarNode : public LazyImage::Node {
+    NodePtr a;
+    float x;
+
+    public:
+        ScalarNode(NodePtr _a,
+                   float _x) :
+            Node(_a->depth, _a->cost + Op::cost),
+            a { std::move(_a) },
+            x { _x } {}
+
+        ssize_t width() const { return a->width(); }
+        ssize_t height() const { return a->height(); }
+        ColorSpace colorSpace() const { return a->colorSpace(); }
+        void check() const { a->check(); }
+
+        void row(ChannelType ch,
+                 ssize_t j,
+                 ssize_t w,
+                 float *out,
+                 float *scratch) const {
+            a->row(ch, j, w, out, scratch);
+            Op op;
+            for (ssize_t i = 0; i < w; i++)
+                out[i] = op(out[i], x);
+        }
+};
+
+// b is computed into the first row of scratch, so it uses one more row than it would on its own.
+template <class Op>
+class BinaryNode : public LazyImage::Node {
+    NodePtr a, b;
+
+    public:
+        BinaryNode(NodePtr _a,
+                   NodePtr _b) :
+            Node(std::max(_a->depth, _b->depth + 1), _a->cost + _b->cost + Op::cost),
+            a { std::move(_a) },
+            b { std::move(_b) } {
+            check_operands(*a, *b);
+        }
+
+        ssize_t width() const { return a->width(); }
+        ssize_t height() const { return a->height(); }
+        ColorSpace colorSpace() const { return a->colorSpace(); }
+        void check() const {
+            a->check();
+            b->check();
+            check_operands(*a, *b);
+        }
+
+        void row(ChannelType ch,
+                 ssize_t j,
+                 ssize_t w,
+                 float *out,
+                 float *scratch) const {
+            a->row(ch, j, w, out, scratch);
+            b->row(ch, j, w, scratch, scratch + w);
+            Op op;
+            for (ssize_t i = 0; i < w; i++)
+                out[i] = op(out[i], scratch[i]);
+        }
+};
+
+}
+
+LazyImage::LazyImage(const Image& im) :
+    node { std::make_shared<ImageNode>(&im, &im.image_data) } {}
+
+ssize_t
+LazyImage::width() const
+{
+    return node->width();
+}
+
+ssize_t
+LazyImage::height() const
+{
+    return node->height();
+}
+
+ColorSpace
+LazyImage::colorSpace() const
+{
+    return node->colorSpace();
+}
+
+Image
+LazyImage::eval() const
+{
+    node->check();
+
+    Image result(width(), height(), colorSpace(), BUFFER_UNINITIALIZED);
+    ssize_t w = result.width();
+
+    for (auto it = result.image_data.channels().begin(); it != result.image_data.channels().end(); ++it)
+        parallel_for(0, result.height(), rows_per_task(w, node->cost), [&](ssize_t j0, ssize_t j1) {
+            std::vector<float> scratch(node->depth * w);
+            for (ssize_t j = j0; j < j1; j++)
+                node->row(*it, j, w, result.image_data.row(*it, j), scratch.data());
+        });
+
+    return result;
+}
+
+void
+LazyImage::eval(Image& dst) const
+{
+    node->check();
+
+    if (colorSpace() != dst.colorSpace() || width() != dst.width() || height() != dst.height()) {
+        dst = eval();
+        return;
+    }
+
+    // Unlike ImageExpr, nodes write rows before they have read all of their operands, so every row is
+    //     computed into a separate buffer before it is copied into dst.
+    ssize_t w = dst.width();
+    for (auto it = dst.image_data.channels().begin(); it != dst.image_data.channels().end(); ++it)
+        parallel_for(0, dst.height(), rows_per_task(w, node->cost), [&](ssize_t j0, ssize_t j1) {
+            std::vector<float> scratch((node->depth + 1) * w);
+            for (ssize_t j = j0; j < j1; j++) {
+                node->row(*it, j, w, scratch.data(), scratch.data() + w);
+                std::copy(scratch.data(), scratch.data() + w, dst.image_data.row(*it, j));
+            }
+        });
+}
+
+std::string
+LazyImage::str() const
+{
+    std::stringstream os;
+    os << "LazyImage @ " << (const void *) (this) <<
+        " { Width: " << std::to_string(width()) <<
+        ", Height: " << std::to_string(height()) <<
+        ", Color space: " << ::str(colorSpace()) << "}";
+    return os.str();
+}
+
+LazyImage
+operator+(const LazyImage& e1,
+          const LazyImage& e2)
+{
+    return LazyImage(std::make_shared<BinaryNode<AddOp>>(e1.node, e2.node));
+}
+
+LazyImage
+operator*(const LazyImage& e1,
+          const LazyImage& e2)
+{
+    return LazyImage(std::make_shared<BinaryNode<MulOp>>(e1.node, e2.node));
+}
+
+LazyImage
+operator+(const LazyImage& e,
+          float x)
+{
+    return LazyImage(std::make_shared<ScalarNode<AddOp>>(e.node, x));
+}
+
+LazyImage
+operator*(const LazyImage& e,
+          float x)
+{
+    return LazyImage(std::make_shared<ScalarNode<MulOp>>(e.node, x));
+}
+
+LazyImage
+pow(const LazyImage& e,
+    float p)
+{
+    return LazyImage(std::make_shared<ScalarNode<PowOp>>(e.node, p));
+}
+
+LazyImage
+sqrt(const LazyImage& e)
+{
+    return LazyImage(std::make_shared<UnaryNode<SqrtOp>>(e.node));
+}
+
+LazyImage
+atan2(const LazyImage& e1,
+      const LazyImage& e2)
+{
+    return LazyImage(std::make_shared<BinaryNode<Atan2Op>>(e1.node, e2.node));
+}
@@ -0,0 +1,90 @@
+#ifndef __LAZY_IMAGE_H_
+#define __LAZY_IMAGE_H_
+
+#include <memory>
+#include <cstdlib>
+#include "Image.hpp"
+
+// An elementwise expression of images built at run time, for the Python module where the expressions of
+//     ImageExpr.hpp cannot be composed. Its semantics are the same: operations only record the expression,
+//     and the images it refers to are read when it is evaluated by eval(), which computes the result in
+//     a single pass without creating intermediate images.
+// Expressions are immutable and share their subexpressions. Images are held by reference, so they must
+//     outlive every expression which refers to them.
+class LazyImage {
+    public:
+        class Node;
+
+    private:
+        std::shared_ptr<const Node> node;
+
+        LazyImage(std::shared_ptr<const Node> _node) :
+            node { std::move(_node) } {}
+
+    public:
+        // the expression whose value is im.
+        LazyImage(const Image& im);
+
+        ssize_t width() const;
+        ssize_t height() const;
+        ColorSpace colorSpace() const;
+
+        Image eval() const;
+        // Evaluates the expression into dst, in place if dst has its dimensions and colour space,
+        //     in which case dst may be one of the images the expression refers to.
+        void eval(Image& dst) const;
+
+        std::string str() const;
+
+        // elementwise arithmetic operations, as for images.
+        friend LazyImage operator+(const LazyImage& e1,
+                                   const LazyImage& e2);
+        friend LazyImage operator*(const LazyImage& e1,
+                                   const LazyImage& e2);
+        friend LazyImage operator+(const LazyImage& e,
+                                   float x);
+        friend LazyImage operator*(const LazyImage& e,
+                                   float x);
+        friend LazyImage pow(const LazyImage& e,
+                             float p);
+        friend LazyImage sqrt(const LazyImage& e);
+        friend LazyImage atan2(const LazyImage& e1,
+                               const LazyImage& e2);
+};
+
+// like the operators of ImageExpr.hpp, these only return an expression, so the compiler warns if it is not used.
+__attribute__((warn_unused_result))
+LazyImage
+operator+(const LazyImage& e1,
+          const LazyImage& e2);
+
+__attribute__((warn_unused_result))
+LazyImage
+operator*(const LazyImage& e1,
+          const LazyImage& e2);
+
+__attribute__((warn_unused_result))
+LazyImage
+operator+(const LazyImage& e,
+          float x);
+
+__attribute__((warn_unused_result))
+LazyImage
+operator*(const LazyImage& e,
+          float x);
+
+__attribute__((warn_unused_result))
+LazyImage
+pow(const LazyImage& e,
+    float p);
+
+__attribute__((warn_unused_result))
+LazyImage
+sqrt(const LazyImage& e);
+
+__attribute__((warn_unused_result))
+LazyImage
+atan2(const LazyImage& e1,
+      const LazyImage& e2);
+
+#endif // __LAZY_IMAGE_H_
@@ -0,0 +1,304 @@
+#include "PackedImage.hpp"
+
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include "JPEG.hpp"
+#include "ThreadPool.hpp"
+
+// the number of rows decoded or encoded at a time by readJPEG and writeJPEG.
+#define PACKED_BAND_ROWS 64
+
+size_t
+sample_size(SampleType type)
+{
+    switch (type) {
+        case SAMPLE_U8: return 1;
+        case SAMPLE_U16: return 2;
+        case SAMPLE_F16: return 2;
+        case SAMPLE_F32: return 4;
+    }
+    throw std::invalid_argument("Unknown sample type.");
+}
+
+static
+std::string
+str(SampleType type)
+{
+    switch (type) {
+        case SAMPLE_U8: return "U8";
+        case SAMPLE_U16: return "U16";
+        case SAMPLE_F16: return "F16";
+        case SAMPLE_F32: return "F32";
+    }
+    return "?";
+}
+
+// Conversions between floats and half precision floats, rounding to the nearest half, ties to even.
+// Finite floats which are too large become infinite, and NaNs stay NaNs.
+static inline
+uint16_t
+float_to_half(float f)
+{
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000;
+    x &= 0x7fffffff;
+
+    // floats of at least 2^16 are infinite or NaN as halves.
+    if (x >= (uint32_t) (127 + 16) << 23)
+        return sign | (x > 0x7f800000 ? 0x7e00 : 0x7c00);
+
+    // Below 2^-14, halves are subnormal: adding 0.5 shifts the float's mantissa so that its low bits are those
+    //      of the half, leaving the rounding to the addition.
+    if (x < (uint32_t) 113 << 23) {
+        float y;
+        memcpy(&y, &x, sizeof(y));
+        y += 0.5f;
+        memcpy(&x, &y, sizeof(x));
+        return sign | (uint16_t) (x - 0x3f000000);
+    }
+
+    // rebias the exponent, and round the 13 bits shifted out of the mantissa; a carry increments the exponent.
+    uint32_t odd = (x >> 13) & 1;
+    x += ((uint32_t) (15 - 127) << 23) + 0xfff + odd;
+    return sign | (uint16_t) (x >> 13);
+}
+
+static inline
+float
+half_to_float(uint16_t h)
+{
+    uint32_t x = (uint32_t) (h & 0x7fff) << 13;
+    uint32_t exponent = x & (0x7c00 << 13);
+    x += (uint32_t) (127 - 15) << 23;
+
+    float f;
+    if (exponent == 0x7c00 << 13) {
+        // infinities and NaNs
+        x += (uint32_t) (128 - 16) << 23;
+        memcpy(&f, &x, sizeof(f));
+    } else if (exponent == 0) {
+        // zeros and subnormals, which are renormalized by subtracting the implicit bit.
+        x += 1 << 23;
+        memcpy(&f, &x, sizeof(f));
+        f -= 6.103515625e-05f;
+    } else
+        memcpy(&f, &x, sizeof(f));
+
+    return (h & 0x8000) ? -f : f;
+}
+
+// packs the w pixels at in into samples of the given type at out, saturating them to the range of the type.
+static
+void
+pack_row(const float *in,
+         unsigned char *out,
+         SampleType type,
+         ssize_t w)
+{
+    switch (type) {
+        case SAMPLE_U8:
+            for (ssize_t i = 0; i < w; i++)
+                out[i] = (unsigned char) std::max(0.0f, std::min(255.0f, in[i] + 0.5f));
+            break;
+        case SAMPLE_U16: {
+            uint16_t *out16 = reinterpret_cast<uint16_t *>(out);
+            for (ssize_t i = 0; i < w; i++)
+                out16[i] = (uint16_t) std::max(0.0f, std::min(65535.0f, in[i] * 257.0f + 0.5f));
+            break;
+        }
+        case SAMPLE_F16: {
+            uint16_t *out16 = reinterpret_cast<uint16_t *>(out);
+            for (ssize_t i = 0; i < w; i++)
+                out16[i] = float_to_half(in[i]);
+            break;
+        }
+        case SAMPLE_F32:
+            memcpy(out, in, w * sizeof(float));
+            break;
+    }
+}
+
+// unpacks the w samples of the given type at in into pixels at out.
+static
+void
+unpack_row(const unsigned char *in,
+           float *out,
+           SampleType type,
+           ssize_t w)
+{
+    switch (type) {
+        case SAMPLE_U8:
+            for (ssize_t i = 0; i < w; i++)
+                out[i] = in[i];
+            break;
+        case SAMPLE_U16: {
+            const uint16_t *in16 = reinterpret_cast<const uint16_t *>(in);
+            for (ssize_t i = 0; i < w; i++)
+                out[i] = in16[i] / 257.0f;
+            break;
+        }
+        case SAMPLE_F16: {
+            const uint16_t *in16 = reinterpret_cast<const uint16_t *>(in);
+            for (ssize_t i = 0; i < w; i++)
+                out[i] = half_to_float(in16[i]);
+            break;
+        }
+        case SAMPLE_F32:
+            memcpy(out, in, w * sizeof(float));
+            break;
+    }
+}
+
+PackedImage::PackedImage() :
+    w { 0 },
+    h { 0 },
+    c_space { RGB },
+    type { SAMPLE_U8 }
+{
+}
+
+PackedImage::PackedImage(ssize_t _w,
+                         ssize_t _h,
+                         ColorSpace _c_space,
+                         SampleType _type) :
+    w { _w },
+    h { _h },
+    c_space { _c_space },
+    type { _type },
+    chs { Image::channels(_c_space) }
+{
+    if (w < 0 || h < 0)
+        throw std::invalid_argument("Image dimensions must not be negative");
+
+    // planes are stored in the order of the ChannelType enumeration, as in a PlanarBuffer.
+    std::sort(chs.begin(), chs.end());
+    data.resize(plane_stride() * chs.size());
+}
+
+PackedImage::PackedImage(const Image& im,
+                         SampleType _type) :
+    PackedImage(im.width(), im.height(), im.colorSpace(), _type)
+{
+    pack(im.buffer(), 0, 0, 0, 0, w, h);
+}
+
+Image
+PackedImage::unpack() const
+{
+    Image im(w, h, c_space, BUFFER_UNINITIALIZED);
+    unpack(0, 0, w, h, im.buffer(), 0, 0);
+    return im;
+}
+
+void
+PackedImage::unpack(ssize_t x,
+                    ssize_t y,
+                    ssize_t _w,
+                    ssize_t _h,
+                    PlanarBuffer& dst,
+                    ssize_t dx,
+                    ssize_t dy) const
+{
+    ssize_t size = sample_size(type);
+    parallel_for(0, _h, rows_per_task(_w, 2), [&](ssize_t j0, ssize_t j1) {
+        for (size_t k = 0; k < chs.size(); k++) {
+            const unsigned char *plane = data.data() + plane_stride() * k;
+            for (ssize_t j = j0; j < j1; j++)
+                unpack_row(plane + row_stride() * (y + j) + size * x, dst.row(chs[k], dy + j) + dx, type, _w);
+        }
+    });
+}
+
+void
+PackedImage::pack(const PlanarBuffer& src,
+                  ssize_t sx,
+                  ssize_t sy,
+                  ssize_t x,
+                  ssize_t y,
+                  ssize_t _w,
+                  ssize_t _h)
+{
+    ssize_t size = sample_size(type);
+    parallel_for(0, _h, rows_per_task(_w, 2), [&](ssize_t j0, ssize_t j1) {
+        for (size_t k = 0; k < chs.size(); k++) {
+            unsigned char *plane = data.data() + plane_stride() * k;
+            for (ssize_t j = j0; j < j1; j++)
+                pack_row(src.row(chs[k], sy + j) + sx, plane + row_stride() * (y + j) + size * x, type, _w);
+        }
+    });
+}
+
+PackedImage
+PackedImage::readJPEG(const char *fname,
+                      SampleType _type,
+                      const JPEGReadOptions& options)
+{
+    if (options.raw)
+        throw std::invalid_argument("Packed images cannot be read raw from JPEGs.");
+
+    JPEGFileDecompressor decompressor(fname);
+    jpeg_read_header(&decompressor.cinfo, TRUE);
+    set_jpeg_read_options(&decompressor.cinfo, options);
+    jpeg_start_decompress(&decompressor.cinfo);
+    JPEGScanlineReader reader(&decompressor.cinfo);
+    ssize_t w = decompressor.cinfo.output_width, h = decompressor.cinfo.output_height;
+
+    // the image is allocated once the colour space of the converted rows is known.
+    PackedImage im;
+    auto store = [&](const Image& rows, ssize_t j, ssize_t n) {
+        if (im.chs.empty())
+            im = PackedImage(w, h, rows.colorSpace(), _type);
+        im.pack(rows.buffer(), 0, 0, 0, j, w, n);
+    };
+
+    Image band(w, std::min(h, (ssize_t) PACKED_BAND_ROWS), reader.color_space(), BUFFER_UNINITIALIZED);
+    for (ssize_t j = 0; j < h; j += band.height()) {
+        ssize_t n = std::min(band.height(), h - j);
+        reader.read(band.buffer(), 0, n);
+        if (options.convert) {
+            Image converted = band;
+            convert_decoded(converted, options);
+            store(converted, j, n);
+        } else
+            store(band, j, n);
+    }
+
+    jpeg_finish_decompress(&decompressor.cinfo);
+    return im;
+}
+
+void
+PackedImage::writeJPEG(const char *fname,
+                       const int quality) const
+{
+    JPEGFileCompressor compressor(fname);
+    JPEGScanlineWriter writer(&compressor.cinfo, w, h, c_space, quality);
+
+    Image band(w, std::min(h, (ssize_t) PACKED_BAND_ROWS), c_space, BUFFER_UNINITIALIZED);
+    for (ssize_t j = 0; j < h; j += band.height()) {
+        ssize_t n = std::min(band.height(), h - j);
+        unpack(0, j, w, n, band.buffer(), 0, 0);
+        writer.write(band.buffer(), 0, n);
+    }
+
+    jpeg_finish_compress(&compressor.cinfo);
+}
+
+std::string
+PackedImage::str() const
+{
+    std::stringstream os;
+    os << "PackedImage @ " << (const void *) (this) <<
+        " { Width: " << std::to_string(w) <<
+        ", Height: " << std::to_string(h) <<
+        ", Color space: " << ::str(c_space) <<
+        ", Sample type: " << ::str(type) << "}";
+    return os.str();
+}
+
+#undef PACKED_BAND_ROWS
@@ -0,0 +1,93 @@
+#ifndef __PACKED_IMAGE_H_
+#define __PACKED_IMAGE_H_
+
+#include <vector>
+#include <cstdlib>
+#include "Image.hpp"
+
+// the type in which a PackedImage stores each sample.
+// Samples are packed from and unpacked to the floats of an Image, in which computations are done; pixels outside
+//     the range of the type are saturated to it when packed, so images whose pixels may exceed [0, 255], e.g. the
+//     result of arithmetic, keep them only when packed as SAMPLE_F16 or SAMPLE_F32.
+typedef enum SampleType {
+SAMPLE_U8,  // 8 bit unsigned integers: pixels are rounded to integers in [0, 255]. JPEGs are decoded losslessly.
+SAMPLE_U16, // 16 bit unsigned integers holding pixels multiplied by 257, as 16 bit PNGs do: pixels are kept
+            //      in [0, 255], to the nearest 1 / 257.
+SAMPLE_F16, // IEEE half precision floats, with 11 significant bits: pixels in [128, 256) are kept to the nearest
+            //      1 / 8. Pixels beyond +-65504 become infinite.
+SAMPLE_F32, // single precision floats, as in an Image.
+} SampleType;
+
+// the size of a sample of type type, in bytes.
+size_t sample_size(SampleType type);
+
+// An image whose samples are stored in a compact type, taking 1 / 4 (SAMPLE_U8) or 1 / 2 (SAMPLE_U16, SAMPLE_F16)
+//     of the memory of an Image.
+// Images are unpacked to floats to be processed, either whole by unpack(), or a tile at a time by Pipeline::apply,
+//     which keeps the image packed in between.
+// Planes are stored one after the other, in the order of the ChannelType enumeration, with rows w samples long.
+class PackedImage {
+    std::vector<unsigned char> data;
+    ssize_t w, h;
+    ColorSpace c_space;
+    SampleType type;
+    std::vector<ChannelType> chs;
+
+    public:
+        PackedImage();
+        // a zero filled image.
+        PackedImage(ssize_t _w,
+                    ssize_t _h,
+                    ColorSpace _c_space,
+                    SampleType _type);
+        // packs the pixels of im.
+        PackedImage(const Image& im,
+                    SampleType _type);
+
+        ssize_t width() const { return w; }
+        ssize_t height() const { return h; }
+        ColorSpace colorSpace() const { return c_space; }
+        SampleType sampleType() const { return type; }
+        const std::vector<ChannelType>& channels() const { return chs; }
+
+        // the memory holding the samples: the plane of channels()[k] starts plane_stride() * k bytes from
+        //      samples(), and its rows are row_stride() bytes apart.
+        unsigned char *samples() { return data.data(); }
+        const unsigned char *samples() const { return data.data(); }
+        ssize_t row_stride() const { return w * sample_size(type); }
+        ssize_t plane_stride() const { return row_stride() * h; }
+        size_t bytes() const { return data.size(); }
+
+        // unpacks the image into an Image.
+        Image unpack() const;
+        // Unpacks the w x h rectangle of the image at (x, y) into dst at (dx, dy), resp. packs the rectangle of src
+        //      at (sx, sy) into the image at (x, y). The buffers must have the channels of the image.
+        void unpack(ssize_t x,
+                    ssize_t y,
+                    ssize_t _w,
+                    ssize_t _h,
+                    PlanarBuffer& dst,
+                    ssize_t dx,
+                    ssize_t dy) const;
+        void pack(const PlanarBuffer& src,
+                  ssize_t sx,
+                  ssize_t sy,
+                  ssize_t x,
+                  ssize_t y,
+                  ssize_t _w,
+                  ssize_t _h);
+
+        // Reads the JPEG with name fname as Image::readJPEG would, packing it a band of rows at a time, so that the
+        //      image is never held as floats. options are those of readJPEG, except that raw reads are not supported.
+        static PackedImage readJPEG(const char *fname,
+                                    SampleType _type=SAMPLE_U8,
+                                    const JPEGReadOptions& options=JPEGReadOptions());
+        // writes the image to the JPEG with name fname as Image::writeJPEG would, unpacking it a band of rows
+        //      at a time.
+        void writeJPEG(const char *fname,
+                       const int quality) const;
+
+        std::string str() const;
+};
+
+#endif // __PACKED_IMAGE_H_
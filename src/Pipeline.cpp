@@ -0,0 +1,446 @@
+#include "Pipeline.hpp"
+
+#include <cmath>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include "JPEG.hpp"
+#include "ThreadPool.hpp"
+#include "BoxFilter.hpp"
+#include "EdgeDetect.hpp"
+#include "Hysteresis.hpp"
+
+// the number of rows decoded at a time, and the most rows which a stage computes at a time.
+#define PIPELINE_BAND_ROWS 64
+// the most bytes which the input and output of a stage should take up for a tile, so that they stay in L2.
+#define PIPELINE_TILE_BYTES (512 * 1024)
+// the least width and height of a tile, without its border.
+#define PIPELINE_MIN_TILE_SIZE 64
+
+Pipeline&
+Pipeline::add_stage(ssize_t radius_x,
+                    ssize_t radius_y,
+                    std::function<void(Image&)> op,
+                    bool global)
+{
+    stages.push_back({ radius_x, radius_y, std::move(op), std::vector<Arithmetic>(), global });
+    return *this;
+}
+
+template <class Op>
+static inline
+void
+apply_to_row(float *row,
+             ssize_t w,
+             float x)
+{
+    Op op;
+    for (ssize_t i = 0; i < w; i++)
+        row[i] = op(row[i], x);
+}
+
+Pipeline&
+Pipeline::add_arithmetic(Arithmetic a)
+{
+    // Adjacent arithmetic is fused into one stage, which applies all of it to each row while the row is in cache.
+    if (stages.empty() || stages.back().arithmetic.empty())
+        add_stage(0, 0, nullptr);
+    Stage& stage = stages.back();
+    stage.arithmetic.push_back(a);
+
+    std::vector<Arithmetic> ops = stage.arithmetic;
+    ssize_t cost = 0;
+    for (auto it = ops.begin(); it != ops.end(); ++it)
+        cost += it->op == Arithmetic::POW ? PowOp::cost : AddOp::cost;
+
+    stage.op = [ops, cost](Image& im) {
+        ssize_t w = im.width();
+        const std::vector<ChannelType>& chs = im.image_data.channels();
+        parallel_for(0, im.height(), rows_per_task(w, cost), [&](ssize_t j0, ssize_t j1) {
+            for (auto ch = chs.begin(); ch != chs.end(); ++ch) {
+                for (ssize_t j = j0; j < j1; j++) {
+                    float *row = im.image_data.row(*ch, j);
+                    for (auto it = ops.begin(); it != ops.end(); ++it) {
+                        switch (it->op) {
+                            case Arithmetic::ADD:
+                                apply_to_row<AddOp>(row, w, it->x);
+                                break;
+                            case Arithmetic::MULTIPLY:
+                                apply_to_row<MulOp>(row, w, it->x);
+                                break;
+                            case Arithmetic::POW:
+                                apply_to_row<PowOp>(row, w, it->x);
+                                break;
+                        }
+                    }
+                }
+            }
+        });
+    };
+    return *this;
+}
+
+Pipeline&
+Pipeline::to_RGB(ColorPrecision precision)
+{
+    return add_stage(0, 0, [precision](Image& im) { im.to_RGB(precision); });
+}
+
+Pipeline&
+Pipeline::to_YCbCr(ColorPrecision precision)
+{
+    return add_stage(0, 0, [precision](Image& im) { im.to_YCbCr(precision); });
+}
+
+Pipeline&
+Pipeline::to_gray(ColorPrecision precision)
+{
+    return add_stage(0, 0, [precision](Image& im) { im.to_gray(precision); });
+}
+
+Pipeline&
+Pipeline::add(float y)
+{
+    return add_arithmetic({ Arithmetic::ADD, y });
+}
+
+Pipeline&
+Pipeline::multiply(float y)
+{
+    return add_arithmetic({ Arithmetic::MULTIPLY, y });
+}
+
+Pipeline&
+Pipeline::pow(float p)
+{
+    return add_arithmetic({ Arithmetic::POW, p });
+}
+
+Pipeline&
+Pipeline::convolve(const Kernel& kern)
+{
+    if (kern.size() % 2 == 0)
+        throw std::invalid_argument("Kernel height must be odd");
+
+    return add_stage(kern[0].size() / 2, kern.size() / 2, [kern](Image& im) { im.convolve(kern); });
+}
+
+Pipeline&
+Pipeline::gaussian_blur(float std_dev,
+                        ssize_t kern_size_f)
+{
+    if (kern_size_f < 0)
+        throw std::invalid_argument("Kernel size must not be negative");
+
+    return add_stage(kern_size_f, kern_size_f, [std_dev, kern_size_f](Image& im) {
+        im.gaussian_blur(std_dev, kern_size_f, BLUR_FIR);
+    });
+}
+
+Pipeline&
+Pipeline::box_blur(ssize_t kern_size_f)
+{
+    if (kern_size_f < 0)
+        throw std::invalid_argument("Kernel size must not be negative");
+
+    return add_stage(kern_size_f, kern_size_f, [kern_size_f](Image& im) { im.box_blur(kern_size_f); });
+}
+
+Pipeline&
+Pipeline::fast_gaussian_blur(float std_dev,
+                             size_t passes)
+{
+    if (passes == 0)
+        throw std::invalid_argument("At least one pass is needed");
+
+    std::vector<ssize_t> radii = box_radii_for_gaussian(std_dev, passes);
+    for (auto it = radii.begin(); it != radii.end(); ++it)
+        box_blur(*it);
+
+    return *this;
+}
+
+Pipeline&
+Pipeline::canny_edge_detect(float blur_std_dev,
+                            ssize_t blur_size_f,
+                            float upper_threshold,
+                            float lower_threshold,
+                            EdgeOperator edge_operator,
+                            ssize_t lookahead)
+{
+    if (lookahead < 0)
+        throw std::invalid_argument("Lookahead must not be negative");
+
+    to_gray();
+
+    // canny_edge_detect blurs with BLUR_AUTO, which only differs from BLUR_FIR for large standard deviations.
+    gaussian_blur(blur_std_dev, blur_size_f);
+
+    // the gradient reaches 2 rows away with EDGE_SOBEL_LARGE, and non-maximum suppression compares it with the
+    //      rows on either side.
+    add_stage(3, 3, [=](Image& im) {
+        PlanarBuffer edges(im.width(), im.height(), {INTENSITY});
+        canny_gradient(im.image_data.plane(INTENSITY), im.image_data.stride(),
+                       edges.plane(INTENSITY), edges.stride(),
+                       im.width(), im.height(), edge_operator,
+                       upper_threshold, lower_threshold, Image::get_max_intensity());
+        im.image_data.swap(edges);
+    });
+
+    return add_stage(lookahead, lookahead, [](Image& im) {
+        hysteresis(im.image_data.plane(INTENSITY), im.image_data.stride(),
+                   im.width(), im.height(), Image::get_max_intensity());
+    }, true);
+}
+
+// copies the w x h rectangle of src at (sx, sy) to the rectangle of dst at (dx, dy); dst has the same channels.
+// Rows may be moved within an image, as long as dy <= sy.
+static
+void
+copy_rect(const PlanarBuffer& src,
+          ssize_t sx,
+          ssize_t sy,
+          PlanarBuffer& dst,
+          ssize_t dx,
+          ssize_t dy,
+          ssize_t w,
+          ssize_t h)
+{
+    for (auto ch = src.channels().begin(); ch != src.channels().end(); ++ch) {
+        for (ssize_t r = 0; r < h; r++) {
+            const float *in = src.row(*ch, sy + r) + sx;
+            std::copy(in, in + w, dst.row(*ch, dy + r) + dx);
+        }
+    }
+}
+
+// copies the rows [s0, s0 + n) of src to the rows [d0, d0 + n) of dst, both w pixels wide.
+static
+void
+copy_rows(const PlanarBuffer& src,
+          ssize_t s0,
+          PlanarBuffer& dst,
+          ssize_t d0,
+          ssize_t n,
+          ssize_t w)
+{
+    copy_rect(src, 0, s0, dst, 0, d0, w, n);
+}
+
+void
+Pipeline::run(const char *in_fname,
+              const char *out_fname,
+              const int quality,
+              const JPEGReadOptions& options) const
+{
+    if (options.raw)
+        throw std::invalid_argument("Pipelines cannot read JPEGs raw.");
+
+    // Images which libjpeg cannot convert are converted by a first stage, as readJPEG converts them after decoding.
+    std::vector<Stage> all;
+    if (options.convert)
+        all.push_back({ 0, 0, [options](Image& im) { convert_decoded(im, options); }, std::vector<Arithmetic>(), false });
+    all.insert(all.end(), stages.begin(), stages.end());
+
+    JPEGFileDecompressor decompressor(in_fname);
+    jpeg_read_header(&decompressor.cinfo, TRUE);
+    set_jpeg_read_options(&decompressor.cinfo, options);
+    jpeg_start_decompress(&decompressor.cinfo);
+    JPEGScanlineReader reader(&decompressor.cinfo);
+    ssize_t w = decompressor.cinfo.output_width, h = decompressor.cinfo.output_height;
+
+    // the writer is set up once the colour space of the output is known, i.e. when the first rows reach it.
+    JPEGFileCompressor compressor(out_fname);
+    std::unique_ptr<JPEGScanlineWriter> writer;
+
+    // The input of each stage, of which rows [first, first + count) are held in rows, and rows from next on have
+    //      not been computed yet. Rows more than radius rows before next are no longer needed, so every stage
+    //      holds at most PIPELINE_BAND_ROWS rows more than its kernel.
+    struct Window {
+        Image rows;
+        ssize_t first, count, next;
+    };
+    std::vector<Window> windows(all.size(), Window{ Image(), 0, 0, 0 });
+
+    // passes the rows [r0, r0 + n) of band, which are the next n rows of the input of stage s, to the stage,
+    //      and then computes every row of its output which its input now determines, passing them on to the next.
+    std::function<void(size_t, const Image&, ssize_t, ssize_t)> push = [&](size_t s,
+                                                                           const Image& band,
+                                                                           ssize_t r0,
+                                                                           ssize_t n) {
+        if (s == all.size()) {
+            if (!writer)
+                writer.reset(new JPEGScanlineWriter(&compressor.cinfo, w, h, band.colorSpace(), quality));
+            writer->write(band.image_data, r0, n);
+            return;
+        }
+
+        const Stage& stage = all[s];
+        Window& win = windows[s];
+        ssize_t radius = stage.radius_y;
+        if (win.rows.width() == 0)
+            win.rows = Image(w, std::min(h, PIPELINE_BAND_ROWS + 2 * radius), band.colorSpace(), BUFFER_UNINITIALIZED);
+
+        ssize_t keep = std::max(win.first, win.next - radius);
+        copy_rows(win.rows.image_data, keep - win.first, win.rows.image_data, 0, win.first + win.count - keep, w);
+        win.count -= keep - win.first;
+        win.first = keep;
+        copy_rows(band.image_data, r0, win.rows.image_data, win.count, n, w);
+        win.count += n;
+
+        // rows within radius of the last row read may depend on rows which have not been read yet, unless
+        //      it is the last row of the image.
+        ssize_t end = win.first + win.count;
+        ssize_t ready = end == h ? h : end - radius;
+        while (win.next < ready) {
+            ssize_t j0 = win.next, j1 = std::min(ready, j0 + PIPELINE_BAND_ROWS);
+            ssize_t t0 = std::max((ssize_t) 0, j0 - radius), t1 = std::min(end, j1 + radius);
+
+            // As the operations leave a border of their radius black, the rows computed are those whose
+            //      neighbourhood lies inside the image, or which are on its border.
+            Image chunk(w, t1 - t0, win.rows.colorSpace(), BUFFER_UNINITIALIZED);
+            copy_rows(win.rows.image_data, t0 - win.first, chunk.image_data, 0, t1 - t0, w);
+            stage.op(chunk);
+
+            win.next = j1;
+            push(s + 1, chunk, j0 - t0, j1 - j0);
+        }
+    };
+
+    Image band(w, std::min(h, (ssize_t) PIPELINE_BAND_ROWS), reader.color_space(), BUFFER_UNINITIALIZED);
+    for (ssize_t j = 0; j < h; j += band.height()) {
+        ssize_t n = std::min(band.height(), h - j);
+        reader.read(band.image_data, 0, n);
+        push(0, band, 0, n);
+    }
+
+    jpeg_finish_decompress(&decompressor.cinfo);
+    jpeg_finish_compress(&compressor.cinfo);
+}
+
+void
+Pipeline::apply_tiles(ssize_t w,
+                      ssize_t h,
+                      ColorSpace c_space,
+                      size_t s0,
+                      size_t s1,
+                      const std::function<void(Image&, ssize_t, ssize_t)>& load,
+                      const std::function<void(const Image&, ssize_t, ssize_t,
+                                               ssize_t, ssize_t, ssize_t, ssize_t)>& store) const
+{
+    // Every stage is exact at the pixels whose neighbourhood lies inside its input, as the operations leave a border
+    //      of their radius black, so the output of a tile is exact if it is read with borders of the sums of the
+    //      horizontal and vertical radii, e.g. a 1 x 41 kernel only needs columns on either side.
+    ssize_t border_x = 0, border_y = 0;
+    for (size_t s = s0; s < s1; s++) {
+        border_x += stages[s].radius_x;
+        border_y += stages[s].radius_y;
+    }
+
+    // Tiles are square, and the image is split into tiles of about equal size.
+    ssize_t n_chs = Image::channels(c_space).size();
+    ssize_t side = (ssize_t) std::sqrt(PIPELINE_TILE_BYTES / (2.0 * n_chs * sizeof(float))) - border_x - border_y;
+    side = std::max(side, (ssize_t) PIPELINE_MIN_TILE_SIZE);
+    ssize_t nx = std::max((ssize_t) 1, (w + side - 1) / side), ny = std::max((ssize_t) 1, (h + side - 1) / side);
+
+    parallel_for(0, nx * ny, 1, [&](ssize_t t0, ssize_t t1) {
+        for (ssize_t t = t0; t < t1; t++) {
+            ssize_t tx = t % nx, ty = t / nx;
+            ssize_t i0 = w * tx / nx, i1 = w * (tx + 1) / nx;
+            ssize_t j0 = h * ty / ny, j1 = h * (ty + 1) / ny;
+            ssize_t x0 = std::max((ssize_t) 0, i0 - border_x), x1 = std::min(w, i1 + border_x);
+            ssize_t y0 = std::max((ssize_t) 0, j0 - border_y), y1 = std::min(h, j1 + border_y);
+
+            Image tile(x1 - x0, y1 - y0, c_space, BUFFER_UNINITIALIZED);
+            load(tile, x0, y0);
+            for (size_t s = s0; s < s1; s++)
+                stages[s].op(tile);
+            store(tile, i0 - x0, j0 - y0, i0, j0, i1 - i0, j1 - j0);
+        }
+    });
+}
+
+size_t
+Pipeline::segment_end(size_t s0) const
+{
+    if (stages[s0].global)
+        return s0 + 1;
+
+    size_t s1 = s0;
+    while (s1 < stages.size() && !stages[s1].global)
+        s1++;
+    return s1;
+}
+
+bool
+Pipeline::has_global_stage() const
+{
+    for (auto it = stages.begin(); it != stages.end(); ++it)
+        if (it->global)
+            return true;
+    return false;
+}
+
+Image
+Pipeline::apply(const Image& im) const
+{
+    Image result = im;
+    for (size_t s0 = 0, s1; s0 < stages.size(); s0 = s1) {
+        s1 = segment_end(s0);
+        if (stages[s0].global) {
+            stages[s0].op(result);
+            continue;
+        }
+
+        // the output is allocated by the first tile to finish, which knows its colour space.
+        Image out;
+        std::once_flag allocated;
+        apply_tiles(result.width(), result.height(), result.colorSpace(), s0, s1,
+                    [&](Image& tile, ssize_t x, ssize_t y) {
+                        copy_rect(result.image_data, x, y, tile.image_data, 0, 0, tile.width(), tile.height());
+                    },
+                    [&](const Image& tile, ssize_t sx, ssize_t sy, ssize_t x, ssize_t y, ssize_t tw, ssize_t th) {
+                        std::call_once(allocated, [&] {
+                            out = Image(result.width(), result.height(), tile.colorSpace(), BUFFER_UNINITIALIZED);
+                        });
+                        copy_rect(tile.image_data, sx, sy, out.image_data, x, y, tw, th);
+                    });
+        result = std::move(out);
+    }
+    return result;
+}
+
+PackedImage
+Pipeline::apply(const PackedImage& im) const
+{
+    PackedImage result = im;
+    for (size_t s0 = 0, s1; s0 < stages.size(); s0 = s1) {
+        s1 = segment_end(s0);
+        if (stages[s0].global) {
+            Image whole = result.unpack();
+            stages[s0].op(whole);
+            result = PackedImage(whole, im.sampleType());
+            continue;
+        }
+
+        PackedImage out;
+        std::once_flag allocated;
+        apply_tiles(result.width(), result.height(), result.colorSpace(), s0, s1,
+                    [&](Image& tile, ssize_t x, ssize_t y) {
+                        result.unpack(x, y, tile.width(), tile.height(), tile.image_data, 0, 0);
+                    },
+                    [&](const Image& tile, ssize_t sx, ssize_t sy, ssize_t x, ssize_t y, ssize_t tw, ssize_t th) {
+                        std::call_once(allocated, [&] {
+                            out = PackedImage(result.width(), result.height(), tile.colorSpace(), im.sampleType());
+                        });
+                        out.pack(tile.image_data, sx, sy, x, y, tw, th);
+                    });
+        result = std::move(out);
+    }
+    return result;
+}
+
+#undef PIPELINE_BAND_ROWS
+#undef PIPELINE_TILE_BYTES
+#undef PIPELINE_MIN_TILE_SIZE
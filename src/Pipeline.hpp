@@ -0,0 +1,114 @@
+#ifndef __PIPELINE_H_
+#define __PIPELINE_H_
+
+#include <vector>
+#include <cstdlib>
+#include <functional>
+#include "Image.hpp"
+#include "PackedImage.hpp"
+
+// A sequence of image operations, which can be applied in two ways, both of which compute every stage of a part of the
+//     image before moving on to the next part, rather than passing the whole image through memory once per stage:
+//  * run() applies them to a JPEG as it is decoded, a band of rows at a time, writing each output row to the output
+//    JPEG as soon as it is computed. Only the rows which the operations still need are kept, so memory is
+//    proportional to the width of the image times the height of the kernels, rather than to the size of the image,
+//    and JPEGs too large to be read into an Image can be processed.
+//  * apply() applies them to an Image, tile by tile, each tile being small enough for its stages to stay in cache.
+//    Tiles are read with borders as wide as the sums of the horizontal and vertical radii of the kernels, so that their
+//    output does not depend on their neighbours, and are processed in parallel.
+// Adjacent arithmetic operations are fused into a single pass over each row.
+// Operations have the same semantics as the methods of Image with the same names, and the result is the same as
+//     applying them to the whole image, except where noted. Filters which are computed in a different order, i.e.
+//     FFT convolutions and box blurs, may differ in the last bits when applied tile by tile.
+// Operations return the pipeline, so they can be chained, e.g.
+//     Pipeline().to_gray().gaussian_blur(1.4f, 2).run("in.jpeg", "out.jpeg");
+class Pipeline {
+    // an elementwise arithmetic operation, x + y, x * y or x ^ y of each pixel x.
+    struct Arithmetic {
+        enum { ADD, MULTIPLY, POW } op;
+        float x;
+    };
+
+    // An operation, which computes each pixel of its output from the pixels of its input up to radius_x columns and
+    //      radius_y rows away. run() only needs radius_y, as it passes whole rows to the stages.
+    struct Stage {
+        ssize_t radius_x, radius_y;
+        std::function<void(Image&)> op;
+        // the operations of a stage of elementwise arithmetic, which are applied in order; empty for other stages.
+        std::vector<Arithmetic> arithmetic;
+        // true if the stage depends on the whole image, in which case apply() applies it to the whole image,
+        //      while run() only looks radius_y rows away.
+        bool global;
+    };
+
+    std::vector<Stage> stages;
+
+    Pipeline& add_stage(ssize_t radius_x,
+                        ssize_t radius_y,
+                        std::function<void(Image&)> op,
+                        bool global=false);
+    Pipeline& add_arithmetic(Arithmetic a);
+
+    // Applies stages [s0, s1), none of which are global, tile by tile to a w x h image in c_space.
+    // load(tile, x, y) fills tile with the pixels of the image from (x, y) on, and store(tile, sx, sy, x, y, tw, th)
+    //      stores the tw x th pixels of tile at (sx, sy), which it has computed, as the pixels of the output at (x, y).
+    void apply_tiles(ssize_t w,
+                     ssize_t h,
+                     ColorSpace c_space,
+                     size_t s0,
+                     size_t s1,
+                     const std::function<void(Image&, ssize_t, ssize_t)>& load,
+                     const std::function<void(const Image&, ssize_t, ssize_t,
+                                              ssize_t, ssize_t, ssize_t, ssize_t)>& store) const;
+    // the end of the stages which apply() applies together from stage s0 on: the global stage s0 alone,
+    //      or the stages up to the next global stage.
+    size_t segment_end(size_t s0) const;
+
+    public:
+        Pipeline& to_RGB(ColorPrecision precision=COLOR_FLOAT);
+        Pipeline& to_YCbCr(ColorPrecision precision=COLOR_FLOAT);
+        Pipeline& to_gray(ColorPrecision precision=COLOR_FLOAT);
+
+        // elementwise arithmetic, as for images: every pixel x of every channel becomes x + y, x * y, resp. x ^ p.
+        Pipeline& add(float y);
+        Pipeline& multiply(float y);
+        Pipeline& pow(float p);
+
+        Pipeline& convolve(const Kernel& kern);
+        // Always applies the kernel, i.e. as gaussian_blur with BLUR_FIR, since the recursive filter
+        //      depends on every row of the image.
+        Pipeline& gaussian_blur(float std_dev,
+                                ssize_t kern_size_f);
+        Pipeline& box_blur(ssize_t kern_size_f);
+        Pipeline& fast_gaussian_blur(float std_dev,
+                                     size_t passes=3);
+        // With run(), the hysteresis only follows edges within lookahead rows of each row, so that weak pixels which
+        //      canny_edge_detect joins to a strong pixel through a longer path may be blacked out.
+        // apply() follows edges over the whole image, as canny_edge_detect does.
+        Pipeline& canny_edge_detect(float blur_std_dev=1.4f,
+                                    ssize_t blur_size_f=2,
+                                    float upper_threshold=76.8f,
+                                    float lower_threshold=25.6f,
+                                    EdgeOperator edge_operator=EDGE_SOBEL,
+                                    ssize_t lookahead=64);
+
+        // true if an operation depends on the whole image, i.e. the hysteresis of canny_edge_detect, which run() only
+        //      follows within its lookahead, so that run() may give a different image from apply().
+        bool has_global_stage() const;
+
+        // Applies the operations to the JPEG with name in_fname, writing the result to the JPEG with name out_fname.
+        // options are those of readJPEG, except that raw reads are not supported.
+        void run(const char *in_fname,
+                 const char *out_fname,
+                 const int quality=100,
+                 const JPEGReadOptions& options=JPEGReadOptions()) const;
+
+        // Applies the operations to im, returning the result.
+        Image apply(const Image& im) const;
+        // Applies the operations to im, unpacking it to floats a tile at a time, and packing the result into an image
+        //      of the same sample type, so that neither is ever held as floats. Global stages, i.e. the hysteresis of
+        //      canny_edge_detect, are applied to the whole image unpacked.
+        PackedImage apply(const PackedImage& im) const;
+};
+
+#endif // __PIPELINE_H_
@@ -0,0 +1,228 @@
+#include "PlanarBuffer.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include "PlanePool.hpp"
+
+#define FLOATS_PER_LINE (PLANE_ALIGNMENT / sizeof(float))
+
+static
+float *
+allocate_planes(size_t n)
+{
+    return static_cast<float *>(plane_pool_allocate(n * sizeof(float)));
+}
+
+PlanarBuffer::PlanarBuffer() :
+    data { nullptr },
+    w { 0 },
+    h { 0 },
+    row_stride { 0 },
+    plane_size { 0 },
+    allocated { 0 }
+{
+    offsets.fill(-1);
+}
+
+PlanarBuffer::PlanarBuffer(ssize_t _w,
+                           ssize_t _h,
+                           const std::vector<ChannelType>& _chs,
+                           BufferInit init) :
+    data { nullptr },
+    w { _w },
+    h { _h },
+    row_stride { (ssize_t) ((_w + FLOATS_PER_LINE - 1) / FLOATS_PER_LINE * FLOATS_PER_LINE) },
+    plane_size { (size_t) (row_stride * _h) },
+    allocated { 0 },
+    chs { _chs }
+{
+    if (w < 0 || h < 0)
+        throw std::invalid_argument("Image dimensions must not be negative");
+
+    std::sort(chs.begin(), chs.end());
+    chs.erase(std::unique(chs.begin(), chs.end()), chs.end());
+
+    offsets.fill(-1);
+    for (size_t k = 0; k < chs.size(); k++)
+        offsets[chs[k]] = plane_size * k;
+
+    allocated = plane_size * chs.size();
+    data = allocate_planes(allocated);
+    if (!data)
+        return;
+
+    if (init == BUFFER_ZERO) {
+        memset(data, 0, allocated * sizeof(float));
+        return;
+    }
+    for (size_t r = 0; r < chs.size() * h; r++)
+        memset(data + row_stride * r + w, 0, (row_stride - w) * sizeof(float));
+}
+
+PlanarBuffer::PlanarBuffer(float *_data,
+                           ssize_t _w,
+                           ssize_t _h,
+                           ssize_t _row_stride,
+                           ssize_t _plane_stride,
+                           const std::vector<ChannelType>& _chs,
+                           std::shared_ptr<void> _owner) :
+    data { _data },
+    w { _w },
+    h { _h },
+    row_stride { _row_stride },
+    plane_size { (size_t) _plane_stride },
+    allocated { 0 },
+    owner { std::move(_owner) },
+    chs { _chs }
+{
+    if (w < 0 || h < 0)
+        throw std::invalid_argument("Image dimensions must not be negative");
+    if (row_stride < w || (chs.size() > 1 && _plane_stride < row_stride * h))
+        throw std::invalid_argument("Rows and planes must not overlap");
+    if (!std::is_sorted(chs.begin(), chs.end()) ||
+        std::adjacent_find(chs.begin(), chs.end()) != chs.end())
+        throw std::invalid_argument("Channels must be distinct, and given in order");
+    // a null owner would mark data as owned by the buffer.
+    if (!owner)
+        owner = std::shared_ptr<void>(data, [](void *) {});
+
+    offsets.fill(-1);
+    for (size_t k = 0; k < chs.size(); k++)
+        offsets[chs[k]] = plane_size * k;
+}
+
+PlanarBuffer::PlanarBuffer(const PlanarBuffer& buf) :
+    data { nullptr },
+    w { buf.w },
+    h { buf.h },
+    row_stride { buf.row_stride },
+    plane_size { buf.plane_size },
+    allocated { 0 },
+    chs { buf.chs },
+    offsets (buf.offsets)
+{
+    if (!buf.owner) {
+        allocated = plane_size * chs.size();
+        data = allocate_planes(allocated);
+        if (data)
+            memcpy(data, buf.data, allocated * sizeof(float));
+        return;
+    }
+
+    PlanarBuffer copy(w, h, chs, BUFFER_UNINITIALIZED);
+    for (auto it = chs.begin(); it != chs.end(); ++it)
+        copy.copy_plane(buf, *it);
+    swap(copy);
+}
+
+PlanarBuffer::PlanarBuffer(PlanarBuffer&& buf) :
+    PlanarBuffer()
+{
+    swap(buf);
+}
+
+PlanarBuffer&
+PlanarBuffer::operator=(PlanarBuffer buf)
+{
+    swap(buf);
+    return *this;
+}
+
+PlanarBuffer::~PlanarBuffer()
+{
+    if (!owner)
+        plane_pool_free(data, allocated * sizeof(float));
+}
+
+void
+PlanarBuffer::swap(PlanarBuffer& buf)
+{
+    std::swap(data, buf.data);
+    std::swap(w, buf.w);
+    std::swap(h, buf.h);
+    std::swap(row_stride, buf.row_stride);
+    std::swap(plane_size, buf.plane_size);
+    std::swap(allocated, buf.allocated);
+    std::swap(owner, buf.owner);
+    std::swap(chs, buf.chs);
+    std::swap(offsets, buf.offsets);
+}
+
+std::shared_ptr<void>
+PlanarBuffer::share()
+{
+    if (owner)
+        return owner;
+
+    struct FreeToPool {
+        size_t bytes;
+        void operator()(float *p) const { plane_pool_free(p, bytes); }
+    };
+    // if the handle cannot be allocated, the memory stays with the buffer.
+    std::unique_ptr<float, FreeToPool> block(data, FreeToPool { allocated * sizeof(float) });
+    try {
+        owner = std::shared_ptr<float>(std::move(block));
+    } catch (...) {
+        block.release();
+        throw;
+    }
+    allocated = 0;
+    return owner;
+}
+
+void
+PlanarBuffer::copy_plane(const PlanarBuffer& buf,
+                         ChannelType ch)
+{
+    if (buf.w != w || buf.h != h)
+        throw std::invalid_argument("Buffers must have the same dimensions");
+
+    for (ssize_t j = 0; j < h; j++)
+        memcpy(row(ch, j), buf.row(ch, j), w * sizeof(float));
+}
+
+PlanarBuffer
+PlanarBuffer::select(const std::vector<ChannelType>& _chs) const
+{
+    PlanarBuffer n_buf(w, h, _chs, BUFFER_UNINITIALIZED);
+    for (auto it = n_buf.chs.begin(); it != n_buf.chs.end(); ++it) {
+        if (owner)
+            n_buf.copy_plane(*this, *it);
+        else
+            memcpy(n_buf.plane(*it), plane(*it), plane_size * sizeof(float));
+    }
+    return n_buf;
+}
+
+void
+PlanarBuffer::keep(const std::vector<ChannelType>& _chs)
+{
+    std::vector<ChannelType> n_chs(_chs);
+    std::sort(n_chs.begin(), n_chs.end());
+    n_chs.erase(std::unique(n_chs.begin(), n_chs.end()), n_chs.end());
+
+    for (auto it = n_chs.begin(); it != n_chs.end(); ++it)
+        if (offsets[*it] < 0)
+            throw std::invalid_argument("Buffer has no " + str(*it) + " channel.");
+
+    if (owner) {
+        PlanarBuffer n_buf = select(n_chs);
+        swap(n_buf);
+        return;
+    }
+
+    // planes only ever move towards the front, so moving them in order never overwrites a plane still to be moved.
+    std::array<ssize_t, CHANNEL_TYPE_COUNT> n_offsets;
+    n_offsets.fill(-1);
+    for (size_t k = 0; k < n_chs.size(); k++) {
+        n_offsets[n_chs[k]] = plane_size * k;
+        if (n_offsets[n_chs[k]] != offsets[n_chs[k]])
+            memmove(data + n_offsets[n_chs[k]], data + offsets[n_chs[k]], plane_size * sizeof(float));
+    }
+
+    chs.swap(n_chs);
+    offsets = n_offsets;
+}
+
+#undef FLOATS_PER_LINE
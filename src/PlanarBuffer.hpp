@@ -0,0 +1,113 @@
+#ifndef __PLANAR_BUFFER_H_
+#define __PLANAR_BUFFER_H_
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <cstdlib>
+#include "Channel.hpp"
+
+// alignment of the start of every plane and every row, in bytes.
+#define PLANE_ALIGNMENT 64
+
+// whether the pixels of a new buffer are zero filled, or left uninitialized for callers which write every pixel.
+// The padding of the rows is zero filled either way.
+typedef enum BufferInit {
+BUFFER_ZERO,
+BUFFER_UNINITIALIZED,
+} BufferInit;
+
+// Storage for the channels of an image.
+// All channels live in a single PLANE_ALIGNMENT aligned allocation, one plane after the other, in the order of
+//     the ChannelType enumeration. Within a plane, pixel (i, j) is at row(ch, j)[i].
+// Rows are padded to a multiple of PLANE_ALIGNMENT bytes, so every row starts on a cache line;
+//     the padding is zero filled, and is not part of the image.
+// The set of channels is fixed when the buffer is created.
+// Memory is allocated from the PlanePool, so that temporaries reuse the memory of those freed before them.
+// A buffer may also wrap planes held in memory it does not own, such as a NumPy array, whose rows and planes may be
+//     any distance apart; rows then need not be aligned, and their padding may hold anything.
+class PlanarBuffer {
+    float *data;
+    ssize_t w, h;
+    // distance between the starts of two consecutive rows, in floats.
+    ssize_t row_stride;
+    // distance between the starts of two consecutive planes, in floats.
+    size_t plane_size;
+    // the number of floats allocated at data, which is 0 for a wrapping buffer.
+    size_t allocated;
+    // keeps the memory of a wrapping buffer alive, or null if the buffer owns data.
+    std::shared_ptr<void> owner;
+    std::vector<ChannelType> chs;
+    // offset of each channel's plane from data, or -1 if the channel is not present.
+    std::array<ssize_t, CHANNEL_TYPE_COUNT> offsets;
+
+    ssize_t offset(ChannelType ch) const {
+        if (offsets[ch] < 0)
+            throw std::out_of_range("Image has no " + str(ch) + " channel.");
+        return offsets[ch];
+    }
+
+    public:
+        PlanarBuffer();
+        // creates a buffer having the given channels, which may be given in any order.
+        PlanarBuffer(ssize_t _w,
+                     ssize_t _h,
+                     const std::vector<ChannelType>& _chs,
+                     BufferInit init=BUFFER_ZERO);
+
+        // Wraps the w x h planes at data, which the buffer neither copies nor frees: the plane of _chs[k] starts at
+        //      data + _plane_stride * k, and its rows are _row_stride floats apart. _chs must be given in the order of
+        //      the ChannelType enumeration. The buffer holds _owner for as long as it refers to the memory.
+        PlanarBuffer(float *_data,
+                     ssize_t _w,
+                     ssize_t _h,
+                     ssize_t _row_stride,
+                     ssize_t _plane_stride,
+                     const std::vector<ChannelType>& _chs,
+                     std::shared_ptr<void> _owner);
+
+        // copies own their memory, with the layout of a new buffer, even if buf wraps memory it does not own.
+        PlanarBuffer(const PlanarBuffer& buf);
+        PlanarBuffer(PlanarBuffer&& buf);
+        PlanarBuffer& operator=(PlanarBuffer buf);
+        ~PlanarBuffer();
+
+        void swap(PlanarBuffer& buf);
+
+        ssize_t width() const { return w; }
+        ssize_t height() const { return h; }
+        ssize_t stride() const { return row_stride; }
+        // distance between the starts of the planes of two consecutive channels, in floats.
+        ssize_t plane_stride() const { return plane_size; }
+        // true if the buffer wraps memory which it does not own.
+        bool wraps() const { return (bool) owner; }
+        // Returns a handle on the memory of the buffer, which stays valid for as long as the handle is held, even once
+        //      the buffer no longer refers to it. A buffer owning its memory hands it to the handle, which frees it to
+        //      the PlanePool, and from then on wraps it, with the same layout.
+        std::shared_ptr<void> share();
+
+        // the channels held by the buffer, in the order of the ChannelType enumeration.
+        const std::vector<ChannelType>& channels() const { return chs; }
+        size_t size() const { return chs.size(); }
+        size_t count(ChannelType ch) const { return offsets[ch] < 0 ? 0 : 1; }
+
+        // direct access to a plane or a row. These throw std::out_of_range if the channel is not present.
+        float *plane(ChannelType ch) { return data + offset(ch); }
+        const float *plane(ChannelType ch) const { return data + offset(ch); }
+        float *row(ChannelType ch, ssize_t j) { return plane(ch) + row_stride * j; }
+        const float *row(ChannelType ch, ssize_t j) const { return plane(ch) + row_stride * j; }
+
+        // copies the plane of channel ch in buf into the plane of channel ch in this buffer.
+        // Both buffers must have the same dimensions.
+        void copy_plane(const PlanarBuffer& buf,
+                        ChannelType ch);
+        // returns a buffer holding only the given channels of this buffer.
+        PlanarBuffer select(const std::vector<ChannelType>& _chs) const;
+        // removes every channel except the given ones, which must all be present. Rather than copying the
+        //     buffer, the remaining planes are moved to the front of the allocation, which is not shrunk.
+        // A wrapping buffer is copied instead, leaving the memory it wraps as it is.
+        void keep(const std::vector<ChannelType>& _chs);
+};
+
+#endif // __PLANAR_BUFFER_H_
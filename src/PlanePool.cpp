@@ -0,0 +1,229 @@
+#include "PlanePool.hpp"
+
+#include <new>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include "PlanarBuffer.hpp"
+
+// the size of the smallest class, in bytes; smaller blocks are rounded up to it.
+#define PLANE_POOL_MIN_CLASS 4096
+#define PLANE_POOL_DEFAULT_CAPACITY ((size_t) 512 << 20)
+
+// The index of the class of blocks of bytes bytes, whose size is the smallest of 2^k, 1.25 * 2^k, 1.5 * 2^k and
+//      1.75 * 2^k which is at least bytes, and which is stored in class_bytes.
+static
+size_t
+size_class(size_t bytes,
+           size_t& class_bytes)
+{
+    if (bytes <= PLANE_POOL_MIN_CLASS) {
+        class_bytes = PLANE_POOL_MIN_CLASS;
+        return 0;
+    }
+
+    size_t k = 0;
+    while (((size_t) PLANE_POOL_MIN_CLASS << (k + 1)) < bytes)
+        k++;
+    size_t base = (size_t) PLANE_POOL_MIN_CLASS << k, step = base / 4;
+    size_t n = (bytes - base + step - 1) / step;
+    class_bytes = base + n * step;
+    return 4 * k + n;
+}
+
+// the size of the blocks of class c.
+static
+size_t
+class_size(size_t c)
+{
+    if (c == 0)
+        return PLANE_POOL_MIN_CLASS;
+    size_t base = (size_t) PLANE_POOL_MIN_CLASS << ((c - 1) / 4);
+    return base + ((c - 1) % 4 + 1) * (base / 4);
+}
+
+static std::atomic<size_t> hits { 0 }, misses { 0 }, cached { 0 }, discarded { 0 };
+static std::atomic<size_t> cached_bytes { 0 };
+static std::atomic<size_t> capacity { PLANE_POOL_DEFAULT_CAPACITY };
+
+// the blocks cached by a thread, by size class.
+struct ThreadCache {
+    // only contended by trim_plane_pool, which empties the caches of other threads.
+    std::mutex mutex;
+    std::vector<std::vector<void *>> blocks;
+
+    ThreadCache();
+    ~ThreadCache();
+
+    // frees every block; mutex must be held.
+    void clear();
+};
+
+// The caches of every thread, which trim_plane_pool empties.
+// It is never destroyed, as threads may still exit once static objects have been destroyed.
+struct CacheRegistry {
+    std::mutex mutex;
+    std::vector<ThreadCache *> caches;
+};
+
+static
+CacheRegistry&
+registry()
+{
+    static CacheRegistry *caches = new CacheRegistry();
+    return *caches;
+}
+
+// set once the cache of the thread has been destroyed, so that buffers freed later on, e.g. by the destructors of
+//      static objects, are handed back to the system.
+static thread_local bool cache_destroyed = false;
+
+static
+ThreadCache *
+thread_cache()
+{
+    if (cache_destroyed)
+        return nullptr;
+    static thread_local ThreadCache cache;
+    return &cache;
+}
+
+ThreadCache::ThreadCache()
+{
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    registry().caches.push_back(this);
+}
+
+ThreadCache::~ThreadCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        std::vector<ThreadCache *>& caches = registry().caches;
+        caches.erase(std::find(caches.begin(), caches.end(), this));
+
+        std::lock_guard<std::mutex> cache_lock(mutex);
+        clear();
+    }
+    cache_destroyed = true;
+}
+
+void
+ThreadCache::clear()
+{
+    for (size_t c = 0; c < blocks.size(); c++) {
+        for (auto it = blocks[c].begin(); it != blocks[c].end(); ++it)
+            free(*it);
+        cached_bytes -= class_size(c) * blocks[c].size();
+        blocks[c].clear();
+    }
+}
+
+// takes bytes of the capacity of the pool, returning false if there are not that many left.
+static
+bool
+reserve(size_t bytes)
+{
+    size_t used = cached_bytes.load();
+    do {
+        if (used + bytes > capacity.load())
+            return false;
+    } while (!cached_bytes.compare_exchange_weak(used, used + bytes));
+    return true;
+}
+
+void *
+plane_pool_allocate(size_t bytes)
+{
+    if (bytes == 0)
+        return nullptr;
+
+    size_t class_bytes;
+    size_t c = size_class(bytes, class_bytes);
+    ThreadCache *cache = thread_cache();
+    if (cache) {
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        if (c < cache->blocks.size() && !cache->blocks[c].empty()) {
+            void *p = cache->blocks[c].back();
+            cache->blocks[c].pop_back();
+            cached_bytes -= class_bytes;
+            hits++;
+            return p;
+        }
+    }
+
+    misses++;
+    void *p = nullptr;
+    if (posix_memalign(&p, PLANE_ALIGNMENT, class_bytes))
+        throw std::bad_alloc();
+    return p;
+}
+
+void
+plane_pool_free(void *p,
+                size_t bytes)
+{
+    if (!p)
+        return;
+
+    size_t class_bytes;
+    size_t c = size_class(bytes, class_bytes);
+    ThreadCache *cache = thread_cache();
+    if (cache && reserve(class_bytes)) {
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        try {
+            if (cache->blocks.size() <= c)
+                cache->blocks.resize(c + 1);
+            cache->blocks[c].push_back(p);
+            cached++;
+            return;
+        } catch (const std::bad_alloc&) {
+            cached_bytes -= class_bytes;
+        }
+    }
+
+    discarded++;
+    free(p);
+}
+
+PlanePoolStats
+plane_pool_stats()
+{
+    return PlanePoolStats { hits.load(), misses.load(), cached.load(), discarded.load(), cached_bytes.load() };
+}
+
+void
+reset_plane_pool_stats()
+{
+    hits = 0;
+    misses = 0;
+    cached = 0;
+    discarded = 0;
+}
+
+size_t
+plane_pool_capacity()
+{
+    return capacity.load();
+}
+
+void
+set_plane_pool_capacity(size_t bytes)
+{
+    capacity = bytes;
+    if (cached_bytes.load() > bytes)
+        trim_plane_pool();
+}
+
+void
+trim_plane_pool()
+{
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    for (auto it = registry().caches.begin(); it != registry().caches.end(); ++it) {
+        std::lock_guard<std::mutex> cache_lock((*it)->mutex);
+        (*it)->clear();
+    }
+}
+
+#undef PLANE_POOL_MIN_CLASS
+#undef PLANE_POOL_DEFAULT_CAPACITY
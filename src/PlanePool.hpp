@@ -0,0 +1,41 @@
+#ifndef __PLANE_POOL_H_
+#define __PLANE_POOL_H_
+
+#include <cstdlib>
+
+// A cache of the memory of the planes of images, which PlanarBuffer allocates from and frees to.
+// Images and their temporaries are large, and freeing them hands their pages back to the system, so that the next
+//     image of the same size pays for the allocation and for a page fault on every page again. Instead, freed
+//     blocks are kept by the thread which frees them, in a cache of its own, and reused for the next allocation of
+//     about the same size on that thread, without contention with other threads. Sizes are rounded up to classes
+//     at most 25% apart.
+// The memory cached by all threads together is limited by the capacity of the pool; blocks freed beyond it are
+//     handed back to the system. Blocks still cached when their thread exits are freed.
+
+struct PlanePoolStats {
+    // allocations served from a cache, resp. from the system.
+    size_t hits, misses;
+    // blocks freed to a cache, resp. to the system as the pool was full.
+    size_t cached, discarded;
+    // bytes currently held by the caches of all threads.
+    size_t cached_bytes;
+};
+
+// Allocates at least bytes bytes aligned to PLANE_ALIGNMENT, or returns nullptr if bytes is 0.
+// Throws std::bad_alloc if the memory cannot be allocated.
+void *plane_pool_allocate(size_t bytes);
+// frees the block p, allocated by plane_pool_allocate with the same bytes, possibly from another thread.
+void plane_pool_free(void *p,
+                     size_t bytes);
+
+// The counts since the start of the process, or the last reset_plane_pool_stats().
+PlanePoolStats plane_pool_stats();
+void reset_plane_pool_stats();
+
+// the most bytes which the caches may hold together, 0 disabling the pool.
+size_t plane_pool_capacity();
+void set_plane_pool_capacity(size_t bytes);
+// frees every block held by the caches of all threads.
+void trim_plane_pool();
+
+#endif // __PLANE_POOL_H_
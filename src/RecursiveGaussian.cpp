@@ -0,0 +1,140 @@
+#include "RecursiveGaussian.hpp"
+
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+// Rows and columns are filtered IIR_LANES at a time, gathered into a buffer where the same position in each
+//     sequence is contiguous, so that the recursion runs on all of them at once with vector instructions.
+// Groups with fewer sequences leave the remaining lanes of the buffer unused.
+#define IIR_LANES 16
+// number of elements by which sequences are extended on either side, one per previous output of the filter.
+#define IIR_PAD 3
+
+RecursiveGaussian::RecursiveGaussian(float std_dev)
+{
+    if (std_dev < 0.5f)
+        throw std::invalid_argument("Recursive gaussian blur requires a standard deviation of at least 0.5");
+
+    double q = std_dev >= 2.5 ? 0.98711 * std_dev - 0.96330 :
+                                3.97156 - 4.14554 * std::sqrt(1 - 0.26891 * std_dev);
+
+    double q2 = q * q;
+    double q3 = q2 * q;
+    double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+
+    b1 = (2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0;
+    b2 = -(1.4281 * q2 + 1.26661 * q3) / b0;
+    b3 = 0.422205 * q3 / b0;
+    B = 1 - (b1 + b2 + b3);
+}
+
+void
+RecursiveGaussian::filter(float *data,
+                          ssize_t n) const
+{
+    // the lanes of one element of every sequence, as a vector type which the compiler splits into the vector
+    //     registers available on the target.
+    typedef float Lanes __attribute__((vector_size(IIR_LANES * sizeof(float)), aligned(sizeof(float))));
+
+    const float B = this->B, b1 = this->b1, b2 = this->b2, b3 = this->b3;
+
+    // The sequences are padded with IIR_PAD elements on each side. A constant input is a steady state of the
+    //     filter, so padding with the first (resp. last) element extends the sequence by repeating it.
+    Lanes *begin = (Lanes *) data + IIR_PAD;
+    Lanes *end = begin + n;
+
+    for (Lanes *x = begin - IIR_PAD; x < begin; x++)
+        *x = *begin;
+    for (Lanes *x = begin; x < end; x++)
+        *x = b3 * x[-3] + b2 * x[-2] + B * x[0] + b1 * x[-1];
+
+    for (Lanes *x = end; x < end + IIR_PAD; x++)
+        *x = end[-1];
+    for (Lanes *x = end - 1; x >= begin; x--)
+        *x = b3 * x[3] + b2 * x[2] + B * x[0] + b1 * x[1];
+}
+
+void
+RecursiveGaussian::blur_rows(const float *src,
+                             ssize_t src_stride,
+                             float *dst,
+                             ssize_t dst_stride,
+                             ssize_t w,
+                             ssize_t j0,
+                             ssize_t j1) const
+{
+    if (w <= 0)
+        return;
+
+    std::vector<float> buffer((w + 2 * IIR_PAD) * IIR_LANES);
+
+    for (ssize_t j = j0; j < j1; j += IIR_LANES) {
+        ssize_t lanes = std::min((ssize_t) IIR_LANES, j1 - j);
+
+        // lanes beyond the last row of the group filter a copy of its first row, and are then discarded.
+        const float *in[IIR_LANES];
+        for (ssize_t l = 0; l < IIR_LANES; l++)
+            in[l] = src + src_stride * (l < lanes ? j + l : j);
+
+        // the rows are transposed column by column, so that the buffer is written sequentially.
+        float *x = buffer.data() + IIR_LANES * IIR_PAD;
+        for (ssize_t i = 0; i < w; i++, x += IIR_LANES)
+            for (ssize_t l = 0; l < IIR_LANES; l++)
+                x[l] = in[l][i];
+
+        filter(buffer.data(), w);
+
+        x = buffer.data() + IIR_LANES * IIR_PAD;
+        for (ssize_t i = 0; i < w; i++, x += IIR_LANES)
+            for (ssize_t l = 0; l < lanes; l++)
+                dst[dst_stride * (j + l) + i] = x[l];
+    }
+}
+
+void
+RecursiveGaussian::blur_columns(const float *src,
+                                ssize_t src_stride,
+                                float *dst,
+                                ssize_t dst_stride,
+                                ssize_t h,
+                                ssize_t i0,
+                                ssize_t i1) const
+{
+    if (h <= 0 || i0 >= i1)
+        return;
+
+    // Columns are contiguous within a row, so the recursion runs down the plane a whole row at a time,
+    //     in place in dst. The rows above the first and below the last are copies of these rows.
+    const float B = this->B, b1 = this->b1, b2 = this->b2, b3 = this->b3;
+    ssize_t n = i1 - i0;
+    std::vector<float> edge(n);
+
+    std::copy(src + i0, src + i1, edge.begin());
+    const float *p1 = edge.data(), *p2 = edge.data(), *p3 = edge.data();
+    for (ssize_t j = 0; j < h; j++) {
+        const float *in = src + src_stride * j + i0;
+        float *out = dst + dst_stride * j + i0;
+        for (ssize_t i = 0; i < n; i++)
+            out[i] = b3 * p3[i] + b2 * p2[i] + B * in[i] + b1 * p1[i];
+        p3 = p2;
+        p2 = p1;
+        p1 = out;
+    }
+
+    float *last = dst + dst_stride * (h - 1) + i0;
+    std::copy(last, last + n, edge.begin());
+    p1 = p2 = p3 = edge.data();
+    for (ssize_t j = h - 1; j >= 0; j--) {
+        float *out = dst + dst_stride * j + i0;
+        for (ssize_t i = 0; i < n; i++)
+            out[i] = b3 * p3[i] + b2 * p2[i] + B * out[i] + b1 * p1[i];
+        p3 = p2;
+        p2 = p1;
+        p1 = out;
+    }
+}
+
+#undef IIR_LANES
+#undef IIR_PAD
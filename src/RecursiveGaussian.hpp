@@ -0,0 +1,44 @@
+#ifndef __RECURSIVE_GAUSSIAN_H_
+#define __RECURSIVE_GAUSSIAN_H_
+
+#include <cstdlib>
+
+// A recursive approximation of a Gaussian blur, after I. T. Young and L. J. van Vliet,
+//     "Recursive implementation of the Gaussian filter", Signal Processing 44 (1995).
+// Each pass is a third order causal filter followed by the same filter run backwards, so the cost per pixel
+//     does not depend on the standard deviation. Sequences are extended past their ends by repeating their
+//     first and last pixels.
+// Unlike the convolution, every pixel of the image is computed.
+class RecursiveGaussian {
+    // coefficients of the filter, normalized so that w[k] = B x[k] + b1 w[k - 1] + b2 w[k - 2] + b3 w[k - 3].
+    double B, b1, b2, b3;
+
+    // filters IIR_LANES independent sequences of length n in place, interleaved so that element k of
+    //     sequence l is at data[IIR_LANES * (k + IIR_PAD) + l]. The IIR_PAD elements before and after
+    //     each sequence are overwritten.
+    void filter(float *data,
+                ssize_t n) const;
+
+    public:
+        // the approximation is only valid for std_dev >= 0.5.
+        RecursiveGaussian(float std_dev);
+
+        // blurs the rows [j0, j1) of a w pixels wide plane horizontally. src and dst may be the same plane.
+        void blur_rows(const float *src,
+                       ssize_t src_stride,
+                       float *dst,
+                       ssize_t dst_stride,
+                       ssize_t w,
+                       ssize_t j0,
+                       ssize_t j1) const;
+        // blurs the columns [i0, i1) of a plane of height h vertically. src and dst may be the same plane.
+        void blur_columns(const float *src,
+                          ssize_t src_stride,
+                          float *dst,
+                          ssize_t dst_stride,
+                          ssize_t h,
+                          ssize_t i0,
+                          ssize_t i1) const;
+};
+
+#endif // __RECURSIVE_GAUSSIAN_H_
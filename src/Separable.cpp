@@ -0,0 +1,163 @@
+#include "Separable.hpp"
+
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <algorithm>
+
+// terms smaller than this, relative to the largest term, are below float precision and are dropped.
+#define SEPARABLE_TOL 1e-6
+// the number of Jacobi sweeps after which the singular value decomposition gives up converging further.
+#define MAX_SWEEPS 60
+// the number of decompositions kept in the cache.
+#define CACHE_SIZE 64
+
+SeparableKernel::SeparableKernel(const Kernel& kern)
+{
+    if (!factor_rank_one(kern))
+        factor_svd(kern);
+}
+
+bool
+SeparableKernel::factor_rank_one(const Kernel& kern)
+{
+    ssize_t kern_h = kern.size();
+    ssize_t kern_w = kern[0].size();
+
+    // the largest element is used as a pivot, so that the factors are as accurate as possible.
+    ssize_t p = 0, q = 0;
+    for (ssize_t n = 0; n < kern_h; n++)
+        for (ssize_t m = 0; m < kern_w; m++)
+            if (std::fabs(kern[n][m]) > std::fabs(kern[p][q])) {
+                p = n;
+                q = m;
+            }
+
+    float pivot = kern[p][q];
+    // a kernel of zeros has no terms at all.
+    if (pivot == 0)
+        return true;
+
+    KernelRow column(kern_h);
+    KernelRow row(kern_w);
+    for (ssize_t n = 0; n < kern_h; n++)
+        column[n] = kern[n][q];
+    for (ssize_t m = 0; m < kern_w; m++)
+        row[m] = kern[p][m] / pivot;
+
+    for (ssize_t n = 0; n < kern_h; n++)
+        for (ssize_t m = 0; m < kern_w; m++)
+            if (std::fabs(kern[n][m] - column[n] * row[m]) > SEPARABLE_TOL * std::fabs(pivot))
+                return false;
+
+    columns.push_back(column);
+    rows.push_back(row);
+    return true;
+}
+
+void
+SeparableKernel::factor_svd(const Kernel& kern)
+{
+    ssize_t kern_h = kern.size();
+    ssize_t kern_w = kern[0].size();
+
+    // One sided Jacobi: the columns of a are rotated until they are orthogonal, and the same rotations are
+    //     applied to v, which starts as the identity. Then kern = a * transpose(v), and the norms of the columns
+    //     of a are the singular values.
+    std::vector<std::vector<double>> a(kern_w, std::vector<double>(kern_h));
+    std::vector<std::vector<double>> v(kern_w, std::vector<double>(kern_w, 0));
+    for (ssize_t m = 0; m < kern_w; m++) {
+        for (ssize_t n = 0; n < kern_h; n++)
+            a[m][n] = kern[n][m];
+        v[m][m] = 1;
+    }
+
+    for (int sweep = 0; sweep < MAX_SWEEPS; sweep++) {
+        bool rotated = false;
+
+        for (ssize_t k = 0; k < kern_w; k++)
+            for (ssize_t l = k + 1; l < kern_w; l++) {
+                double alpha = 0, beta = 0, gamma = 0;
+                for (ssize_t n = 0; n < kern_h; n++) {
+                    alpha += a[k][n] * a[k][n];
+                    beta += a[l][n] * a[l][n];
+                    gamma += a[k][n] * a[l][n];
+                }
+                if (std::fabs(gamma) <= 1e-15 * std::sqrt(alpha * beta))
+                    continue;
+                rotated = true;
+
+                double zeta = (beta - alpha) / (2 * gamma);
+                double t = (zeta >= 0 ? 1 : -1) / (std::fabs(zeta) + std::sqrt(1 + zeta * zeta));
+                double c = 1 / std::sqrt(1 + t * t);
+                double s = c * t;
+
+                for (ssize_t n = 0; n < kern_h; n++) {
+                    double x = a[k][n];
+                    a[k][n] = c * x - s * a[l][n];
+                    a[l][n] = s * x + c * a[l][n];
+                }
+                for (ssize_t m = 0; m < kern_w; m++) {
+                    double x = v[k][m];
+                    v[k][m] = c * x - s * v[l][m];
+                    v[l][m] = s * x + c * v[l][m];
+                }
+            }
+
+        if (!rotated)
+            break;
+    }
+
+    std::vector<std::pair<double, ssize_t>> sigma(kern_w);
+    for (ssize_t k = 0; k < kern_w; k++) {
+        double norm = 0;
+        for (ssize_t n = 0; n < kern_h; n++)
+            norm += a[k][n] * a[k][n];
+        sigma[k] = std::make_pair(std::sqrt(norm), k);
+    }
+    std::sort(sigma.begin(), sigma.end(), std::greater<std::pair<double, ssize_t>>());
+
+    // each term is sigma * u * transpose(v); the column a[k] already includes sigma.
+    for (auto it = sigma.begin(); it != sigma.end(); ++it) {
+        if (it->first <= SEPARABLE_TOL * sigma[0].first || it->first == 0)
+            break;
+
+        KernelRow column(kern_h);
+        KernelRow row(kern_w);
+        for (ssize_t n = 0; n < kern_h; n++)
+            column[n] = a[it->second][n];
+        for (ssize_t m = 0; m < kern_w; m++)
+            row[m] = v[it->second][m];
+
+        columns.push_back(column);
+        rows.push_back(row);
+    }
+}
+
+std::shared_ptr<const SeparableKernel>
+SeparableKernel::get(const Kernel& kern)
+{
+    static std::mutex cache_mutex;
+    static std::map<Kernel, std::shared_ptr<const SeparableKernel>> cache;
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(kern);
+        if (it != cache.end())
+            return it->second;
+    }
+
+    // the decomposition is computed without holding the lock, as it may take a while for large kernels.
+    std::shared_ptr<const SeparableKernel> sep(new SeparableKernel(kern));
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    // batch jobs reuse a handful of kernels, so the cache is simply emptied when it fills up.
+    if (cache.size() >= CACHE_SIZE)
+        cache.clear();
+    cache[kern] = sep;
+    return sep;
+}
+
+#undef SEPARABLE_TOL
+#undef MAX_SWEEPS
+#undef CACHE_SIZE
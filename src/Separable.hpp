@@ -0,0 +1,35 @@
+#ifndef __SEPARABLE_H_
+#define __SEPARABLE_H_
+
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include "Kernel.hpp"
+
+// A kernel written as a sum of separable terms, so that it can be applied as a sequence of row and column passes:
+//      kern[n][m] = sum over t of column(t)[n] * row(t)[m]
+// Terms whose contribution is below float precision are dropped, so rank() is the numerical rank of the kernel.
+// Decompositions are immutable once built, and are shared between all users of the same kernel through get().
+class SeparableKernel {
+    std::vector<KernelRow> columns;
+    std::vector<KernelRow> rows;
+
+    SeparableKernel(const Kernel& kern);
+
+    // factors a rank one kernel exactly, returning false if kern does not have rank one.
+    bool factor_rank_one(const Kernel& kern);
+    // factors any kernel through its singular value decomposition.
+    void factor_svd(const Kernel& kern);
+
+    public:
+        // returns the (cached) decomposition of kern, which must be a valid kernel as checked by Image::convolve.
+        static std::shared_ptr<const SeparableKernel> get(const Kernel& kern);
+
+        size_t rank() const { return rows.size(); }
+
+        // the kern.size() x 1 column and 1 x kern[0].size() row of term t.
+        const KernelRow& column(size_t t) const { return columns[t]; }
+        const KernelRow& row(size_t t) const { return rows[t]; }
+};
+
+#endif // __SEPARABLE_H_
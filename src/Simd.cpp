@@ -0,0 +1,83 @@
+#include "Simd.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(FOURIER_SIMD_X86)
+#include <cpuid.h>
+
+// reads an extended control register, used to check that the OS saves the AVX registers on context switches.
+static
+unsigned long long
+xgetbv(unsigned int reg)
+{
+    unsigned int lo, hi;
+    __asm__ volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (reg));
+    return ((unsigned long long) hi << 32) | lo;
+}
+
+static
+SimdLevel
+detect_simd_level()
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return SIMD_NONE;
+    if (!(ecx & bit_SSE4_2))
+        return SIMD_NONE;
+    if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+        return SIMD_SSE42;
+
+    unsigned long long xcr0 = xgetbv(0);
+    // XMM and YMM state
+    if ((xcr0 & 0x6) != 0x6)
+        return SIMD_SSE42;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return SIMD_SSE42;
+    if (!(ebx & bit_AVX2))
+        return SIMD_SSE42;
+    // opmask, upper ZMM and high ZMM state
+    if (!(ebx & bit_AVX512F) || (xcr0 & 0xe0) != 0xe0)
+        return SIMD_AVX2;
+
+    return SIMD_AVX512;
+}
+#else
+static
+SimdLevel
+detect_simd_level()
+{
+    return SIMD_NONE;
+}
+#endif
+
+static
+SimdLevel
+cap_simd_level(SimdLevel level)
+{
+    const char *cap = getenv("FOURIER_SIMD");
+    if (!cap)
+        return level;
+
+    SimdLevel max_level = level;
+    if (!strcmp(cap, "none"))
+        max_level = SIMD_NONE;
+    else if (!strcmp(cap, "sse4.2"))
+        max_level = SIMD_SSE42;
+    else if (!strcmp(cap, "avx2"))
+        max_level = SIMD_AVX2;
+    else if (!strcmp(cap, "avx512"))
+        max_level = SIMD_AVX512;
+
+    return max_level < level ? max_level : level;
+}
+
+SimdLevel
+simd_level()
+{
+    // initialization of function statics is thread safe.
+    static const SimdLevel level = cap_simd_level(detect_simd_level());
+    return level;
+}
@@ -0,0 +1,18 @@
+#ifndef __SIMD_H_
+#define __SIMD_H_
+
+// Instruction set extensions for which Fourier has specialized kernels, ordered from least to most capable.
+typedef enum SimdLevel {
+SIMD_NONE,
+SIMD_SSE42,
+SIMD_AVX2,
+SIMD_AVX512,
+} SimdLevel;
+
+// The most capable instruction set supported by both the CPU and the operating system.
+// The CPU is queried with CPUID once, on the first call.
+// Setting the environment variable FOURIER_SIMD to "none", "sse4.2", "avx2" or "avx512" caps the level,
+//     which is useful for comparing the specialized kernels against the portable ones.
+SimdLevel simd_level();
+
+#endif // __SIMD_H_
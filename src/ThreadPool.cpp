@@ -0,0 +1,255 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+
+// index of the queue belonging to the current thread, if it is a worker of the pool.
+static thread_local size_t current_worker = (size_t) -1;
+// the number of parallel regions, or submissions, which the current thread is inside of.
+static thread_local size_t region_depth = 0;
+
+ThreadPool::ThreadPool() :
+    queued { 0 },
+    stopping { false },
+    n_threads { 1 },
+    active { 0 },
+    resizing { false }
+{
+    start(std::max(std::thread::hardware_concurrency(), 1u));
+}
+
+ThreadPool::~ThreadPool()
+{
+    stop();
+}
+
+ThreadPool&
+ThreadPool::instance()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void
+ThreadPool::start(size_t n)
+{
+    n_threads = std::max(n, (size_t) 1);
+    stopping = false;
+
+    // the thread starting a parallel region takes part in it, so one thread less is needed.
+    for (size_t i = 0; i < n_threads; i++)
+        queues.emplace_back(new Queue());
+    for (size_t i = 0; i + 1 < n_threads; i++)
+        workers.emplace_back(&ThreadPool::work, this, i);
+}
+
+void
+ThreadPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto it = workers.begin(); it != workers.end(); ++it)
+        it->join();
+
+    // with no workers, tasks are run as they are submitted, so nothing can be left over.
+    workers.clear();
+    queues.clear();
+}
+
+void
+ThreadPool::set_num_threads(size_t n)
+{
+    if (current_worker != (size_t) -1 || region_depth > 0)
+        throw std::logic_error("set_num_threads cannot be called from inside a parallel region or a task");
+
+    {
+        std::unique_lock<std::mutex> lock(resize_mutex);
+        resize_done.wait(lock, [this] { return !resizing; });
+        resizing = true;
+        resize_done.wait(lock, [this] { return active == 0; });
+    }
+
+    try {
+        stop();
+        start(n);
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(resize_mutex);
+            resizing = false;
+        }
+        resize_done.notify_all();
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(resize_mutex);
+        resizing = false;
+    }
+    resize_done.notify_all();
+}
+
+void
+ThreadPool::enter()
+{
+    if (current_worker != (size_t) -1)
+        return;
+
+    if (region_depth == 0) {
+        std::unique_lock<std::mutex> lock(resize_mutex);
+        resize_done.wait(lock, [this] { return !resizing; });
+        active++;
+    }
+    region_depth++;
+}
+
+void
+ThreadPool::leave()
+{
+    if (current_worker != (size_t) -1)
+        return;
+
+    if (--region_depth == 0) {
+        bool idle;
+        {
+            std::lock_guard<std::mutex> lock(resize_mutex);
+            idle = --active == 0;
+        }
+        if (idle)
+            resize_done.notify_all();
+    }
+}
+
+void
+ThreadPool::work(size_t index)
+{
+    current_worker = index;
+
+    for (;;) {
+        if (run_one(index))
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
+
+bool
+ThreadPool::run_one(size_t index)
+{
+    std::function<void()> task;
+
+    // own queue first, newest task first; then steal the oldest task of another queue.
+    for (size_t k = 0; k < queues.size() && !task; k++) {
+        Queue& q = *queues[(index + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty())
+            continue;
+        if (k == 0) {
+            task = std::move(q.tasks.back());
+            q.tasks.pop_back();
+        } else {
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+        }
+    }
+
+    if (!task)
+        return false;
+
+    queued--;
+    task();
+    return true;
+}
+
+void
+ThreadPool::submit(std::function<void()> task)
+{
+    Active region(*this);
+    if (workers.empty()) {
+        task();
+        return;
+    }
+
+    // threads outside the pool share the last queue.
+    size_t index = current_worker < workers.size() ? current_worker : workers.size();
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // taking the lock orders the increment before any worker's check of queued.
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+void
+ThreadPool::parallel_for(ssize_t begin,
+                         ssize_t end,
+                         ssize_t grain,
+                         const std::function<void(ssize_t, ssize_t)>& body)
+{
+    if (end <= begin)
+        return;
+
+    Active region(*this);
+    grain = std::max(grain, (ssize_t) 1);
+    if (workers.empty() || end - begin <= grain) {
+        body(begin, end);
+        return;
+    }
+
+    // a few chunks per thread, so that threads which finish early can steal work from slower ones.
+    ssize_t chunk = std::max(grain, (ssize_t) ((end - begin + 4 * n_threads - 1) / (4 * n_threads)));
+    ssize_t n_chunks = (end - begin + chunk - 1) / chunk;
+
+    std::atomic<ssize_t> remaining { n_chunks };
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto run_chunk = [&](ssize_t c) {
+        try {
+            body(begin + c * chunk, std::min(end, begin + (c + 1) * chunk));
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+        // The thread waiting for the region reads remaining without sleep_mutex, so it may see 0, return and destroy
+        //      the region, this lambda included, while this thread still holds the lock. The decrement must therefore
+        //      be the last access to the region, and wake is reached through a reference taken before it rather than
+        //      through the this pointer captured by the lambda.
+        // Counting down under the lock orders it before the check of a waiting thread about to sleep, so that the
+        //      notification is not lost.
+        std::condition_variable& woken = wake;
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        if (--remaining == 0)
+            woken.notify_all();
+    };
+
+    for (ssize_t c = 1; c < n_chunks; c++)
+        submit([&run_chunk, c] { run_chunk(c); });
+    run_chunk(0);
+
+    // Other tasks are run while the region is in flight. When there are none, the thread sleeps until its last
+    //      chunk finishes, or until a task is queued, as workers do.
+    size_t index = current_worker < workers.size() ? current_worker : workers.size();
+    while (remaining > 0) {
+        if (run_one(index))
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this, &remaining] { return remaining == 0 || queued > 0; });
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -0,0 +1,115 @@
+#ifndef __THREAD_POOL_H_
+#define __THREAD_POOL_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+
+// A work stealing pool of threads, shared by the whole library.
+// Every worker has its own queue of tasks. Workers take tasks from the back of their own queue, and when it is
+//     empty they steal from the front of the other queues. Threads waiting for work they submitted run queued
+//     tasks in the meantime, so parallel regions may be nested without deadlocking, and sleep when there are none.
+class ThreadPool {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    // one queue per worker, and one extra queue for tasks submitted by threads outside the pool.
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    // Idle workers, and threads waiting for the rest of a parallel region, sleep on wake. It is notified when a task
+    //      is queued, and when the last chunk of a region finishes.
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queued;
+    bool stopping;
+
+    // number of threads taking part in parallel regions, including the thread which starts the region.
+    std::atomic<size_t> n_threads;
+
+    // The parallel regions and submissions started by threads outside the pool which are in flight, which
+    //      set_num_threads waits for. While resizing is set, new ones wait for it to finish.
+    std::mutex resize_mutex;
+    std::condition_variable resize_done;
+    size_t active;
+    bool resizing;
+
+    ThreadPool();
+
+    void start(size_t n);
+    void stop();
+    void work(size_t index);
+
+    // Mark the start and end of a parallel region or submission. Only outermost regions of threads outside the
+    //      pool are counted, as nested ones are covered by the region which contains them.
+    void enter();
+    void leave();
+    struct Active {
+        ThreadPool& pool;
+        Active(ThreadPool& _pool) : pool(_pool) { pool.enter(); }
+        ~Active() { pool.leave(); }
+    };
+
+    // runs one queued task, preferring the queue at index. Returns false if every queue was empty.
+    bool run_one(size_t index);
+
+    public:
+        ~ThreadPool();
+
+        // the pool used by all parallel algorithms; it is started on first use,
+        //      with std::thread::hardware_concurrency() threads.
+        static ThreadPool& instance();
+
+        size_t num_threads() const { return n_threads; }
+        // Changes the number of threads used by parallel regions; 1 disables threading.
+        // It may be called from any thread at any time: it waits until the parallel regions in flight on other
+        //      threads have finished, and regions started meanwhile wait until the new workers are running.
+        //      Queued tasks are finished before the old workers are stopped.
+        // Throws std::logic_error if called from inside a parallel region or a task, which could never finish
+        //      while it waits.
+        void set_num_threads(size_t n);
+
+        // queues a task to be run by some thread of the pool.
+        void submit(std::function<void()> task);
+
+        // Calls body(b, e) for consecutive subranges [b, e) covering [begin, end), each having at least grain
+        //      elements (except possibly the last), and returns once all calls have returned.
+        // Calls may run concurrently, so body must only write to the part of the output belonging to its subrange.
+        // The first exception thrown by body is rethrown once all calls have finished.
+        void parallel_for(ssize_t begin,
+                          ssize_t end,
+                          ssize_t grain,
+                          const std::function<void(ssize_t, ssize_t)>& body);
+};
+
+// shorthand for ThreadPool::instance().parallel_for
+inline
+void
+parallel_for(ssize_t begin,
+             ssize_t end,
+             ssize_t grain,
+             const std::function<void(ssize_t, ssize_t)>& body)
+{
+    ThreadPool::instance().parallel_for(begin, end, grain, body);
+}
+
+// The grain to use for loops over the rows of a w pixels wide image, doing about cost operations per pixel.
+// Tasks get large enough that the cost of scheduling them is negligible.
+inline
+ssize_t
+rows_per_task(ssize_t w,
+              ssize_t cost = 1)
+{
+    return std::max((ssize_t) 1, (ssize_t) 65536 / std::max(w * cost, (ssize_t) 1));
+}
+
+#endif // __THREAD_POOL_H_
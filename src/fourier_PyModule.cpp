@@ -1,4 +1,11 @@
 #include "Image.hpp"
+#include "LazyImage.hpp"
+#include "Pipeline.hpp"
+#include "PackedImage.hpp"
+#include "PlanePool.hpp"
+#include "Batch.hpp"
+#include "ThreadPool.hpp"
+#include "Executor.hpp"
 
 #include <pybind11/pybind11.h>
 #include <pybind11/operators.h>
@@ -6,6 +13,263 @@
 
 namespace py = pybind11;
 
+// Bindings of operations which take long, i.e. which read, write or compute whole images, release the GIL while
+//     they run, so that other Python threads can run in the meantime. An image must not be used by another thread
+//     while an operation on it is running.
+typedef py::call_guard<py::gil_scoped_release> release_gil;
+
+// the buffer of data, which must be contiguous and one dimensional, e.g. bytes, a bytearray or a memoryview.
+// Its bytes are at info.ptr, and can be read in place as long as info is kept.
+static
+py::buffer_info
+request_bytes(py::buffer data)
+{
+    py::buffer_info info = data.request();
+    if (info.ndim != 1 || info.strides[0] != info.itemsize)
+        throw std::invalid_argument("Images can only be decoded from contiguous one dimensional buffers.");
+    return info;
+}
+
+// A handle on info which can be dropped by any thread, the GIL being taken to release the buffer.
+static
+std::shared_ptr<py::buffer_info>
+hold_buffer(py::buffer_info&& info)
+{
+    return std::shared_ptr<py::buffer_info>(new py::buffer_info(std::move(info)), [](py::buffer_info *p) {
+        py::gil_scoped_acquire gil;
+        delete p;
+    });
+}
+
+// An Image wrapping the pixels of data, e.g. a NumPy array of float32, without copying them. data must be laid out
+//     as the buffer of an Image in c_space, with shape (channels, height, width), or (height, width) for gray images,
+//     and contiguous rows. The buffer is held until the image no longer refers to it.
+static
+Image
+wrap_buffer(py::buffer data,
+            ColorSpace c_space)
+{
+    py::buffer_info info = data.request(true);
+    if (info.format != py::format_descriptor<float>::format() || info.itemsize != sizeof(float))
+        throw std::invalid_argument("Images can only wrap buffers of float32.");
+
+    ssize_t planes = Image::channels(c_space).size();
+    if (info.ndim == 2 && planes == 1) {
+        info.shape.insert(info.shape.begin(), 1);
+        info.strides.insert(info.strides.begin(), info.strides[0] * info.shape[1]);
+    } else if (info.ndim != 3 || info.shape[0] != planes) {
+        throw std::invalid_argument("Buffer must have shape (" + std::to_string(planes) + ", height, width).");
+    }
+    if (info.strides[2] != (ssize_t) sizeof(float) || info.strides[1] % sizeof(float) || info.strides[0] % sizeof(float) ||
+        info.strides[1] <= 0 || info.strides[0] <= 0)
+        throw std::invalid_argument("Buffer rows must be contiguous, and rows and planes must follow each other.");
+
+    float *pixels = (float *) info.ptr;
+    ssize_t w = info.shape[2], h = info.shape[1];
+    ssize_t row_stride = info.strides[1] / sizeof(float), plane_stride = info.strides[0] / sizeof(float);
+    return Image::wrap(pixels, w, h, row_stride, plane_stride, c_space, hold_buffer(std::move(info)));
+}
+
+static
+py::bytes
+to_bytes(const std::vector<unsigned char>& data)
+{
+    return py::bytes((const char *) data.data(), data.size());
+}
+
+// the Python exception which pybind11 would raise for error, the exception thrown by an operation.
+static
+py::object
+python_exception(std::exception_ptr error)
+{
+    PyObject *type = PyExc_RuntimeError;
+    std::string message = "Unknown error";
+    try {
+        std::rethrow_exception(error);
+    } catch (const std::bad_alloc& e) {
+        type = PyExc_MemoryError;
+        message = e.what();
+    } catch (const std::out_of_range& e) {
+        type = PyExc_IndexError;
+        message = e.what();
+    } catch (const std::overflow_error& e) {
+        type = PyExc_OverflowError;
+        message = e.what();
+    } catch (const std::invalid_argument& e) {
+        type = PyExc_ValueError;
+        message = e.what();
+    } catch (const std::length_error& e) {
+        type = PyExc_ValueError;
+        message = e.what();
+    } catch (const std::domain_error& e) {
+        type = PyExc_ValueError;
+        message = e.what();
+    } catch (const std::range_error& e) {
+        type = PyExc_ValueError;
+        message = e.what();
+    } catch (const std::exception& e) {
+        message = e.what();
+    } catch (...) {
+    }
+    return py::reinterpret_borrow<py::object>(type)(message);
+}
+
+// Called with the GIL held once an asynchronous operation has finished, with the object it keeps, to give the
+//     result of its future.
+typedef std::function<py::object(py::object)> AsyncResult;
+
+// the result of an operation which gives value.
+template <class T>
+static
+AsyncResult
+async_value(T value)
+{
+    std::shared_ptr<T> result = std::make_shared<T>(std::move(value));
+    return [result](py::object) { return py::cast(std::move(*result)); };
+}
+
+// the result of an operation which changes the object it keeps, e.g. blurs an image: the object itself.
+static
+AsyncResult
+async_self()
+{
+    return [](py::object self) { return self; };
+}
+
+static
+AsyncResult
+async_none()
+{
+    return [](py::object) { return py::none(); };
+}
+
+namespace {
+
+// the Python objects of an asynchronous operation, which are only touched with the GIL held.
+struct AsyncCall {
+    py::object future;
+    py::object keep;
+};
+
+}
+
+// Runs job without the GIL on the Executor, returning a concurrent.futures.Future, which can be waited for or
+//     wrapped by asyncio.wrap_future. The future is given the result returned by job, or the exception it throws.
+// keep, e.g. the image which job changes, is kept alive until job has finished. job must not hold Python objects
+//     other than through keep and hold_buffer, as it is dropped without the GIL.
+static
+py::object
+run_async(py::object keep,
+          std::function<AsyncResult()> job)
+{
+    py::object future = py::module::import("concurrent.futures").attr("Future")();
+    std::shared_ptr<AsyncCall> call(new AsyncCall { future, std::move(keep) });
+
+    Executor::instance().submit([call, job] {
+        AsyncResult result;
+        std::exception_ptr error;
+        try {
+            result = job();
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        py::gil_scoped_acquire gil;
+        try {
+            if (error)
+                call->future.attr("set_exception")(python_exception(error));
+            else
+                call->future.attr("set_result")(result(call->keep));
+        } catch (py::error_already_set& e) {
+            // e.g. the future was cancelled, or the result could not be converted.
+            try {
+                call->future.attr("set_exception")(e.value());
+            } catch (py::error_already_set&) {
+            }
+        }
+        // the objects are dropped while the GIL is held.
+        result = nullptr;
+        call->future = py::object();
+        call->keep = py::object();
+    });
+
+    return future;
+}
+
+// The layout of the planes exported by get_image_buffer, and the memory holding them.
+struct ExportedPlanes {
+    std::shared_ptr<void> memory;
+    Py_ssize_t shape[3];
+    Py_ssize_t strides[3];
+};
+
+// The bf_getbuffer slot of Image, which exports its planes as float32 of shape (channels, height, width), with the
+//     channels of its colour space in order, e.g. numpy.asarray(im)[0] is the red plane of an RGB image.
+// The exporter, view->obj, is a capsule holding the memory of the planes rather than the image itself, since
+//     operations computing new pixels, such as colour conversions and filters, give the image new memory. Arrays
+//     taken before such an operation keep the pixels which the image had, and their memory is freed once the last
+//     of them is dropped. pybind11's def_buffer cannot do this, as its exporter is always the image.
+static
+int
+get_image_buffer(PyObject *obj,
+                 Py_buffer *view,
+                 int flags)
+{
+    view->obj = nullptr;
+    try {
+        Image& im = py::handle(obj).cast<Image&>();
+        PlanarBuffer& planes = im.buffer();
+        std::unique_ptr<ExportedPlanes> exported(new ExportedPlanes {
+            nullptr,
+            { (Py_ssize_t) planes.size(), im.height(), im.width() },
+            { (Py_ssize_t) sizeof(float) * planes.plane_stride(),
+              (Py_ssize_t) sizeof(float) * planes.stride(),
+              (Py_ssize_t) sizeof(float) }
+        });
+
+        view->buf = planes.plane(planes.channels()[0]);
+        view->len = sizeof(float) * planes.size() * im.height() * im.width();
+        view->readonly = 0;
+        view->itemsize = sizeof(float);
+        view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? (char *) "f" : nullptr;
+        view->ndim = 3;
+        view->shape = exported->shape;
+        view->strides = exported->strides;
+        view->suboffsets = nullptr;
+        view->internal = nullptr;
+
+        // rows are padded to the alignment of PlanarBuffer, or to the strides of a wrapped array, so the planes are
+        //      only contiguous for some widths.
+        bool contiguous = PyBuffer_IsContiguous(view, 'C');
+        if (((flags & PyBUF_STRIDES) != PyBUF_STRIDES && !contiguous) ||
+            ((flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS && !contiguous) ||
+            ((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS && !PyBuffer_IsContiguous(view, 'F')) ||
+            ((flags & PyBUF_ANY_CONTIGUOUS) == PyBUF_ANY_CONTIGUOUS && !PyBuffer_IsContiguous(view, 'A'))) {
+            PyErr_SetString(PyExc_BufferError, "The planes of the image are not contiguous.");
+            return -1;
+        }
+        if ((flags & PyBUF_STRIDES) != PyBUF_STRIDES)
+            view->strides = nullptr;
+        if ((flags & PyBUF_ND) != PyBUF_ND) {
+            view->ndim = 1;
+            view->shape = nullptr;
+        }
+
+        exported->memory = planes.share();
+        py::capsule memory(exported.get(), [](void *p) { delete static_cast<ExportedPlanes *>(p); });
+        exported.release();
+        view->obj = memory.release().ptr();
+        return 0;
+    } catch (py::error_already_set& e) {
+        e.restore();
+    } catch (const std::bad_alloc&) {
+        PyErr_NoMemory();
+    } catch (const std::exception& e) {
+        PyErr_SetString(PyExc_BufferError, e.what());
+    }
+    return -1;
+}
+
 PYBIND11_MODULE(fourier, m) {
     py::enum_<ColorSpace>(m, "ColorSpace")
         .value("RGB", ColorSpace::RGB)
@@ -16,53 +280,606 @@ PYBIND11_MODULE(fourier, m) {
         .value("Gray", ColorSpace::GRAY)
         .export_values();
 
-    py::class_<Image>(m, "Image")
+    py::enum_<BlurMethod>(m, "BlurMethod")
+        .value("BLUR_AUTO", BlurMethod::BLUR_AUTO)
+        .value("BLUR_FIR", BlurMethod::BLUR_FIR)
+        .value("BLUR_IIR", BlurMethod::BLUR_IIR)
+        .export_values();
+
+    py::enum_<ColorPrecision>(m, "ColorPrecision")
+        .value("COLOR_FLOAT", ColorPrecision::COLOR_FLOAT)
+        .value("COLOR_FIXED16", ColorPrecision::COLOR_FIXED16)
+        .export_values();
+
+    py::enum_<SampleType>(m, "SampleType")
+        .value("SAMPLE_U8", SampleType::SAMPLE_U8)
+        .value("SAMPLE_U16", SampleType::SAMPLE_U16)
+        .value("SAMPLE_F16", SampleType::SAMPLE_F16)
+        .value("SAMPLE_F32", SampleType::SAMPLE_F32)
+        .export_values();
+
+    py::enum_<PNGFilters>(m, "PNGFilters")
+        .value("PNG_FILTERS_NONE", PNGFilters::PNG_FILTERS_NONE)
+        .value("PNG_FILTERS_FAST", PNGFilters::PNG_FILTERS_FAST)
+        .value("PNG_FILTERS_ALL", PNGFilters::PNG_FILTERS_ALL)
+        .export_values();
+
+    // registered before Image, whose methods take it as a default argument.
+    py::class_<PNGWriteOptions>(m, "PNGWriteOptions")
+        .def(py::init<>())
+        .def_readwrite("bit_depth", &PNGWriteOptions::bit_depth)
+        .def_readwrite("compression_level", &PNGWriteOptions::compression_level)
+        .def_readwrite("filters", &PNGWriteOptions::filters);
+
+    py::enum_<EdgeOperator>(m, "EdgeOperator")
+        .value("EDGE_SOBEL", EdgeOperator::EDGE_SOBEL)
+        .value("EDGE_SOBEL_FELDMAN", EdgeOperator::EDGE_SOBEL_FELDMAN)
+        .value("EDGE_SCHARR", EdgeOperator::EDGE_SCHARR)
+        .value("EDGE_SOBEL_LARGE", EdgeOperator::EDGE_SOBEL_LARGE)
+        .export_values();
+
+    // Images export their planes through the buffer protocol, as get_image_buffer describes.
+    py::class_<Image>(m, "Image", py::buffer_protocol())
         .def(py::init<ssize_t, ssize_t, ColorSpace>())
         .def(py::init<const Image&>())
+        .def(py::init(&wrap_buffer),
+             "Wraps the pixels of a float32 buffer, such as a NumPy array, of shape (channels, height, width) "
+             "without copying them.",
+             py::arg("data"),
+             py::arg("color_space"))
+        .def(py::init([](const LazyImage& e) {
+             return e.eval();
+        }), release_gil())
         .def("width", &Image::width)
         .def("height", &Image::height)
         .def("color_space", &Image::colorSpace)
-        .def("to_RGB", &Image::to_RGB)
-        .def("to_YCbCr", &Image::to_YCbCr)
-        .def("to_gray", &Image::to_gray)
-        .def("convolve", &Image::convolve)
-        .def("__mul__", [](const Image& im1, const Image& im2){
-             return im1 * im2;
-        }, py::is_operator())
-        .def("__add__", [](const Image& im1, const Image& im2){
-             return im1 + im2;
-        }, py::is_operator())
+        .def("to_RGB", &Image::to_RGB,
+             py::arg("precision") = COLOR_FLOAT,
+             release_gil())
+        .def("to_YCbCr", &Image::to_YCbCr,
+             py::arg("precision") = COLOR_FLOAT,
+             release_gil())
+        .def("to_gray", &Image::to_gray,
+             py::arg("precision") = COLOR_FLOAT,
+             release_gil())
+        .def("convolve", &Image::convolve,
+             release_gil())
+        // arithmetic returns a LazyImage, which keeps the images it refers to alive.
+        .def("__mul__", [](const Image& im, const LazyImage& e){
+             return LazyImage(im) * e;
+        }, py::is_operator(), py::keep_alive<0, 1>(), py::keep_alive<0, 2>())
+        .def("__add__", [](const Image& im, const LazyImage& e){
+             return LazyImage(im) + e;
+        }, py::is_operator(), py::keep_alive<0, 1>(), py::keep_alive<0, 2>())
         .def("__mul__", [](const Image& im, float x){
-             return im * x;
-        }, py::is_operator())
+             return LazyImage(im) * x;
+        }, py::is_operator(), py::keep_alive<0, 1>())
         .def("__add__", [](const Image& im, float x){
-             return im + x;
-        }, py::is_operator())
-        .def("__pow__", [](Image& im, float p){
-             return pow(im, p);
-        })
+             return LazyImage(im) + x;
+        }, py::is_operator(), py::keep_alive<0, 1>())
+        .def("__pow__", [](const Image& im, float p){
+             return pow(LazyImage(im), p);
+        }, py::is_operator(), py::keep_alive<0, 1>())
+        // compound assignment, and assigning an expression with assign(), evaluate in place.
+        .def("__imul__", [](Image& im, const LazyImage& e) -> Image& {
+             (LazyImage(im) * e).eval(im);
+             return im;
+        }, py::is_operator(), release_gil())
+        .def("__iadd__", [](Image& im, const LazyImage& e) -> Image& {
+             (LazyImage(im) + e).eval(im);
+             return im;
+        }, py::is_operator(), release_gil())
+        .def("__imul__", [](Image& im, float x) -> Image& {
+             return im *= x;
+        }, py::is_operator(), release_gil())
+        .def("__iadd__", [](Image& im, float x) -> Image& {
+             return im += x;
+        }, py::is_operator(), release_gil())
+        .def("assign", [](Image& im, const LazyImage& e) -> Image& {
+             e.eval(im);
+             return im;
+        }, py::arg("e"), release_gil())
         .def("gaussian_blur_naive", &Image::gaussian_blur_naive,
              py::arg("std_dev"),
-             py::arg("size_f"))
+             py::arg("size_f"),
+             release_gil())
         .def("gaussian_blur", &Image::gaussian_blur,
              py::arg("std_dev"),
-             py::arg("size_f"))
+             py::arg("size_f"),
+             py::arg("method") = BLUR_AUTO,
+             release_gil())
         .def("box_blur", &Image::box_blur,
-             py::arg("size_f"))
+             py::arg("size_f"),
+             release_gil())
+        .def("fast_gaussian_blur", &Image::fast_gaussian_blur,
+             py::arg("std_dev"),
+             py::arg("passes") = 3,
+             release_gil())
         .def("canny_edge_detect", &Image::canny_edge_detect,
              py::arg("blur_std_dev") = 1.4f,
              py::arg("blur_size_f") = 2,
              py::arg("upper_threshold") = 76.8,
-             py::arg("lower_threshold") = 25.6)
+             py::arg("lower_threshold") = 25.6,
+             py::arg("edge_operator") = EDGE_SOBEL,
+             release_gil())
         .def("writeJPEG", &Image::writeJPEG,
              py::arg("fname"),
+             py::arg("quality") = 100,
+             release_gil())
+        .def("encodeJPEG", [](const Image& im, int quality){
+             std::vector<unsigned char> data;
+             {
+                 py::gil_scoped_release release;
+                 data = im.encodeJPEG(quality);
+             }
+             return to_bytes(data);
+        }, "Encodes the Image as a JPEG, returned as bytes.",
              py::arg("quality") = 100)
+        .def("writePNG", &Image::writePNG,
+             py::arg("fname"),
+             py::arg("options") = PNGWriteOptions(),
+             release_gil())
+        .def("encodePNG", [](const Image& im, const PNGWriteOptions& options){
+             std::vector<unsigned char> data;
+             {
+                 py::gil_scoped_release release;
+                 data = im.encodePNG(options);
+             }
+             return to_bytes(data);
+        }, "Encodes the Image as a PNG, returned as bytes.",
+             py::arg("options") = PNGWriteOptions())
+        // Asynchronous variants of the operations above, which run them in the background and return a
+        //     concurrent.futures.Future. Those changing the image give it as their result, once they have finished;
+        //     the image must not be used until then.
+        .def("to_RGB_async", [](py::object self, ColorPrecision precision){
+             Image *im = &self.cast<Image&>();
+             return run_async(self, [im, precision] {
+                 im->to_RGB(precision);
+                 return async_self();
+             });
+        }, py::arg("precision") = COLOR_FLOAT)
+        .def("to_YCbCr_async", [](py::object self, ColorPrecision precision){
+             Image *im = &self.cast<Image&>();
+             return run_async(self, [im, precision] {
+                 im->to_YCbCr(precision);
+                 return async_self();
+             });
+        }, py::arg("precision") = COLOR_FLOAT)
+        .def("to_gray_async", [](py::object self, ColorPrecision precision){
+             Image *im = &self.cast<Image&>();
+             return run_async(self, [im, precision] {
+                 im->to_gray(precision);
+                 return async_self();
+             });
+        }, py::arg("precision") = COLOR_FLOAT)
+        .def("convolve_async", [](py::object self, const Kernel& kern){
+             Image *im = &self.cast<Image&>();
+             return run_async(self, [im, kern] {
+                 im->convolve(kern);
+                 return async_self();
+             });
+        }, py::arg("kern"))
+        .def("gaussian_blur_async", [](py::object self, float std_dev, ssize_t size_f, BlurMethod method){
+             Image *im = &self.cast<Image&>();
+             return run_async(self, [im, std_dev, size_f, method] {
+                 im->gaussian_blur(std_dev, size_f, method);
+                 return async_self();
+             });
+        }, py::arg("std_dev"),
+           py::arg("size_f"),
+           py::arg("method") = BLUR_AUTO)
+        .def("box_blur_async", [](py::object self, ssize_t size_f){
+             Image *im = &self.cast<Image&>();
+             return run_async(self, [im, size_f] {
+                 im->box_blur(size_f);
+                 return async_self();
+             });
+        }, py::arg("size_f"))
+        .def("fast_gaussian_blur_async", [](py::object self, float std_dev, size_t passes){
+             Image *im = &self.cast<Image&>();
+             return run_async(self, [im, std_dev, passes] {
+                 im->fast_gaussian_blur(std_dev, passes);
+                 return async_self();
+             });
+        }, py::arg("std_dev"),
+           py::arg("passes") = 3)
+        .def("canny_edge_detect_async", [](py::object self, float blur_std_dev, ssize_t blur_size_f,
+                                           float upper_threshold, float lower_threshold, EdgeOperator edge_operator){
+             Image *im = &self.cast<Image&>();
+             return run_async(self, [=] {
+                 im->canny_edge_detect(blur_std_dev, blur_size_f, upper_threshold, lower_threshold, edge_operator);
+                 return async_self();
+             });
+        }, py::arg("blur_std_dev") = 1.4f,
+           py::arg("blur_size_f") = 2,
+           py::arg("upper_threshold") = 76.8,
+           py::arg("lower_threshold") = 25.6,
+           py::arg("edge_operator") = EDGE_SOBEL)
+        .def("writeJPEG_async", [](py::object self, std::string fname, int quality){
+             const Image *im = &self.cast<const Image&>();
+             return run_async(self, [im, fname, quality] {
+                 im->writeJPEG(fname.c_str(), quality);
+                 return async_none();
+             });
+        }, py::arg("fname"),
+           py::arg("quality") = 100)
+        .def("encodeJPEG_async", [](py::object self, int quality){
+             const Image *im = &self.cast<const Image&>();
+             return run_async(self, [im, quality] {
+                 std::shared_ptr<std::vector<unsigned char>> data =
+                     std::make_shared<std::vector<unsigned char>>(im->encodeJPEG(quality));
+                 return AsyncResult([data](py::object) -> py::object { return to_bytes(*data); });
+             });
+        }, py::arg("quality") = 100)
+        .def("writePNG_async", [](py::object self, std::string fname, const PNGWriteOptions& options){
+             const Image *im = &self.cast<const Image&>();
+             return run_async(self, [im, fname, options] {
+                 im->writePNG(fname.c_str(), options);
+                 return async_none();
+             });
+        }, py::arg("fname"),
+           py::arg("options") = PNGWriteOptions())
+        .def("encodePNG_async", [](py::object self, const PNGWriteOptions& options){
+             const Image *im = &self.cast<const Image&>();
+             return run_async(self, [im, options] {
+                 std::shared_ptr<std::vector<unsigned char>> data =
+                     std::make_shared<std::vector<unsigned char>>(im->encodePNG(options));
+                 return AsyncResult([data](py::object) -> py::object { return to_bytes(*data); });
+             });
+        }, py::arg("options") = PNGWriteOptions())
         .def("__str__", &Image::str)
         .def("__repr__", &Image::str)
         .def("dump", &Image::dump);
+    // replaces the slots which py::buffer_protocol() installs, leaving nothing to release but the capsule.
+    PyBufferProcs *image_buffer = ((PyTypeObject *) m.attr("Image").ptr())->tp_as_buffer;
+    image_buffer->bf_getbuffer = get_image_buffer;
+    image_buffer->bf_releasebuffer = nullptr;
+
+    // An elementwise expression of images, which is only computed when eval() is called,
+    //     or when it is passed where an Image is expected.
+    py::class_<LazyImage>(m, "LazyImage")
+        .def(py::init<const Image&>(), py::keep_alive<1, 2>())
+        .def("width", &LazyImage::width)
+        .def("height", &LazyImage::height)
+        .def("color_space", &LazyImage::colorSpace)
+        .def("eval", static_cast<Image (LazyImage::*)() const>(&LazyImage::eval),
+             release_gil())
+        // the expression is kept, and with it the images it refers to, until it has been evaluated.
+        .def("eval_async", [](py::object self){
+             const LazyImage *e = &self.cast<const LazyImage&>();
+             return run_async(self, [e] {
+                 return async_value(e->eval());
+             });
+        })
+        .def("__mul__", [](const LazyImage& e1, const LazyImage& e2){
+             return e1 * e2;
+        }, py::is_operator(), py::keep_alive<0, 1>(), py::keep_alive<0, 2>())
+        .def("__add__", [](const LazyImage& e1, const LazyImage& e2){
+             return e1 + e2;
+        }, py::is_operator(), py::keep_alive<0, 1>(), py::keep_alive<0, 2>())
+        .def("__mul__", [](const LazyImage& e, float x){
+             return e * x;
+        }, py::is_operator(), py::keep_alive<0, 1>())
+        .def("__add__", [](const LazyImage& e, float x){
+             return e + x;
+        }, py::is_operator(), py::keep_alive<0, 1>())
+        .def("__pow__", [](const LazyImage& e, float p){
+             return pow(e, p);
+        }, py::is_operator(), py::keep_alive<0, 1>())
+        .def("__str__", &LazyImage::str)
+        .def("__repr__", &LazyImage::str);
+
+    py::implicitly_convertible<Image, LazyImage>();
+    py::implicitly_convertible<LazyImage, Image>();
+
+    m.def("sqrt",
+          [](const LazyImage& e) {
+              return sqrt(e);
+          },
+          "The elementwise square root of an Image or LazyImage.",
+          py::arg("x"),
+          py::keep_alive<0, 1>());
+    m.def("atan2",
+          [](const LazyImage& e1, const LazyImage& e2) {
+              return atan2(e1, e2);
+          },
+          "The elementwise arc tangent of y / x, for Images or LazyImages y and x.",
+          py::arg("y"),
+          py::arg("x"),
+          py::keep_alive<0, 1>(),
+          py::keep_alive<0, 2>());
+
+    py::class_<JPEGReadOptions>(m, "JPEGReadOptions")
+        .def(py::init<>())
+        .def_readwrite("convert", &JPEGReadOptions::convert)
+        .def_readwrite("color_space", &JPEGReadOptions::color_space)
+        .def_readwrite("raw", &JPEGReadOptions::raw)
+        .def_readwrite("scale_num", &JPEGReadOptions::scale_num)
+        .def_readwrite("scale_denom", &JPEGReadOptions::scale_denom)
+        .def_readwrite("min_width", &JPEGReadOptions::min_width)
+        .def_readwrite("min_height", &JPEGReadOptions::min_height);
 
     m.def("readJPEG",
           &Image::readJPEG,
           "A function which reads a JPEG into memory and wraps the pixel data in an Image object.",
+          py::arg("fname"),
+          py::arg("options") = JPEGReadOptions(),
+          release_gil());
+    m.def("decodeJPEG",
+          [](py::buffer data, const JPEGReadOptions& options){
+              py::buffer_info info = request_bytes(data);
+              py::gil_scoped_release release;
+              return Image::decodeJPEG((const unsigned char *) info.ptr, info.size * info.itemsize, options);
+          },
+          "Decodes a JPEG held in memory, such as bytes, as readJPEG decodes a file.",
+          py::arg("data"),
+          py::arg("options") = JPEGReadOptions());
+    m.def("readJPEGPlanes",
+          &Image::readJPEGPlanes,
+          "Reads the components of a YCbCr or grayscale JPEG as they are stored in the file, as a list of "
+          "gray Images. Subsampled components are left subsampled.",
+          py::arg("fname"),
+          release_gil());
+    m.def("readJPEG_async",
+          [](std::string fname, const JPEGReadOptions& options){
+              return run_async(py::none(), [fname, options] {
+                  return async_value(Image::readJPEG(fname.c_str(), options));
+              });
+          },
+          "Reads a JPEG as readJPEG does, in the background, returning a concurrent.futures.Future of the Image.",
+          py::arg("fname"),
+          py::arg("options") = JPEGReadOptions());
+    m.def("decodeJPEG_async",
+          [](py::buffer data, const JPEGReadOptions& options){
+              std::shared_ptr<py::buffer_info> info = hold_buffer(request_bytes(data));
+              return run_async(py::none(), [info, options] {
+                  return async_value(Image::decodeJPEG((const unsigned char *) info->ptr,
+                                                       info->size * info->itemsize,
+                                                       options));
+              });
+          },
+          "Decodes a JPEG as decodeJPEG does, in the background, returning a concurrent.futures.Future of the Image.",
+          py::arg("data"),
+          py::arg("options") = JPEGReadOptions());
+    m.def("readJPEGPlanes_async",
+          [](std::string fname){
+              return run_async(py::none(), [fname] {
+                  return async_value(Image::readJPEGPlanes(fname.c_str()));
+              });
+          },
+          "Reads the components of a JPEG as readJPEGPlanes does, in the background, returning a "
+          "concurrent.futures.Future of the list of Images.",
           py::arg("fname"));
+
+    // registered after JPEGReadOptions, which readJPEG takes as a default argument.
+    // The samples are exported with the buffer protocol as uint8, uint16, float16 or float32.
+    py::class_<PackedImage>(m, "PackedImage", py::buffer_protocol())
+        .def(py::init<const Image&, SampleType>(),
+             "Packs the pixels of an Image into samples of the given type.",
+             py::arg("im"),
+             py::arg("sample_type") = SAMPLE_U8,
+             release_gil())
+        .def_buffer([](PackedImage& im) {
+             static const char *formats[] = { "B", "H", "e", "f" };
+             ssize_t size = sample_size(im.sampleType());
+             return py::buffer_info(im.samples(),
+                                    size,
+                                    formats[im.sampleType()],
+                                    3,
+                                    { (ssize_t) im.channels().size(), im.height(), im.width() },
+                                    { im.plane_stride(), im.row_stride(), size });
+        })
+        .def("width", &PackedImage::width)
+        .def("height", &PackedImage::height)
+        .def("color_space", &PackedImage::colorSpace)
+        .def("sample_type", &PackedImage::sampleType)
+        .def("nbytes", &PackedImage::bytes)
+        .def("unpack", static_cast<Image (PackedImage::*)() const>(&PackedImage::unpack),
+             release_gil())
+        .def_static("readJPEG", &PackedImage::readJPEG,
+                    "Reads a JPEG as readJPEG does, packing it a band of rows at a time.",
+                    py::arg("fname"),
+                    py::arg("sample_type") = SAMPLE_U8,
+                    py::arg("options") = JPEGReadOptions(),
+                    release_gil())
+        .def("writeJPEG", &PackedImage::writeJPEG,
+             py::arg("fname"),
+             py::arg("quality") = 100,
+             release_gil())
+        .def("__str__", &PackedImage::str);
+
+    // registered after JPEGReadOptions, which run() takes as a default argument.
+    // Operations return the pipeline itself, so that they can be chained.
+    py::class_<Pipeline>(m, "Pipeline")
+        .def(py::init<>())
+        .def("to_RGB", &Pipeline::to_RGB,
+             py::arg("precision") = COLOR_FLOAT,
+             py::return_value_policy::reference_internal)
+        .def("to_YCbCr", &Pipeline::to_YCbCr,
+             py::arg("precision") = COLOR_FLOAT,
+             py::return_value_policy::reference_internal)
+        .def("to_gray", &Pipeline::to_gray,
+             py::arg("precision") = COLOR_FLOAT,
+             py::return_value_policy::reference_internal)
+        .def("add", &Pipeline::add,
+             py::arg("y"),
+             py::return_value_policy::reference_internal)
+        .def("multiply", &Pipeline::multiply,
+             py::arg("y"),
+             py::return_value_policy::reference_internal)
+        .def("pow", &Pipeline::pow,
+             py::arg("p"),
+             py::return_value_policy::reference_internal)
+        .def("convolve", &Pipeline::convolve,
+             py::arg("kern"),
+             py::return_value_policy::reference_internal)
+        .def("gaussian_blur", &Pipeline::gaussian_blur,
+             py::arg("std_dev"),
+             py::arg("size_f"),
+             py::return_value_policy::reference_internal)
+        .def("box_blur", &Pipeline::box_blur,
+             py::arg("size_f"),
+             py::return_value_policy::reference_internal)
+        .def("fast_gaussian_blur", &Pipeline::fast_gaussian_blur,
+             py::arg("std_dev"),
+             py::arg("passes") = 3,
+             py::return_value_policy::reference_internal)
+        .def("canny_edge_detect", &Pipeline::canny_edge_detect,
+             py::arg("blur_std_dev") = 1.4f,
+             py::arg("blur_size_f") = 2,
+             py::arg("upper_threshold") = 76.8,
+             py::arg("lower_threshold") = 25.6,
+             py::arg("edge_operator") = EDGE_SOBEL,
+             py::arg("lookahead") = 64,
+             py::return_value_policy::reference_internal)
+        .def("run", &Pipeline::run,
+             "Applies the operations to the JPEG in_fname as it is decoded, writing the result to the JPEG out_fname.",
+             py::arg("in_fname"),
+             py::arg("out_fname"),
+             py::arg("quality") = 100,
+             py::arg("options") = JPEGReadOptions(),
+             release_gil())
+        .def("run_async", [](py::object self, std::string in_fname, std::string out_fname, int quality,
+                             const JPEGReadOptions& options){
+             const Pipeline *pipeline = &self.cast<const Pipeline&>();
+             return run_async(self, [pipeline, in_fname, out_fname, quality, options] {
+                 pipeline->run(in_fname.c_str(), out_fname.c_str(), quality, options);
+                 return async_none();
+             });
+        }, "Runs the pipeline in the background, returning a concurrent.futures.Future which is done once it has "
+           "finished.",
+           py::arg("in_fname"),
+           py::arg("out_fname"),
+           py::arg("quality") = 100,
+           py::arg("options") = JPEGReadOptions())
+        .def("apply", static_cast<Image (Pipeline::*)(const Image&) const>(&Pipeline::apply),
+             "Applies the operations to im tile by tile, returning the result.",
+             py::arg("im"),
+             release_gil())
+        .def("apply", static_cast<PackedImage (Pipeline::*)(const PackedImage&) const>(&Pipeline::apply),
+             "Applies the operations to im tile by tile, returning the result packed as im is.",
+             py::arg("im"),
+             release_gil())
+        // the pipeline and the image are kept until the result has been computed.
+        .def("apply_async", [](py::object self, py::object im){
+             const Pipeline *pipeline = &self.cast<const Pipeline&>();
+             if (py::isinstance<PackedImage>(im)) {
+                 const PackedImage *src = &im.cast<const PackedImage&>();
+                 return run_async(py::make_tuple(self, im), [pipeline, src] {
+                     return async_value(pipeline->apply(*src));
+                 });
+             }
+             const Image *src = &im.cast<const Image&>();
+             return run_async(py::make_tuple(self, im), [pipeline, src] {
+                 return async_value(pipeline->apply(*src));
+             });
+        }, py::arg("im"));
+
+    py::class_<BatchResult>(m, "BatchResult")
+        .def_readonly("path", &BatchResult::path)
+        .def_readonly("output", &BatchResult::output)
+        .def_readonly("seconds", &BatchResult::seconds)
+        .def_readonly("ok", &BatchResult::ok)
+        .def_readonly("error", &BatchResult::error)
+        .def("__repr__", [](const BatchResult& r) {
+             return "BatchResult { " + r.path + " -> " + r.output + ": " +
+                    (r.ok ? "ok" : "failed, " + r.error) + ", " + std::to_string(r.seconds) + " s }";
+        });
+
+    m.def("process_batch",
+          &process_batch,
+          "Runs pipeline on each JPEG of paths in parallel, writing the results to out_dir, and returns a BatchResult "
+          "for each of them. Errors are reported in the results rather than raised. Pipelines with canny_edge_detect "
+          "are applied to whole images, as by apply(), since run() only follows edges within the lookahead.",
+          py::arg("paths"),
+          py::arg("pipeline"),
+          py::arg("out_dir"),
+          py::arg("threads") = 0,
+          py::arg("quality") = 100,
+          py::arg("options") = JPEGReadOptions(),
+          release_gil());
+    m.def("process_batch_async",
+          [](std::vector<std::string> paths, py::object pipeline, std::string out_dir, size_t threads, int quality,
+             const JPEGReadOptions& options){
+              const Pipeline *p = &pipeline.cast<const Pipeline&>();
+              return run_async(pipeline, [paths, p, out_dir, threads, quality, options] {
+                  return async_value(process_batch(paths, *p, out_dir, threads, quality, options));
+              });
+          },
+          "Runs process_batch in the background, returning a concurrent.futures.Future of its results.",
+          py::arg("paths"),
+          py::arg("pipeline"),
+          py::arg("out_dir"),
+          py::arg("threads") = 0,
+          py::arg("quality") = 100,
+          py::arg("options") = JPEGReadOptions());
+
+    m.def("readPNG",
+          &Image::readPNG,
+          "Reads a PNG into a gray, RGB or RGBA Image.",
+          py::arg("fname"),
+          release_gil());
+    m.def("decodePNG",
+          [](py::buffer data){
+              py::buffer_info info = request_bytes(data);
+              py::gil_scoped_release release;
+              return Image::decodePNG((const unsigned char *) info.ptr, info.size * info.itemsize);
+          },
+          "Decodes a PNG held in memory, such as bytes, as readPNG decodes a file.",
+          py::arg("data"));
+    m.def("readPNG_async",
+          [](std::string fname){
+              return run_async(py::none(), [fname] {
+                  return async_value(Image::readPNG(fname.c_str()));
+              });
+          },
+          "Reads a PNG as readPNG does, in the background, returning a concurrent.futures.Future of the Image.",
+          py::arg("fname"));
+    m.def("decodePNG_async",
+          [](py::buffer data){
+              std::shared_ptr<py::buffer_info> info = hold_buffer(request_bytes(data));
+              return run_async(py::none(), [info] {
+                  return async_value(Image::decodePNG((const unsigned char *) info->ptr,
+                                                      info->size * info->itemsize));
+              });
+          },
+          "Decodes a PNG as decodePNG does, in the background, returning a concurrent.futures.Future of the Image.",
+          py::arg("data"));
+
+    m.def("set_num_threads",
+          [](size_t n) {
+              ThreadPool::instance().set_num_threads(n);
+          },
+          "Sets the number of threads used by image operations. 1 disables multithreading. Waits for the operations "
+          "running on other threads to finish first.",
+          py::arg("n"),
+          release_gil());
+    m.def("get_num_threads",
+          []() {
+              return ThreadPool::instance().num_threads();
+          },
+          "Returns the number of threads used by image operations.");
+
+    py::class_<PlanePoolStats>(m, "PlanePoolStats")
+        .def_readonly("hits", &PlanePoolStats::hits)
+        .def_readonly("misses", &PlanePoolStats::misses)
+        .def_readonly("cached", &PlanePoolStats::cached)
+        .def_readonly("discarded", &PlanePoolStats::discarded)
+        .def_readonly("cached_bytes", &PlanePoolStats::cached_bytes)
+        .def("__repr__", [](const PlanePoolStats& s) {
+             return "PlanePoolStats { hits: " + std::to_string(s.hits) + ", misses: " + std::to_string(s.misses) +
+                    ", cached: " + std::to_string(s.cached) + ", discarded: " + std::to_string(s.discarded) +
+                    ", cached_bytes: " + std::to_string(s.cached_bytes) + " }";
+        });
+
+    m.def("plane_pool_stats", &plane_pool_stats,
+          "Returns the counts of allocations served by the plane pool and by the system.");
+    m.def("reset_plane_pool_stats", &reset_plane_pool_stats);
+    m.def("get_plane_pool_capacity", &plane_pool_capacity,
+          "Returns the most bytes which the plane pool keeps for reuse.");
+    m.def("set_plane_pool_capacity", &set_plane_pool_capacity,
+          "Sets the most bytes which the plane pool keeps for reuse. 0 disables the pool.",
+          py::arg("bytes"));
+    m.def("trim_plane_pool", &trim_plane_pool,
+          "Frees the memory kept by the plane pool.");
 }
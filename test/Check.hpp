@@ -0,0 +1,148 @@
+#ifndef __CHECK_H_
+#define __CHECK_H_
+
+// Helpers shared by the checks in test/, each of which is an executable run by ctest.
+// Checks report every failure on stdout, and main returns check_status(), so the executable exits with status 1
+//     if any failed.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Image.hpp"
+
+static int failures = 0;
+
+static inline
+int
+check_status()
+{
+    return failures ? 1 : 0;
+}
+
+static inline
+uint32_t
+hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// n floats in [lo, hi), the same for the same seed.
+static inline
+std::vector<float>
+random_floats(size_t n,
+              uint32_t seed,
+              float lo,
+              float hi)
+{
+    std::vector<float> v(n);
+    for (size_t i = 0; i < n; i++)
+        v[i] = lo + (hi - lo) * (hash(seed * 2654435761u + i) >> 8) / 16777216.0f;
+    return v;
+}
+
+// a w x h image in c_space, whose pixels are random floats in [lo, hi).
+static inline
+Image
+random_image(ssize_t w,
+             ssize_t h,
+             ColorSpace c_space,
+             uint32_t seed,
+             float lo=0.0f,
+             float hi=255.0f)
+{
+    Image im(w, h, c_space);
+    const std::vector<ChannelType>& chs = im.buffer().channels();
+    std::vector<float> v = random_floats(w * h * chs.size(), seed, lo, hi);
+    for (size_t k = 0; k < chs.size(); k++)
+        for (ssize_t j = 0; j < h; j++)
+            std::copy(v.begin() + w * (h * k + j), v.begin() + w * (h * k + j + 1), im.buffer().row(chs[k], j));
+    return im;
+}
+
+// the pixels of every plane of im, plane by plane and row by row, without the padding of the rows.
+static inline
+std::vector<float>
+pixels(const Image& im)
+{
+    std::vector<float> v;
+    const std::vector<ChannelType>& chs = im.buffer().channels();
+    for (auto ch = chs.begin(); ch != chs.end(); ++ch)
+        for (ssize_t j = 0; j < im.height(); j++)
+            v.insert(v.end(), im.buffer().row(*ch, j), im.buffer().row(*ch, j) + im.width());
+    return v;
+}
+
+// checks that actual holds exactly the same floats as expected, bit for bit.
+static inline
+void
+expect_same(const std::string& name,
+            const std::vector<float>& expected,
+            const std::vector<float>& actual)
+{
+    if (expected.size() != actual.size()) {
+        printf("FAIL %s: %zu floats instead of %zu\n", name.c_str(), actual.size(), expected.size());
+        failures++;
+        return;
+    }
+    if (!memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)))
+        return;
+
+    size_t n = 0, first = expected.size();
+    for (size_t i = 0; i < expected.size(); i++) {
+        if (memcmp(&expected[i], &actual[i], sizeof(float))) {
+            first = std::min(first, i);
+            n++;
+        }
+    }
+    printf("FAIL %s: %zu of %zu floats differ, the first at %zu: %.9g instead of %.9g\n", name.c_str(),
+           n, expected.size(), first, actual[first], expected[first]);
+    failures++;
+}
+
+// checks that no float of actual is more than max_error from expected, and that they differ by at most mean_error on
+//      average.
+template <class T>
+static inline
+void
+expect_close(const std::string& name,
+             const std::vector<T>& expected,
+             const std::vector<float>& actual,
+             double max_error,
+             double mean_error=INFINITY)
+{
+    if (expected.size() != actual.size()) {
+        printf("FAIL %s: %zu floats instead of %zu\n", name.c_str(), actual.size(), expected.size());
+        failures++;
+        return;
+    }
+
+    double max = 0.0, sum = 0.0;
+    size_t worst = 0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        double d = std::fabs((double) actual[i] - (double) expected[i]);
+        // NaNs are never close to anything.
+        if (!(d <= max)) {
+            max = std::isnan(d) ? INFINITY : d;
+            worst = i;
+        }
+        sum += d;
+    }
+    double mean = expected.empty() ? 0.0 : sum / expected.size();
+    if (max <= max_error && mean <= mean_error)
+        return;
+
+    printf("FAIL %s: differs by up to %.6g, at %zu (%.9g instead of %.9g), and by %.6g on average\n",
+           name.c_str(), max, worst, actual[worst], (double) expected[worst], mean);
+    failures++;
+}
+
+#endif // __CHECK_H_
@@ -1,4 +1,4 @@
-#!/usr/bin/env python2
+#!/usr/bin/env python3
 
 import sys
 sys.path.append("..") # Adds higher directory to python modules path.
@@ -0,0 +1,156 @@
+// Checks the edge tracking of canny_edge_detect against a flood fill from the strong pixels, and that
+//      canny_edge_detect gives the same edges as its steps applied one by one, whatever the number of threads.
+// Exits with status 1, listing the checks which fail, if any do.
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "Check.hpp"
+#include "Image.hpp"
+#include "ThreadPool.hpp"
+#include "EdgeDetect.hpp"
+#include "Hysteresis.hpp"
+
+#define STRONG 255.0f
+#define WEAK 127.5f
+
+// The hysteresis of the w x h plane, as Hysteresis.hpp defines it, by a flood fill from every strong pixel through
+//      the 8 neighbours of each pixel reached.
+static
+std::vector<float>
+flood_fill(const std::vector<float>& plane,
+           ssize_t w,
+           ssize_t h,
+           float strong)
+{
+    std::vector<float> out(w * h, 0.0f);
+    std::vector<ssize_t> stack;
+    for (ssize_t k = 0; k < w * h; k++) {
+        if (plane[k] == strong) {
+            out[k] = strong;
+            stack.push_back(k);
+        }
+    }
+
+    while (!stack.empty()) {
+        ssize_t k = stack.back();
+        stack.pop_back();
+        ssize_t i = k % w, j = k / w;
+        for (ssize_t dj = -1; dj <= 1; dj++)
+            for (ssize_t di = -1; di <= 1; di++) {
+                ssize_t x = i + di, y = j + dj;
+                if (x < 0 || x >= w || y < 0 || y >= h)
+                    continue;
+                ssize_t n = w * y + x;
+                if (plane[n] != 0.0f && out[n] == 0.0f) {
+                    out[n] = strong;
+                    stack.push_back(n);
+                }
+            }
+    }
+    return out;
+}
+
+// Calls op with 1, 3 and 8 threads, checking that the floats it returns are the same, and returns them.
+static
+std::vector<float>
+same_for_any_threads(const std::string& name,
+                     const std::function<std::vector<float>()>& op)
+{
+    ThreadPool& pool = ThreadPool::instance();
+    size_t n_threads = pool.num_threads();
+
+    std::vector<float> single;
+    const size_t thread_counts[] = { 1, 3, 8 };
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        pool.set_num_threads(thread_counts[t]);
+        std::vector<float> out = op();
+        if (t == 0)
+            single = out;
+        else
+            expect_same(name + " with " + std::to_string(thread_counts[t]) + " threads", single, out);
+    }
+
+    pool.set_num_threads(n_threads);
+    return single;
+}
+
+// Tracks edges in a w x h plane, each pixel of which is strong with probability p_strong, else weak with
+//      probability p_weak, else 0. Weak pixels around the percolation threshold of 0.41 form long winding chains,
+//      which cross the seams between the bands of the labeling many times.
+static
+void
+check_hysteresis(ssize_t w,
+                 ssize_t h,
+                 float p_strong,
+                 float p_weak,
+                 uint32_t seed)
+{
+    std::vector<float> plane = random_floats(w * h, seed, 0.0f, 1.0f);
+    for (auto it = plane.begin(); it != plane.end(); ++it)
+        *it = *it < p_strong ? STRONG : *it < p_strong + p_weak ? WEAK : 0.0f;
+
+    std::string name = "hysteresis " + std::to_string(w) + "x" + std::to_string(h) + " weak " +
+                       std::to_string(p_weak).substr(0, 4);
+    std::vector<float> out = same_for_any_threads(name, [&]() {
+        // rows are padded, so that the stride is checked too.
+        ssize_t stride = w + 5;
+        std::vector<float> padded(stride * h, 0.0f);
+        for (ssize_t j = 0; j < h; j++)
+            std::copy(plane.begin() + w * j, plane.begin() + w * (j + 1), padded.begin() + stride * j);
+        hysteresis(padded.data(), stride, w, h, STRONG);
+
+        std::vector<float> unpadded(w * h);
+        for (ssize_t j = 0; j < h; j++)
+            std::copy(padded.begin() + stride * j, padded.begin() + stride * j + w, unpadded.begin() + w * j);
+        return unpadded;
+    });
+    expect_same(name, flood_fill(plane, w, h, STRONG), out);
+}
+
+// canny_edge_detect against its steps, the last of which is done by flood_fill.
+static
+void
+check_canny(const std::string& name,
+            const Image& im,
+            EdgeOperator edge_operator)
+{
+    std::vector<float> edges = same_for_any_threads(name, [&]() {
+        Image out = im;
+        out.canny_edge_detect(1.4f, 2, 76.8f, 25.6f, edge_operator);
+        return pixels(out);
+    });
+
+    Image blurred = im;
+    blurred.to_gray();
+    blurred.gaussian_blur(1.4f, 2);
+    ssize_t w = im.width(), h = im.height();
+    std::vector<float> thresholded(w * h);
+    canny_gradient(blurred.buffer().plane(INTENSITY), blurred.buffer().stride(),
+                   thresholded.data(), w,
+                   w, h, edge_operator, 76.8f, 25.6f, Image::get_max_intensity());
+    expect_same(name, flood_fill(thresholded, w, h, Image::get_max_intensity()), edges);
+}
+
+int
+main()
+{
+    const float weak[] = { 0.2f, 0.4f, 0.6f };
+    for (size_t k = 0; k < sizeof(weak) / sizeof(weak[0]); k++) {
+        check_hysteresis(301, 203, 0.002f, weak[k], 1 + k);
+        check_hysteresis(7, 1001, 0.002f, weak[k], 11 + k);
+        check_hysteresis(1001, 7, 0.002f, weak[k], 21 + k);
+    }
+    check_hysteresis(64, 64, 0.0f, 0.5f, 31);
+    check_hysteresis(1, 1, 1.0f, 0.0f, 32);
+
+    const EdgeOperator operators[] = { EDGE_SOBEL, EDGE_SOBEL_FELDMAN, EDGE_SCHARR, EDGE_SOBEL_LARGE };
+    const char *operator_names[] = { "sobel", "sobel feldman", "scharr", "sobel large" };
+    Image photo = Image::readJPEG(FOURIER_TEST_IMAGES "/tiger.jpeg");
+    for (size_t k = 0; k < sizeof(operators) / sizeof(operators[0]); k++)
+        check_canny(std::string("canny_edge_detect ") + operator_names[k] + " tiger.jpeg", photo, operators[k]);
+    check_canny("canny_edge_detect noise", random_image(203, 157, RGB, 41), EDGE_SOBEL);
+
+    printf("edge detection checked\n");
+    return check_status();
+}
@@ -0,0 +1,343 @@
+// Checks the codecs and process_batch:
+//  * PNGs written and read back, at 8 bits exactly and at 16 bits to within their precision, from files and memory,
+//  * JPEGs encoded and decoded in memory against the same JPEGs written to and read from files,
+//  * process_batch against Pipeline::run applied to each image, or against canny_edge_detect applied to the whole
+//    image for pipelines with a global stage, its refusal to overwrite its inputs, and the outputs it leaves as they
+//    were when an image fails.
+// Files are written to a temporary directory, which is removed afterwards.
+// Exits with status 1, listing the checks which fail, if any do.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "Check.hpp"
+#include "Image.hpp"
+#include "Pipeline.hpp"
+#include "Batch.hpp"
+
+static std::vector<std::string> written;
+
+// the path of a file called name in the temporary directory, which is removed by remove_written().
+static
+std::string
+temporary(const std::string& dir,
+          const std::string& name)
+{
+    written.push_back(dir + "/" + name);
+    return written.back();
+}
+
+// removes the files and directories written, the latter being listed after the files in them.
+static
+void
+remove_written(const std::string& dir)
+{
+    for (auto it = written.begin(); it != written.end(); ++it)
+        if (unlink(it->c_str()))
+            rmdir(it->c_str());
+    rmdir(dir.c_str());
+}
+
+static
+void
+mkdir_or_fail(const std::string& dir)
+{
+    if (mkdir(dir.c_str(), 0700))
+        throw std::runtime_error("Cannot create " + dir);
+}
+
+static
+std::vector<unsigned char>
+read_file(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<unsigned char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// the number of files in dir.
+static
+size_t
+directory_size(const std::string& dir)
+{
+    size_t n = 0;
+    DIR *d = opendir(dir.c_str());
+    for (struct dirent *e = d ? readdir(d) : nullptr; e; e = readdir(d))
+        if (strcmp(e->d_name, ".") && strcmp(e->d_name, ".."))
+            n++;
+    if (d)
+        closedir(d);
+    return n;
+}
+
+static
+void
+expect(const std::string& name,
+       bool ok)
+{
+    if (ok)
+        return;
+    printf("FAIL %s\n", name.c_str());
+    failures++;
+}
+
+// a w x h image in c_space whose pixels are random integers in [lo, hi].
+static
+Image
+integer_image(ssize_t w,
+              ssize_t h,
+              ColorSpace c_space,
+              uint32_t seed,
+              float lo=0.0f,
+              float hi=255.0f)
+{
+    Image im = random_image(w, h, c_space, seed, lo, hi + 1.0f);
+    const std::vector<ChannelType>& chs = im.buffer().channels();
+    for (auto ch = chs.begin(); ch != chs.end(); ++ch)
+        for (ssize_t j = 0; j < h; j++)
+            for (float *x = im.buffer().row(*ch, j); x < im.buffer().row(*ch, j) + w; x++)
+                *x = std::floor(*x);
+    return im;
+}
+
+// pixels(im) clamped to [0, 255].
+static
+std::vector<float>
+clamped(const Image& im)
+{
+    std::vector<float> v = pixels(im);
+    for (auto it = v.begin(); it != v.end(); ++it)
+        *it = std::min(std::max(*it, 0.0f), 255.0f);
+    return v;
+}
+
+// writes im to a PNG, in memory and to a file, and checks that both read back as expected.
+static
+void
+check_png(const std::string& dir,
+          const std::string& name,
+          const Image& im,
+          ColorSpace read_space,
+          const std::vector<float>& expected,
+          const PNGWriteOptions& options,
+          double max_error)
+{
+    std::string path = temporary(dir, name + ".png");
+    im.writePNG(path.c_str(), options);
+    std::vector<unsigned char> encoded = im.encodePNG(options);
+    expect("encodePNG " + name + " gives the bytes written by writePNG", encoded == read_file(path));
+
+    Image decoded = Image::decodePNG(encoded.data(), encoded.size());
+    Image read = Image::readPNG(path.c_str());
+    expect("decodePNG " + name + " colour space", decoded.colorSpace() == read_space);
+    expect_close("decodePNG " + name, expected, pixels(decoded), max_error);
+    expect_same("readPNG " + name, pixels(decoded), pixels(read));
+}
+
+static
+void
+check_pngs(const std::string& dir)
+{
+    const ssize_t w = 203, h = 157;
+    PNGWriteOptions eight, sixteen, fast;
+    sixteen.bit_depth = 16;
+    fast.compression_level = 1;
+    fast.filters = PNG_FILTERS_FAST;
+
+    const ColorSpace spaces[] = { GRAY, RGB, RGBA };
+    const char *names[] = { "gray", "rgb", "rgba" };
+    for (size_t k = 0; k < sizeof(spaces) / sizeof(spaces[0]); k++) {
+        Image im = integer_image(w, h, spaces[k], 1 + k);
+        check_png(dir, std::string(names[k]) + "8", im, spaces[k], pixels(im), eight, 0.0);
+        check_png(dir, std::string(names[k]) + "8 fast", im, spaces[k], pixels(im), fast, 0.0);
+
+        // 16 bit samples keep fractions to within half of 1 / 257, and pixels beyond [0, 255] are clamped.
+        Image fractions = random_image(w, h, spaces[k], 11 + k, -20.0f, 275.0f);
+        check_png(dir, std::string(names[k]) + "16", fractions, spaces[k], clamped(fractions), sixteen,
+                  0.5 / 257.0 + 1e-4);
+    }
+
+    Image out_of_range = integer_image(w, h, RGB, 21, -20.0f, 275.0f);
+    check_png(dir, "rgb8 clamped", out_of_range, RGB, clamped(out_of_range), eight, 0.0);
+
+    // RGBX images are written as RGB, i.e. their first three planes, and other colour spaces are converted to RGB.
+    Image rgbx = integer_image(w, h, RGBX, 22);
+    std::vector<float> rgb = pixels(rgbx);
+    rgb.resize(3 * w * h);
+    check_png(dir, "rgbx8", rgbx, RGB, rgb, eight, 0.0);
+
+    Image ycbcr = integer_image(w, h, RGB, 23);
+    ycbcr.to_YCbCr();
+    Image converted = ycbcr;
+    converted.to_RGB();
+    check_png(dir, "ycbcr8", ycbcr, RGB, clamped(converted), eight, 1.0);
+
+    const unsigned char garbage[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n', 0, 0, 0, 13, 'I', 'H', 'D', 'R' };
+    bool thrown = false;
+    try {
+        Image::decodePNG(garbage, sizeof(garbage));
+    } catch (std::runtime_error&) {
+        thrown = true;
+    }
+    expect("decodePNG of a truncated PNG throws std::runtime_error", thrown);
+}
+
+// checks that JPEGs encoded in memory are those written to files, and are decoded as they are read.
+static
+void
+check_jpegs(const std::string& dir)
+{
+    Image photo = Image::readJPEG(FOURIER_TEST_IMAGES "/eagle.jpeg");
+    Image gray = photo;
+    gray.to_gray();
+    const Image *images[] = { &photo, &gray };
+    const char *names[] = { "rgb", "gray" };
+
+    for (size_t k = 0; k < sizeof(images) / sizeof(images[0]); k++) {
+        std::string path = temporary(dir, std::string(names[k]) + ".jpeg");
+        images[k]->writeJPEG(path.c_str(), 90);
+        std::vector<unsigned char> encoded = images[k]->encodeJPEG(90);
+        expect(std::string("encodeJPEG ") + names[k] + " gives the bytes written by writeJPEG",
+               encoded == read_file(path));
+
+        JPEGReadOptions options[4];
+        options[1].scale_denom = 4;
+        options[2].convert = true;
+        options[2].color_space = YCbCr;
+        options[3].raw = true;
+        const char *option_names[] = { "", " 1/4", " YCbCr", " raw" };
+        for (size_t o = 0; o < sizeof(options) / sizeof(options[0]); o++) {
+            Image decoded = Image::decodeJPEG(encoded.data(), encoded.size(), options[o]);
+            Image read = Image::readJPEG(path.c_str(), options[o]);
+            std::string name = std::string("decodeJPEG ") + names[k] + option_names[o];
+            expect(name + " colour space", decoded.colorSpace() == read.colorSpace());
+            expect_same(name, pixels(read), pixels(decoded));
+        }
+
+        // JPEG is lossy, but at quality 90 pixels stay close to those written on average.
+        Image decoded = Image::decodeJPEG(encoded.data(), encoded.size());
+        expect_close(std::string("JPEG ") + names[k] + " at quality 90", clamped(*images[k]), pixels(decoded),
+                     255.0, 3.0);
+    }
+
+    bool thrown = false;
+    std::vector<unsigned char> encoded = photo.encodeJPEG(90);
+    try {
+        Image::decodeJPEG(encoded.data(), 100);
+    } catch (std::runtime_error&) {
+        thrown = true;
+    }
+    expect("decodeJPEG of a truncated JPEG throws std::runtime_error", thrown);
+}
+
+// checks process_batch against Pipeline::run, and that it never overwrites its inputs.
+static
+void
+check_batch(const std::string& dir)
+{
+    Pipeline pipeline;
+    pipeline.to_gray().gaussian_blur(1.4f, 2);
+
+    const std::string inputs[] = { FOURIER_TEST_IMAGES "/eagle.jpeg", FOURIER_TEST_IMAGES "/jag.jpeg" };
+    std::vector<std::string> paths(inputs, inputs + 2);
+    paths.push_back(dir + "/missing.jpeg");
+
+    const size_t thread_counts[] = { 0, 1 };
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        std::string out_dir = dir + "/out" + std::to_string(t);
+        mkdir_or_fail(out_dir);
+        std::vector<BatchResult> results = process_batch(paths, pipeline, out_dir, thread_counts[t], 95);
+        std::string name = "process_batch with threads " + std::to_string(thread_counts[t]);
+
+        expect(name + " gives a result per image", results.size() == paths.size());
+        for (size_t k = 0; k < 2 && k < results.size(); k++) {
+            temporary(out_dir, results[k].output.substr(results[k].output.rfind('/') + 1));
+            expect(name + " processes " + paths[k] + ": " + results[k].error, results[k].ok);
+
+            std::string expected = temporary(dir, "expected" + std::to_string(k) + ".jpeg");
+            pipeline.run(paths[k].c_str(), expected.c_str(), 95);
+            expect(name + " writes what Pipeline::run writes for " + paths[k],
+                   read_file(expected) == read_file(results[k].output));
+        }
+        if (results.size() == 3)
+            expect(name + " reports the missing image", !results[2].ok && !results[2].error.empty() &&
+                   access(results[2].output.c_str(), F_OK) != 0);
+        written.push_back(out_dir);
+    }
+
+    // an image whose output is its input fails, leaving it as it was.
+    std::string input = temporary(dir, "input.jpeg");
+    std::vector<unsigned char> original = read_file(inputs[0]);
+    std::ofstream(input, std::ios::binary).write((const char *) original.data(), original.size());
+    std::vector<BatchResult> results = process_batch({ input }, pipeline, dir);
+    expect("process_batch refuses to overwrite its input",
+           results.size() == 1 && !results[0].ok && read_file(input) == original);
+
+    // An image which fails once its output is being written, as a corrupt marker follows the last scan, leaves the
+    //      file which was there before as it was, and no other file behind.
+    std::string corrupt = temporary(dir, "corrupt.jpeg");
+    std::ofstream(corrupt, std::ios::binary).write((const char *) original.data(), original.size() - 2)
+        .write("\xff\xda\x00\x02", 4);
+    std::string out_dir = dir + "/existing";
+    mkdir_or_fail(out_dir);
+    std::string output = temporary(out_dir, "corrupt.jpeg");
+    const std::string earlier = "an earlier output";
+    std::ofstream(output, std::ios::binary) << earlier;
+    results = process_batch({ corrupt }, pipeline, out_dir);
+    expect("process_batch reports an image which fails while it is written", results.size() == 1 && !results[0].ok);
+    expect("process_batch leaves the output there before a failure as it was",
+           read_file(output) == std::vector<unsigned char>(earlier.begin(), earlier.end()));
+    expect("process_batch leaves no other file behind after a failure", directory_size(out_dir) == 1);
+    written.push_back(out_dir);
+}
+
+// checks that process_batch applies a pipeline with canny_edge_detect to the whole image, writing what
+//      canny_edge_detect gives, although run() would only follow edges within the small lookahead.
+static
+void
+check_batch_global(const std::string& dir)
+{
+    Pipeline pipeline;
+    pipeline.canny_edge_detect(1.4f, 2, 76.8f, 25.6f, EDGE_SOBEL, 4);
+    const std::string path = FOURIER_TEST_IMAGES "/tiger.jpeg";
+
+    std::string out_dir = dir + "/global";
+    mkdir_or_fail(out_dir);
+    std::vector<BatchResult> results = process_batch({ path }, pipeline, out_dir, 0, 95);
+    std::string output = temporary(out_dir, "tiger.jpeg");
+    written.push_back(out_dir);
+    expect("process_batch with canny_edge_detect processes tiger.jpeg", results.size() == 1 && results[0].ok);
+
+    Image im = Image::readJPEG(path.c_str());
+    im.canny_edge_detect(1.4f, 2);
+    std::string expected = temporary(dir, "expected_edges.jpeg");
+    im.writeJPEG(expected.c_str(), 95);
+    expect("process_batch with canny_edge_detect writes what canny_edge_detect gives",
+           read_file(expected) == read_file(output));
+}
+
+int
+main()
+{
+    char dir_template[] = "/tmp/fourier_codec_check_XXXXXX";
+    if (!mkdtemp(dir_template)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string dir = dir_template;
+
+    check_pngs(dir);
+    check_jpegs(dir);
+    check_batch(dir);
+    check_batch_global(dir);
+
+    remove_written(dir);
+    printf("codecs checked\n");
+    return check_status();
+}
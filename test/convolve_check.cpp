@@ -0,0 +1,265 @@
+// Checks the ways in which Image applies kernels against a direct convolution computed in double precision:
+//  * the direct, separable and FFT paths of convolve(), with square and non-square kernels,
+//  * the terms of SeparableKernel and FFTConvolver on their own, as convolve() only uses them above some size,
+//  * box_blur against the convolution with a box kernel, gaussian_blur against gaussian_blur_naive, and the
+//    recursive gaussian_blur against the FIR one,
+// and that every one of them gives the same floats whatever the number of threads.
+// Exits with status 1, listing the checks which fail, if any do.
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <functional>
+#include "Check.hpp"
+#include "Image.hpp"
+#include "Kernel.hpp"
+#include "FFT.hpp"
+#include "Separable.hpp"
+#include "ThreadPool.hpp"
+
+// The largest error allowed for the float paths, relative to the largest pixel a kernel can give: the sum of the
+//      absolute values of its elements times 255. Every path stays within about 1e-7 of it for these sizes.
+#define RELATIVE_ERROR 5e-7
+
+// The convolution of the w x h plane src with kern, as Image::convolve defines it: pixels at which the kernel
+//      does not fit in the plane are 0.
+static
+std::vector<double>
+direct_convolution(const std::vector<float>& src,
+                   ssize_t w,
+                   ssize_t h,
+                   const Kernel& kern)
+{
+    ssize_t kern_w_f = kern[0].size() / 2, kern_h_f = kern.size() / 2;
+    std::vector<double> dst(w * h, 0.0);
+    for (ssize_t j = kern_h_f; j < h - kern_h_f; j++)
+        for (ssize_t i = kern_w_f; i < w - kern_w_f; i++) {
+            double sum = 0.0;
+            for (ssize_t n = 0; n < (ssize_t) kern.size(); n++)
+                for (ssize_t m = 0; m < (ssize_t) kern[n].size(); m++)
+                    sum += (double) kern[n][m] * src[w * (j + n - kern_h_f) + i + m - kern_w_f];
+            dst[w * j + i] = sum;
+        }
+    return dst;
+}
+
+static
+double
+max_error(const Kernel& kern)
+{
+    double sum = 0.0;
+    for (auto row = kern.begin(); row != kern.end(); ++row)
+        for (auto it = row->begin(); it != row->end(); ++it)
+            sum += std::fabs(*it);
+    return RELATIVE_ERROR * 255.0 * sum;
+}
+
+// a kern_h x kern_w kernel with random elements in [-1, 1), the same for the same seed.
+static
+Kernel
+random_kernel(ssize_t kern_w,
+              ssize_t kern_h,
+              uint32_t seed)
+{
+    std::vector<float> v = random_floats(kern_w * kern_h, seed, -1.0f, 1.0f);
+    Kernel kern(kern_h, KernelRow(kern_w));
+    for (ssize_t n = 0; n < kern_h; n++)
+        std::copy(v.begin() + kern_w * n, v.begin() + kern_w * (n + 1), kern[n].begin());
+    return kern;
+}
+
+// a kern_h x kern_w kernel of the given rank, as a sum of products of random columns and rows.
+static
+Kernel
+low_rank_kernel(ssize_t kern_w,
+                ssize_t kern_h,
+                size_t rank,
+                uint32_t seed)
+{
+    Kernel kern(kern_h, KernelRow(kern_w, 0.0f));
+    for (size_t t = 0; t < rank; t++) {
+        std::vector<float> column = random_floats(kern_h, seed + 2 * t, -1.0f, 1.0f);
+        std::vector<float> row = random_floats(kern_w, seed + 2 * t + 1, -1.0f, 1.0f);
+        for (ssize_t n = 0; n < kern_h; n++)
+            for (ssize_t m = 0; m < kern_w; m++)
+                kern[n][m] += column[n] * row[m];
+    }
+    return kern;
+}
+
+static
+std::string
+size_name(ssize_t w,
+          ssize_t h)
+{
+    return std::to_string(w) + "x" + std::to_string(h);
+}
+
+// Checks that op gives the same floats with 1, 3 and 8 threads, returning the pixels it gives with 1.
+static
+std::vector<float>
+same_for_any_threads(const std::string& name,
+                     const Image& im,
+                     const std::function<void(Image&)>& op)
+{
+    ThreadPool& pool = ThreadPool::instance();
+    size_t n_threads = pool.num_threads();
+
+    std::vector<float> single;
+    const size_t thread_counts[] = { 1, 3, 8 };
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        pool.set_num_threads(thread_counts[t]);
+        Image out = im;
+        op(out);
+        if (t == 0)
+            single = pixels(out);
+        else
+            expect_same(name + " with " + std::to_string(thread_counts[t]) + " threads", single, pixels(out));
+    }
+
+    pool.set_num_threads(n_threads);
+    return single;
+}
+
+// applies kern with Image::convolve to a w x h gray image.
+static
+void
+check_convolve(const std::string& name,
+               const Kernel& kern,
+               ssize_t w,
+               ssize_t h)
+{
+    Image im = random_image(w, h, GRAY, w * 7 + h);
+    std::vector<float> out = same_for_any_threads(name, im, [&](Image& x) { x.convolve(kern); });
+    expect_close(name, direct_convolution(pixels(im), w, h, kern), out, max_error(kern));
+}
+
+// applies kern with FFTConvolver, and through the terms of its SeparableKernel, whose sum must be kern.
+static
+void
+check_paths(const std::string& name,
+            const Kernel& kern,
+            ssize_t w,
+            ssize_t h)
+{
+    std::vector<float> src = random_floats(w * h, w * 5 + h, 0.0f, 255.0f);
+    std::vector<double> expected = direct_convolution(src, w, h, kern);
+
+    std::vector<float> fft(w * h, -1.0f);
+    FFTConvolver(kern, w, h).convolve(src.data(), w, fft.data(), w);
+    expect_close("FFT " + name, expected, fft, max_error(kern));
+
+    std::shared_ptr<const SeparableKernel> sep = SeparableKernel::get(kern);
+    Kernel sum(kern.size(), KernelRow(kern[0].size(), 0.0f));
+    for (size_t t = 0; t < sep->rank(); t++)
+        for (size_t n = 0; n < kern.size(); n++)
+            for (size_t m = 0; m < kern[0].size(); m++)
+                sum[n][m] += sep->column(t)[n] * sep->row(t)[m];
+    std::vector<double> terms = direct_convolution(src, w, h, sum);
+    expect_close("separable terms " + name, expected, std::vector<float>(terms.begin(), terms.end()),
+                 max_error(kern));
+}
+
+static
+void
+check_rank(const std::string& name,
+           const Kernel& kern,
+           size_t rank)
+{
+    size_t actual = SeparableKernel::get(kern)->rank();
+    if (actual == rank)
+        return;
+    printf("FAIL rank of %s: %zu instead of %zu\n", name.c_str(), actual, rank);
+    failures++;
+}
+
+int
+main()
+{
+    // sizes which are not multiples of any vector width, and which the FFTs have to pad.
+    const ssize_t w = 203, h = 157;
+
+    // small kernels are applied directly, as are single rows and columns, and kernels which are not cheaper
+    //      as separable passes.
+    check_convolve("convolve 3x3", random_kernel(3, 3, 1), w, h);
+    check_convolve("convolve 9x5", random_kernel(9, 5, 2), w, h);
+    check_convolve("convolve 41x1", random_kernel(41, 1, 3), w, h);
+    check_convolve("convolve 1x41", random_kernel(1, 41, 4), w, h);
+    check_convolve("convolve 41x3", random_kernel(41, 3, 5), w, h);
+    check_convolve("convolve 3x41", random_kernel(3, 41, 6), w, h);
+    // kernels of low rank are applied as separable passes.
+    check_convolve("convolve rank 1 15x15", low_rank_kernel(15, 15, 1, 7), w, h);
+    check_convolve("convolve rank 2 21x21", low_rank_kernel(21, 21, 2, 9), w, h);
+    check_convolve("convolve rank 2 45x15", low_rank_kernel(45, 15, 2, 11), w, h);
+    check_convolve("convolve rank 3 17x33", low_rank_kernel(17, 33, 3, 13), w, h);
+    // large kernels of full rank are applied in the frequency domain.
+    check_convolve("convolve 41x41", random_kernel(41, 41, 15), w, h);
+    check_convolve("convolve 61x31", random_kernel(61, 31, 16), w, h);
+    check_convolve("convolve 25x71", random_kernel(25, 71, 17), w, h);
+    check_convolve("gaussian 51x51", GaussianKernel(8.0f, 25), w, h);
+
+    const ssize_t kernel_sizes[][2] = { { 3, 3 }, { 1, 41 }, { 41, 1 }, { 9, 31 }, { 41, 41 }, { 61, 31 } };
+    for (size_t k = 0; k < sizeof(kernel_sizes) / sizeof(kernel_sizes[0]); k++) {
+        ssize_t kw = kernel_sizes[k][0], kh = kernel_sizes[k][1];
+        check_paths(size_name(kw, kh) + " on " + size_name(w, h), random_kernel(kw, kh, 20 + k), w, h);
+        check_paths(size_name(kw, kh) + " on " + size_name(97, 89), random_kernel(kw, kh, 30 + k), 97, 89);
+    }
+    check_rank("rank 1 15x15", low_rank_kernel(15, 15, 1, 7), 1);
+    check_rank("rank 2 45x15", low_rank_kernel(45, 15, 2, 11), 2);
+    check_rank("rank 3 17x33", low_rank_kernel(17, 33, 3, 13), 3);
+    check_rank("gaussian 51x51", GaussianKernel(8.0f, 25), 1);
+
+    // box_blur sums in double precision, and is checked against a convolution with kernels of float taps.
+    Image im = random_image(w, h, RGB, 40);
+    const ssize_t radii[] = { 0, 1, 4, 20 };
+    for (size_t k = 0; k < sizeof(radii) / sizeof(radii[0]); k++) {
+        ssize_t r = radii[k];
+        std::string name = "box_blur " + std::to_string(r);
+        std::vector<float> out = same_for_any_threads(name, im, [r](Image& x) { x.box_blur(r); });
+        Image box = im;
+        box.convolve(Kernel(1, KernelRow(2 * r + 1, 1.0f / (2 * r + 1))));
+        box.convolve(Kernel(2 * r + 1, KernelRow(1, 1.0f / (2 * r + 1))));
+        expect_close(name, pixels(box), out, 5e-4);
+    }
+
+    // gaussian_blur applies a row and a column kernel, whose product is the kernel of gaussian_blur_naive.
+    const float blur_std_devs[] = { 1.4f, 3.0f };
+    for (size_t k = 0; k < sizeof(blur_std_devs) / sizeof(blur_std_devs[0]); k++) {
+        float std_dev = blur_std_devs[k];
+        ssize_t size_f = (ssize_t) std::ceil(3 * std_dev);
+        Image separable = im, naive = im;
+        separable.gaussian_blur(std_dev, size_f, BLUR_FIR);
+        naive.gaussian_blur_naive(std_dev, size_f);
+        expect_close("gaussian_blur " + std::to_string(std_dev).substr(0, 3), pixels(naive), pixels(separable), 1e-3);
+    }
+
+    // The recursive filter only approximates a gaussian, with an error which is largest around edges. On this
+    //      photograph it stays within 3.3 of the FIR blur, and within 0.5 on average; pixels near the border are
+    //      left out, as the recursive filter extends the image past it.
+    Image photo = Image::readJPEG(FOURIER_TEST_IMAGES "/eagle.jpeg");
+    photo.to_gray();
+    const float std_devs[] = { 8.0f, 20.0f };
+    for (size_t k = 0; k < sizeof(std_devs) / sizeof(std_devs[0]); k++) {
+        float std_dev = std_devs[k];
+        ssize_t size_f = (ssize_t) std::ceil(4 * std_dev);
+        std::string name = "IIR gaussian_blur " + std::to_string((int) std_dev);
+
+        std::vector<float> iir = same_for_any_threads(name, photo, [&](Image& x) {
+            x.gaussian_blur(std_dev, size_f, BLUR_IIR);
+        });
+        Image fir = photo;
+        fir.gaussian_blur(std_dev, size_f, BLUR_FIR);
+
+        std::vector<float> expected, actual;
+        ssize_t pw = photo.width(), ph = photo.height();
+        for (ssize_t j = 2 * size_f; j < ph - 2 * size_f; j++)
+            for (ssize_t i = 2 * size_f; i < pw - 2 * size_f; i++) {
+                expected.push_back(fir.buffer().row(INTENSITY, j)[i]);
+                actual.push_back(iir[pw * j + i]);
+            }
+        expect_close(name, expected, actual, 5.0, 0.75);
+    }
+
+    printf("convolutions checked\n");
+    return check_status();
+}
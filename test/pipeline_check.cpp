@@ -0,0 +1,147 @@
+// Checks Pipeline::apply, which applies its stages tile by tile, against the methods of Image applied to the whole
+//      image, with square and non-square kernels, whose tiles need borders of different widths and heights, chains
+//      of stages, and the global hysteresis of canny_edge_detect. Images and PackedImages of float samples are both
+//      checked, whatever the number of threads.
+// Exits with status 1, listing the checks which fail, if any do.
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <functional>
+#include "Check.hpp"
+#include "Image.hpp"
+#include "Kernel.hpp"
+#include "Pipeline.hpp"
+#include "PackedImage.hpp"
+#include "ThreadPool.hpp"
+
+// a kern_h x kern_w kernel with random elements in [-1, 1) which sum to 1, the same for the same seed.
+static
+Kernel
+random_kernel(ssize_t kern_w,
+              ssize_t kern_h,
+              uint32_t seed)
+{
+    std::vector<float> v = random_floats(kern_w * kern_h, seed, -1.0f, 1.0f);
+    float sum = 0.0f;
+    for (auto it = v.begin(); it != v.end(); ++it)
+        sum += *it;
+    Kernel kern(kern_h, KernelRow(kern_w));
+    for (ssize_t n = 0; n < kern_h; n++)
+        for (ssize_t m = 0; m < kern_w; m++)
+            kern[n][m] = v[kern_w * n + m] - (sum - 1.0f) / (kern_w * kern_h);
+    return kern;
+}
+
+// Applies pipeline to im with 1, 3 and 8 threads, as an Image and as a PackedImage of floats, and checks the
+//      results against op applied to the whole of im. Tiles are computed as the whole image is, except by the
+//      FFT convolutions and box blurs, which sum in a different order, so those are checked to within max_error.
+static
+void
+check_apply(const std::string& name,
+            const Image& im,
+            const Pipeline& pipeline,
+            const std::function<void(Image&)>& op,
+            double max_error=0.0)
+{
+    Image whole = im;
+    op(whole);
+    std::vector<float> expected = pixels(whole);
+
+    ThreadPool& pool = ThreadPool::instance();
+    size_t n_threads = pool.num_threads();
+    const size_t thread_counts[] = { 1, 3, 8 };
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        pool.set_num_threads(thread_counts[t]);
+        std::string threads = " with " + std::to_string(thread_counts[t]) + " threads";
+
+        Image out = pipeline.apply(im);
+        PackedImage packed = pipeline.apply(PackedImage(im, SAMPLE_F32));
+        if (max_error == 0.0) {
+            expect_same(name + threads, expected, pixels(out));
+            expect_same(name + " packed" + threads, expected, pixels(packed.unpack()));
+        } else {
+            expect_close(name + threads, expected, pixels(out), max_error);
+            expect_close(name + " packed" + threads, expected, pixels(packed.unpack()), max_error);
+        }
+    }
+    pool.set_num_threads(n_threads);
+}
+
+// Checks a pipeline convolving with a kern_w x kern_h kernel. FFT convolutions of the tiles are checked to within
+//      1e-6 of the largest pixel the kernel can give, i.e. the sum of the absolute values of its elements times 255.
+static
+void
+check_convolve(const std::string& image_name,
+               const Image& im,
+               ssize_t kern_w,
+               ssize_t kern_h,
+               uint32_t seed,
+               bool fft=false)
+{
+    Kernel kern = random_kernel(kern_w, kern_h, seed);
+    double max_error = 0.0;
+    for (auto row = kern.begin(); fft && row != kern.end(); ++row)
+        for (auto it = row->begin(); it != row->end(); ++it)
+            max_error += 1e-6 * 255.0 * std::fabs(*it);
+
+    Pipeline pipeline;
+    pipeline.convolve(kern);
+    check_apply("convolve " + std::to_string(kern_w) + "x" + std::to_string(kern_h) + " " + image_name, im,
+                pipeline, [&](Image& x) { x.convolve(kern); }, max_error);
+}
+
+int
+main()
+{
+    Image photo = Image::readJPEG(FOURIER_TEST_IMAGES "/eagle.jpeg");
+    Image gray = photo;
+    gray.to_gray();
+    // small enough that the smallest tiles do not divide it evenly.
+    Image noise = random_image(203, 157, RGB, 1);
+
+    const Image *images[] = { &gray, &photo, &noise };
+    const char *names[] = { "eagle.jpeg gray", "eagle.jpeg", "noise" };
+    for (size_t k = 0; k < sizeof(images) / sizeof(images[0]); k++) {
+        const Image& im = *images[k];
+        std::string name = names[k];
+
+        // single rows and columns, and kernels much wider than high or the reverse, are applied directly.
+        check_convolve(name, im, 3, 3, 10 * k + 1);
+        check_convolve(name, im, 1, 41, 10 * k + 2);
+        check_convolve(name, im, 41, 1, 10 * k + 3);
+        check_convolve(name, im, 3, 41, 10 * k + 4);
+        check_convolve(name, im, 41, 3, 10 * k + 5);
+        // large kernels of full rank are applied in the frequency domain.
+        check_convolve(name, im, 61, 31, 10 * k + 6, true);
+        check_convolve(name, im, 25, 71, 10 * k + 7, true);
+
+        Pipeline blur;
+        blur.gaussian_blur(3.0f, 9);
+        check_apply("gaussian_blur " + name, im, blur, [](Image& x) { x.gaussian_blur(3.0f, 9, BLUR_FIR); });
+
+        Pipeline box;
+        box.box_blur(7);
+        check_apply("box_blur " + name, im, box, [](Image& x) { x.box_blur(7); }, 1e-3);
+
+        // the borders of the tiles are the sums of the radii, which differ horizontally and vertically.
+        Kernel wide = random_kernel(41, 1, 10 * k + 8), tall = random_kernel(1, 21, 10 * k + 9);
+        Pipeline chain;
+        chain.convolve(wide).add(10.0f).multiply(0.5f).convolve(tall).convolve(wide).gaussian_blur(1.4f, 2);
+        check_apply("chain " + name, im, chain, [&](Image& x) {
+            x.convolve(wide);
+            x += 10.0f;
+            x *= 0.5f;
+            x.convolve(tall);
+            x.convolve(wide);
+            x.gaussian_blur(1.4f, 2, BLUR_FIR);
+        });
+
+        Pipeline canny;
+        canny.canny_edge_detect();
+        check_apply("canny_edge_detect " + name, im, canny, [](Image& x) { x.canny_edge_detect(1.4f, 2); });
+    }
+
+    printf("pipelines checked\n");
+    return check_status();
+}
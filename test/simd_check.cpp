@@ -0,0 +1,154 @@
+// Checks that the kernels of every instruction set supported by the CPU produce exactly the same floats as the
+//     scalar kernels, i.e. that the results of the library do not depend on the CPU it runs on.
+// Exits with status 1, listing the kernels which differ, if any do. Setting FOURIER_SIMD caps the levels checked.
+
+#include <string>
+#include <vector>
+#include "Check.hpp"
+#include "Simd.hpp"
+#include "Convolve.hpp"
+#include "ColorMatrix.hpp"
+
+static
+const char *
+simd_name(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_NONE: return "none";
+        case SIMD_SSE42: return "sse4.2";
+        case SIMD_AVX2: return "avx2";
+        case SIMD_AVX512: return "avx512";
+    }
+    return "?";
+}
+
+static
+ConvolveKernels
+convolve_kernels_at(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_NONE: return convolve_kernels_scalar();
+        case SIMD_SSE42: return convolve_kernels_sse42();
+        case SIMD_AVX2: return convolve_kernels_avx2();
+        case SIMD_AVX512: return convolve_kernels_avx512();
+    }
+    return convolve_kernels_scalar();
+}
+
+// convolves a w x h image with kern_w x kern_h kernels, as general, row and column kernels.
+static
+void
+check_convolve(SimdLevel level,
+               ssize_t w,
+               ssize_t h,
+               ssize_t kern_w,
+               ssize_t kern_h)
+{
+    std::vector<float> src = random_floats(w * h, w * 31 + h, 0.0f, 255.0f);
+    std::vector<float> taps = random_floats(kern_w * kern_h, kern_w * 7 + kern_h, -0.5f, 0.5f);
+    ConvolveKernels scalar = convolve_kernels_scalar(), simd = convolve_kernels_at(level);
+
+    const ConvolveRowsFn ConvolveKernels::*fns[] = { &ConvolveKernels::general, &ConvolveKernels::row,
+                                                     &ConvolveKernels::column };
+    const char *names[] = { "general", "row", "column" };
+    for (size_t k = 0; k < 3; k++) {
+        // row kernels take a single row of taps, and column kernels a single column.
+        ssize_t kw = k == 2 ? 1 : kern_w, kh = k == 1 ? 1 : kern_h;
+        std::vector<float> expected(w * h, 0.0f), actual(w * h, 0.0f);
+        (scalar.*fns[k])(src.data(), w, expected.data(), w, w, kh / 2, h - kh / 2, taps.data(), kw, kh);
+        (simd.*fns[k])(src.data(), w, actual.data(), w, w, kh / 2, h - kh / 2, taps.data(), kw, kh);
+        expect_same("convolve " + std::string(names[k]) + " " + std::to_string(w) + "x" + std::to_string(h) +
+                    " kernel " + std::to_string(kw) + "x" + std::to_string(kh) + " (" + simd_name(level) + ")",
+                    expected, actual);
+    }
+}
+
+static
+ColorKernels
+color_kernels_at(SimdLevel level)
+{
+    switch (level) {
+        case SIMD_NONE: return color_kernels_scalar();
+        case SIMD_SSE42: return color_kernels_sse42();
+        case SIMD_AVX2: return color_kernels_avx2();
+        case SIMD_AVX512: return color_kernels_avx512();
+    }
+    return color_kernels_scalar();
+}
+
+// applies m to w x h planes, in floating and in fixed point. Inputs go somewhat beyond [0, 255], as the pixels
+//      of images which have been filtered may, so that the clamping of the fixed point kernels is checked too.
+static
+void
+check_color(SimdLevel level,
+            const std::string& name,
+            const ColorMatrix& m,
+            ssize_t w,
+            ssize_t h)
+{
+    ssize_t n_in = m.cmyk ? 4 : m.n_in;
+    std::vector<float> in = random_floats(w * h * n_in, w * 13 + n_in, -20.0f, 275.0f);
+    const float *in_planes[COLOR_MATRIX_MAX_PLANES + 1];
+    for (ssize_t k = 0; k < n_in; k++)
+        in_planes[k] = in.data() + w * h * k;
+    ColorKernels scalar = color_kernels_scalar(), simd = color_kernels_at(level);
+
+    const ColorRowsFn ColorKernels::*fns[] = { &ColorKernels::floating, &ColorKernels::fixed };
+    const char *precisions[] = { "float", "fixed16" };
+    for (size_t k = 0; k < 2; k++) {
+        std::vector<float> expected(w * h * m.n_out, 0.0f), actual(w * h * m.n_out, 0.0f);
+        float *expected_planes[COLOR_MATRIX_MAX_PLANES], *actual_planes[COLOR_MATRIX_MAX_PLANES];
+        for (ssize_t r = 0; r < m.n_out; r++) {
+            expected_planes[r] = expected.data() + w * h * r;
+            actual_planes[r] = actual.data() + w * h * r;
+        }
+        (scalar.*fns[k])(m, in_planes, w, expected_planes, w, w, 0, h);
+        (simd.*fns[k])(m, in_planes, w, actual_planes, w, w, 0, h);
+        expect_same("color " + name + " " + precisions[k] + " " + std::to_string(w) + "x" + std::to_string(h) +
+                    " (" + simd_name(level) + ")", expected, actual);
+    }
+}
+
+int
+main()
+{
+    // widths which are not multiples of any vector width, so that the tails of rows are checked too.
+    const ssize_t widths[] = { 37, 203 };
+    const ssize_t kernel_sizes[] = { 1, 3, 5, 9, 15 };
+
+    for (int l = SIMD_SSE42; l <= simd_level(); l++) {
+        SimdLevel level = (SimdLevel) l;
+        for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++)
+            for (size_t k = 0; k < sizeof(kernel_sizes) / sizeof(kernel_sizes[0]); k++)
+                check_convolve(level, widths[i], 41, kernel_sizes[k], kernel_sizes[k]);
+
+        // the matrices of the colour conversions of Image, and one with every input and output.
+        const ColorMatrix matrices[] = {
+            color_matrix(3, { { 65.738 / 256.0, 129.057 / 256.0, 25.064 / 256.0, 16.0 },
+                              { -37.945 / 256.0, -74.494 / 256.0, 112.439 / 256.0, 128.0 },
+                              { 112.439 / 256.0, -94.154 / 256.0, -18.285 / 256.0, 128.0 } }),
+            color_matrix(3, { { 298.082 / 256.0, 0.0, 408.583 / 256.0, -222.921 },
+                              { 298.082 / 256.0, -100.291 / 256.0, -208.120 / 256.0, 135.576 },
+                              { 298.082 / 256.0, 516.412 / 256.0, 0.0, -276.836 } }),
+            color_matrix(3, { { 65.738 / 256.0, 129.057 / 256.0, 25.064 / 256.0, 16.0 } }),
+            color_matrix(1, { { 298.082 / 256.0, -222.921 },
+                              { 298.082 / 256.0, 135.576 },
+                              { 298.082 / 256.0, -276.836 } }),
+            color_matrix(3, { { 65.738 / 256.0, 129.057 / 256.0, 25.064 / 256.0, 16.0 },
+                              { -37.945 / 256.0, -74.494 / 256.0, 112.439 / 256.0, 128.0 },
+                              { 112.439 / 256.0, -94.154 / 256.0, -18.285 / 256.0, 128.0 } }, true),
+            color_matrix(4, { { 0.1, -0.2, 0.3, -0.4, 5.0 },
+                              { 0.5, 0.6, -0.7, 0.8, -9.0 },
+                              { -1.1, 1.2, 1.3, 1.4, 1.5 },
+                              { 0.01, 0.02, 0.03, 0.04, 0.05 } }),
+        };
+        const char *names[] = { "RGB to YCbCr", "YCbCr to RGB", "RGB to gray", "gray to RGB", "CMYK to YCbCr",
+                                "4 to 4" };
+        for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++)
+            for (size_t k = 0; k < sizeof(matrices) / sizeof(matrices[0]); k++)
+                check_color(level, names[k], matrices[k], widths[i], 9);
+        printf("%s checked\n", simd_name(level));
+    }
+
+    return check_status();
+}